@@ -0,0 +1,380 @@
+/**
+ * \file dataflow_bench.c
+ * \brief Benchmark for the dataflow analysis of the optimizer
+ *
+ * This program builds a function with many stores and times how long the
+ * optimizer takes to solve one of its dataflow analyses for it: the stores
+ * that reach each block, or the local variables live at each block. The
+ * function is a chain of blocks, each of which stores to a few of a fixed set
+ * of local variables, and ends in a branch either to the next block or back
+ * to an earlier one, so that the analysis has loops to iterate over.
+ *
+ * With `-d depth`, the function is instead a nest of loops that deep, with the
+ * blocks as the body of the innermost one. Every loop header and latch stores
+ * too, so that what they store has to travel around every loop.
+ *
+ * With `-A`, the metadata is allocated from an arena that is reset after every
+ * run, as the optimizer does, rather than with `malloc`.
+ *
+ * Usage: `dataflow_bench [-a reaching|liveness] [-b blocks] [-s stores]
+ * [-v variables] [-d depth] [-r runs] [-A]`
+ */
+#include <llvm-c/Core.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "llvm_utils.h"
+
+/**
+ * \brief Add stores to random variables at the end of a block
+ *
+ * \param[in] builder A builder positioned at the end of the block
+ * \param[in] vars The variables to store to
+ * \param[in] numVars The number of variables
+ * \param[in] numStores The number of stores to add
+ */
+static void buildStores(LLVMBuilderRef builder, LLVMValueRef *vars,
+                        int numVars, int numStores) {
+    LLVMTypeRef i32 = LLVMInt32Type();
+
+    // half of the stores write a constant, and the other half a value
+    // loaded from another variable
+    for (int j = 0; j < numStores; j++) {
+        LLVMValueRef var = vars[rand() % numVars];
+        LLVMValueRef val = LLVMConstInt(i32, rand() % 4, 0);
+
+        if (j % 2 == 1)
+            val = LLVMBuildLoad2(builder, i32, vars[rand() % numVars], "");
+        LLVMBuildStore(builder, val, var);
+    }
+}
+
+/**
+ * \brief Build a conditional branch on the value of a random variable
+ *
+ * \param[in] builder A builder positioned at the end of the block to end
+ * \param[in] vars The variables to branch on
+ * \param[in] numVars The number of variables
+ * \param[in] then The block to branch to when the variable is zero
+ * \param[in] otherwise The block to branch to when it isn't
+ */
+static void buildCondBr(LLVMBuilderRef builder, LLVMValueRef *vars,
+                        int numVars, LLVMBasicBlockRef then,
+                        LLVMBasicBlockRef otherwise) {
+    LLVMTypeRef i32 = LLVMInt32Type();
+    LLVMValueRef cond = LLVMBuildICmp(
+        builder, LLVMIntEQ,
+        LLVMBuildLoad2(builder, i32, vars[rand() % numVars], ""),
+        LLVMConstInt(i32, 0, 0), "");
+    LLVMBuildCondBr(builder, cond, then, otherwise);
+}
+
+/**
+ * \brief Build the function to analyze
+ *
+ * The blocks, stores and variables are chosen with a fixed seed, so that every
+ * run analyzes the same function.
+ *
+ * \param[in] m The module to add the function to
+ * \param[in] numBlocks The number of blocks after the entry block
+ * \param[in] storesPerBlock The number of stores in each of those blocks
+ * \param[in] numVars The number of local variables stored to
+ * \returns The function
+ */
+static LLVMValueRef buildFunction(LLVMModuleRef m, int numBlocks,
+                                  int storesPerBlock, int numVars) {
+    LLVMTypeRef i32 = LLVMInt32Type();
+    LLVMValueRef fn =
+        LLVMAddFunction(m, "bench", LLVMFunctionType(i32, NULL, 0, 0));
+    LLVMBuilderRef builder = LLVMCreateBuilder();
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlock(fn, "entry");
+    LLVMBasicBlockRef *blocks = malloc(sizeof(LLVMBasicBlockRef) * numBlocks);
+    LLVMValueRef *vars = malloc(sizeof(LLVMValueRef) * numVars);
+
+    for (int i = 0; i < numBlocks; i++) {
+        blocks[i] = LLVMAppendBasicBlock(fn, "");
+    }
+    LLVMBasicBlockRef exit = LLVMAppendBasicBlock(fn, "exit");
+
+    LLVMPositionBuilderAtEnd(builder, entry);
+
+    for (int i = 0; i < numVars; i++) {
+        vars[i] = LLVMBuildAlloca(builder, i32, "");
+        LLVMBuildStore(builder, LLVMConstInt(i32, 0, 0), vars[i]);
+    }
+    LLVMBuildBr(builder, blocks[0]);
+
+    srand(57);
+
+    for (int i = 0; i < numBlocks; i++) {
+        LLVMPositionBuilderAtEnd(builder, blocks[i]);
+        buildStores(builder, vars, numVars, storesPerBlock);
+
+        LLVMBasicBlockRef next = i + 1 < numBlocks ? blocks[i + 1] : exit;
+
+        // every fourth block may loop back to one of the blocks before it
+        if (i % 4 == 3) {
+            buildCondBr(builder, vars, numVars, blocks[rand() % (i + 1)], next);
+        } else {
+            LLVMBuildBr(builder, next);
+        }
+    }
+
+    LLVMPositionBuilderAtEnd(builder, exit);
+    LLVMBuildRet(builder, LLVMBuildLoad2(builder, i32, vars[0], ""));
+
+    free(vars);
+    free(blocks);
+    LLVMDisposeBuilder(builder);
+    return fn;
+}
+
+/**
+ * \brief Build a function that is a nest of loops
+ *
+ * \param[in] m The module to add the function to
+ * \param[in] numBlocks The number of blocks in the body of the innermost loop
+ * \param[in] storesPerBlock The number of stores in each block
+ * \param[in] numVars The number of local variables stored to
+ * \param[in] depth The number of loops
+ * \returns The function
+ */
+static LLVMValueRef buildLoopNest(LLVMModuleRef m, int numBlocks,
+                                  int storesPerBlock, int numVars, int depth) {
+    LLVMTypeRef i32 = LLVMInt32Type();
+    LLVMValueRef fn =
+        LLVMAddFunction(m, "bench", LLVMFunctionType(i32, NULL, 0, 0));
+    LLVMBuilderRef builder = LLVMCreateBuilder();
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlock(fn, "entry");
+    LLVMBasicBlockRef *headers = malloc(sizeof(LLVMBasicBlockRef) * depth);
+    LLVMBasicBlockRef *blocks = malloc(sizeof(LLVMBasicBlockRef) * numBlocks);
+    LLVMBasicBlockRef *latches = malloc(sizeof(LLVMBasicBlockRef) * depth);
+    LLVMValueRef *vars = malloc(sizeof(LLVMValueRef) * numVars);
+
+    for (int i = 0; i < depth; i++) {
+        headers[i] = LLVMAppendBasicBlock(fn, "");
+    }
+    for (int i = 0; i < numBlocks; i++) {
+        blocks[i] = LLVMAppendBasicBlock(fn, "");
+    }
+    // the latch of the innermost loop comes first
+    for (int i = depth - 1; i >= 0; i--) {
+        latches[i] = LLVMAppendBasicBlock(fn, "");
+    }
+    LLVMBasicBlockRef exit = LLVMAppendBasicBlock(fn, "exit");
+
+    LLVMPositionBuilderAtEnd(builder, entry);
+
+    for (int i = 0; i < numVars; i++) {
+        vars[i] = LLVMBuildAlloca(builder, i32, "");
+        LLVMBuildStore(builder, LLVMConstInt(i32, 0, 0), vars[i]);
+    }
+    LLVMBuildBr(builder, headers[0]);
+
+    srand(57);
+
+    for (int i = 0; i < depth; i++) {
+        LLVMPositionBuilderAtEnd(builder, headers[i]);
+        buildStores(builder, vars, numVars, storesPerBlock);
+        LLVMBuildBr(builder, i + 1 < depth ? headers[i + 1] : blocks[0]);
+    }
+
+    for (int i = 0; i < numBlocks; i++) {
+        LLVMPositionBuilderAtEnd(builder, blocks[i]);
+        buildStores(builder, vars, numVars, storesPerBlock);
+        LLVMBuildBr(builder,
+                    i + 1 < numBlocks ? blocks[i + 1] : latches[depth - 1]);
+    }
+
+    for (int i = depth - 1; i >= 0; i--) {
+        LLVMPositionBuilderAtEnd(builder, latches[i]);
+        buildStores(builder, vars, numVars, storesPerBlock);
+        buildCondBr(builder, vars, numVars, headers[i],
+                    i > 0 ? latches[i - 1] : exit);
+    }
+
+    LLVMPositionBuilderAtEnd(builder, exit);
+    LLVMBuildRet(builder, LLVMBuildLoad2(builder, i32, vars[0], ""));
+
+    free(vars);
+    free(latches);
+    free(blocks);
+    free(headers);
+    LLVMDisposeBuilder(builder);
+    return fn;
+}
+
+/**
+ * \brief Return the time elapsed since some point, in milliseconds
+ *
+ * \param[in] start The point to measure from
+ * \returns The elapsed time
+ */
+static double elapsedMs(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * \brief Time one run of the reaching stores analysis
+ *
+ * \param[in] fn The function to analyze
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL`
+ * \param[out] setupMs Incremented by the time taken to number the stores
+ * \param[out] solveMs Incremented by the time taken to solve the analysis
+ * \param[out] elements Set to the number of stores
+ * \param[out] evaluations Set to the number of blocks evaluated
+ */
+static void runReaching(LLVMValueRef fn, arena_t *arena, double *setupMs,
+                        double *solveMs, int *elements,
+                        unsigned int *evaluations) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    store_set_t *S = computeS(fn);
+    *setupMs += elapsedMs(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    meta_vec_t *metadata = computeBlockMData(fn, S, arena, evaluations);
+    *solveMs += elapsedMs(&start);
+
+    *elements = S->stores.length;
+    meta_vec_delete(metadata);
+    store_set_delete(S);
+
+    if (arena != NULL)
+        arenaReset(arena);
+}
+
+/**
+ * \brief Time one run of the liveness analysis
+ *
+ * \param[in] fn The function to analyze
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL`
+ * \param[out] setupMs Incremented by the time taken to number the variables
+ * \param[out] solveMs Incremented by the time taken to solve the analysis
+ * \param[out] elements Set to the number of variables
+ * \param[out] evaluations Set to the number of blocks evaluated
+ */
+static void runLiveness(LLVMValueRef fn, arena_t *arena, double *setupMs,
+                        double *solveMs, int *elements,
+                        unsigned int *evaluations) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    var_set_t *vars = computeVars(fn);
+    *setupMs += elapsedMs(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    meta_vec_t *metadata = computeLiveness(fn, vars, arena, evaluations);
+    *solveMs += elapsedMs(&start);
+
+    *elements = vars->vars.length;
+    meta_vec_delete(metadata);
+    var_set_delete(vars);
+
+    if (arena != NULL)
+        arenaReset(arena);
+}
+
+/**
+ * \brief Main entry point into the benchmark
+ *
+ * Parse the analysis and the size of the function, build it, and print the
+ * average time that each step of the analysis took over the runs.
+ */
+int main(int argc, char *argv[]) {
+    int numBlocks = 500;
+    int storesPerBlock = 8;
+    int numVars = 64;
+    const char *analysis = "reaching";
+    int depth = 0;
+    int runs = 5;
+    bool useArena = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:b:s:v:d:r:A")) != -1) {
+        switch (opt) {
+        case 'a':
+            analysis = optarg;
+            break;
+        case 'b':
+            numBlocks = atoi(optarg);
+            break;
+        case 's':
+            storesPerBlock = atoi(optarg);
+            break;
+        case 'v':
+            numVars = atoi(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'A':
+            useArena = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: dataflow_bench [-a reaching|liveness] "
+                            "[-b blocks] [-s stores] [-v variables] "
+                            "[-d depth] [-r runs] [-A]\n");
+            return 1;
+        }
+    }
+
+    if (numBlocks < 1 || storesPerBlock < 0 || numVars < 1 || depth < 0 ||
+        runs < 1) {
+        fprintf(stderr, "Every size must be positive\n");
+        return 1;
+    }
+
+    void (*run)(LLVMValueRef, arena_t *, double *, double *, int *,
+                unsigned int *);
+    const char *setupName;
+
+    if (strcmp(analysis, "reaching") == 0) {
+        run = runReaching;
+        setupName = "computeS";
+    } else if (strcmp(analysis, "liveness") == 0) {
+        run = runLiveness;
+        setupName = "computeVars";
+    } else {
+        fprintf(stderr, "Unknown analysis: %s\n", analysis);
+        return 1;
+    }
+
+    LLVMModuleRef m = LLVMModuleCreateWithName("bench");
+    LLVMValueRef fn =
+        depth > 0
+            ? buildLoopNest(m, numBlocks, storesPerBlock, numVars, depth)
+            : buildFunction(m, numBlocks, storesPerBlock, numVars);
+
+    arena_t *arena = useArena ? arenaCreate(64 * 1024) : NULL;
+    double setupMs = 0;
+    double solveMs = 0;
+    int elements = 0;
+    unsigned int evaluations = 0;
+
+    for (int i = 0; i < runs; i++) {
+        run(fn, arena, &setupMs, &solveMs, &elements, &evaluations);
+    }
+
+    printf("analysis=%s blocks=%d elements=%d variables=%d depth=%d "
+           "runs=%d\n",
+           analysis, numBlocks + 2 * depth + 2, elements, numVars, depth, runs);
+    printf("%s=%.2fms solve=%.2fms evaluations=%u\n", setupName,
+           setupMs / runs, solveMs / runs, evaluations);
+
+    if (arena != NULL)
+        arenaDelete(arena);
+    LLVMDisposeModule(m);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * \file gvn_bench.c
+ * \brief Benchmark for the global value numbering of the optimizer
+ *
+ * This program builds a function of a single block, the way clang builds one
+ * without optimizations: every statement loads two variables, combines them
+ * with an arithmetic operator and stores the result to a variable. Half of the
+ * variables are local and the other half global, so that GVN has both loads
+ * it can forward across any store and loads that the stores to globals make
+ * it load again. The operands are drawn from few variables, so the same
+ * expressions come back.
+ *
+ * Every run builds the function again, and times numbering it and applying
+ * the numbers separately.
+ *
+ * Usage: `gvn_bench [-n statements] [-v variables] [-r runs]`
+ */
+#include <llvm-c/Core.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "gvn.h"
+
+/**
+ * \brief Build the function to number
+ *
+ * The statements are chosen with a fixed seed, so that every run numbers the
+ * same function.
+ *
+ * \param[in] m The module to add the function to
+ * \param[in] globals The global variables, as many as the local ones
+ * \param[in] numStatements The number of statements
+ * \param[in] numVars The number of local variables
+ * \returns The function
+ */
+static LLVMValueRef buildFunction(LLVMModuleRef m, LLVMValueRef *globals,
+                                  int numStatements, int numVars) {
+    LLVMTypeRef i32 = LLVMInt32Type();
+    LLVMValueRef fn =
+        LLVMAddFunction(m, "bench", LLVMFunctionType(i32, NULL, 0, 0));
+    LLVMBuilderRef builder = LLVMCreateBuilder();
+    LLVMValueRef *vars = malloc(sizeof(LLVMValueRef) * 2 * numVars);
+    const LLVMOpcode opcodes[] = {LLVMAdd, LLVMSub, LLVMMul, LLVMXor};
+
+    LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlock(fn, "entry"));
+
+    for (int i = 0; i < numVars; i++) {
+        vars[i] = LLVMBuildAlloca(builder, i32, "");
+        vars[numVars + i] = globals[i];
+        LLVMBuildStore(builder, LLVMConstInt(i32, i, 0), vars[i]);
+    }
+
+    srand(57);
+
+    for (int i = 0; i < numStatements; i++) {
+        LLVMValueRef x =
+            LLVMBuildLoad2(builder, i32, vars[rand() % (2 * numVars)], "");
+        LLVMValueRef y =
+            LLVMBuildLoad2(builder, i32, vars[rand() % (2 * numVars)], "");
+        LLVMValueRef value =
+            LLVMBuildBinOp(builder, opcodes[rand() % 4], x, y, "");
+        LLVMBuildStore(builder, value, vars[rand() % (2 * numVars)]);
+    }
+
+    LLVMBuildRet(builder, LLVMBuildLoad2(builder, i32, vars[0], ""));
+
+    free(vars);
+    LLVMDisposeBuilder(builder);
+    return fn;
+}
+
+/**
+ * \brief Return the time elapsed since some point, in milliseconds
+ *
+ * \param[in] start The point to measure from
+ * \returns The elapsed time
+ */
+static double elapsedMs(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * \brief Main entry point into the benchmark
+ *
+ * Parse the size of the function, and print the average time that numbering
+ * it and applying the numbers took over the runs.
+ */
+int main(int argc, char *argv[]) {
+    int numStatements = 10000;
+    int numVars = 16;
+    int runs = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:v:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            numStatements = atoi(optarg);
+            break;
+        case 'v':
+            numVars = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: gvn_bench [-n statements] [-v variables] "
+                            "[-r runs]\n");
+            return 1;
+        }
+    }
+
+    if (numStatements < 0 || numVars < 1 || runs < 1) {
+        fprintf(stderr, "Every size must be positive\n");
+        return 1;
+    }
+
+    LLVMModuleRef m = LLVMModuleCreateWithName("bench");
+    LLVMValueRef *globals = malloc(sizeof(LLVMValueRef) * numVars);
+
+    for (int i = 0; i < numVars; i++) {
+        globals[i] = LLVMAddGlobal(m, LLVMInt32Type(), "");
+        LLVMSetInitializer(globals[i], LLVMConstInt(LLVMInt32Type(), 0, 0));
+    }
+
+    arena_t *arena = arenaCreate(64 * 1024);
+    double solveMs = 0;
+    double applyMs = 0;
+    gvn_stats_t stats = {0, 0, 0};
+
+    for (int i = 0; i < runs; i++) {
+        LLVMValueRef fn = buildFunction(m, globals, numStatements, numVars);
+        struct timespec start;
+        stats = (gvn_stats_t){0, 0, 0};
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        gvn_t *gvn = gvnSolve(fn, arena, &stats);
+        solveMs += elapsedMs(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        gvnApply(gvn);
+        applyMs += elapsedMs(&start);
+
+        gvn_delete(gvn);
+        arenaReset(arena);
+        LLVMDeleteFunction(fn);
+    }
+
+    printf("statements=%d variables=%d instructions=%u runs=%d\n",
+           numStatements, numVars, stats.instructions, runs);
+    printf("solve=%.2fms apply=%.2fms expressions=%d loads=%d\n",
+           solveMs / runs, applyMs / runs, stats.expressions, stats.loads);
+
+    arenaDelete(arena);
+    free(globals);
+    LLVMDisposeModule(m);
+    return 0;
+}
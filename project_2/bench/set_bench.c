@@ -0,0 +1,250 @@
+/**
+ * \file set_bench.c
+ * \brief Benchmark for the set operations on vectors
+ *
+ * This program times `setUnion`, `setDedup` and `setEqual` against the
+ * versions that they replaced, which searched the vector they were building
+ * for every element. The elements are pointers into one allocation, spaced
+ * like the objects that the optimizer stores in its sets.
+ *
+ * The union is of two vectors of `-n` elements that share half of them, the
+ * deduplicated vector holds each of `-n` elements twice, and the equality is
+ * between a vector and a shuffled copy of it, which makes both versions look
+ * at every element.
+ *
+ * Usage: `set_bench [-n elements] [-r runs]`
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "set_utils.h"
+#include "vec.h"
+
+/**
+ * \brief Deduplicate a vector by searching the result for every element
+ *
+ * \param[in] a A vector
+ * \returns A new vector with the deduplicated elements of vector `a`
+ */
+static vec_void_t *scanDedup(vec_void_t *a) {
+    vec_void_t *newSet = malloc(sizeof(vec_void_t));
+    vec_init(newSet);
+    void *it;
+    int i = 0;
+    int found = -1;
+
+    vec_foreach(a, it, i) {
+        vec_find(newSet, it, found);
+
+        if (found == -1)
+            vec_push(newSet, it);
+    }
+    return newSet;
+}
+
+/**
+ * \brief Compute the union of two vectors by deduplicating both of them
+ *
+ * \param[in] a A vector/set
+ * \param[in] b A vector/set
+ * \returns A new vector with the union of the elements between `a` and `b`
+ */
+static vec_void_t *scanUnion(vec_void_t *a, vec_void_t *b) {
+    vec_void_t tempSet;
+    vec_init(&tempSet);
+    int i;
+    void *it;
+
+    vec_foreach(a, it, i) { vec_push(&tempSet, it); }
+    vec_foreach(b, it, i) { vec_push(&tempSet, it); }
+    vec_void_t *dedupedSet = scanDedup(&tempSet);
+    vec_deinit(&tempSet);
+    return dedupedSet;
+}
+
+/**
+ * \brief Compare two vectors by searching each one for the elements of the
+ * other
+ *
+ * \param[in] a A vector
+ * \param[in] b A vector
+ * \returns Whether the vectors have set equality
+ */
+static bool scanEqual(vec_void_t *a, vec_void_t *b) {
+    bool equal = true;
+    void *it;
+    int i;
+    int found = -1;
+
+    vec_foreach(a, it, i) {
+        vec_find(b, it, found);
+
+        if (found == -1)
+            equal = false;
+    }
+
+    vec_foreach(b, it, i) {
+        vec_find(a, it, found);
+
+        if (found == -1)
+            equal = false;
+    }
+    return equal;
+}
+
+/**
+ * \brief Return the time elapsed since some point, in milliseconds
+ *
+ * \param[in] start The point to measure from
+ * \returns The elapsed time
+ */
+static double elapsedMs(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * \brief Shuffle the elements of a vector
+ *
+ * \param[in,out] vec The vector to shuffle
+ */
+static void shuffle(vec_void_t *vec) {
+    for (int i = vec->length - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        void *tmp = vec->data[i];
+        vec->data[i] = vec->data[j];
+        vec->data[j] = tmp;
+    }
+}
+
+/**
+ * \brief Main entry point into the benchmark
+ *
+ * Build the vectors, run every operation with both versions, and print the
+ * average time that each took over the runs along with the size of its
+ * result, which has to be the same for both.
+ */
+int main(int argc, char *argv[]) {
+    int numElements = 1000;
+    int runs = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            numElements = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: set_bench [-n elements] [-r runs]\n");
+            return 1;
+        }
+    }
+
+    if (numElements < 1 || runs < 1) {
+        fprintf(stderr, "Every size must be positive\n");
+        return 1;
+    }
+
+    // the elements are chosen with a fixed seed, so that every run uses the
+    // same vectors
+    srand(1);
+    int poolSize = numElements + numElements / 2;
+    char *pool = malloc(poolSize * 16);
+
+    vec_void_t a;
+    vec_void_t b;
+    vec_void_t twice;
+    vec_void_t shuffled;
+    vec_init(&a);
+    vec_init(&b);
+    vec_init(&twice);
+    vec_init(&shuffled);
+
+    for (int i = 0; i < numElements; i++) {
+        vec_push(&a, &pool[i * 16]);
+        vec_push(&b, &pool[(i + numElements / 2) * 16]);
+        vec_push(&twice, &pool[i * 16]);
+        vec_push(&twice, &pool[i * 16]);
+        vec_push(&shuffled, &pool[i * 16]);
+    }
+    shuffle(&b);
+    shuffle(&twice);
+    shuffle(&shuffled);
+
+    double scanMs[3] = {0};
+    double hashMs[3] = {0};
+    int scanResult[3] = {0};
+    int hashResult[3] = {0};
+
+    for (int r = 0; r < runs; r++) {
+        struct timespec start;
+        vec_void_t *result;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = scanUnion(&a, &b);
+        scanMs[0] += elapsedMs(&start);
+        scanResult[0] = result->length;
+        vec_deinit(result);
+        free(result);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = setUnion(&a, &b);
+        hashMs[0] += elapsedMs(&start);
+        hashResult[0] = result->length;
+        vec_deinit(result);
+        free(result);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = scanDedup(&twice);
+        scanMs[1] += elapsedMs(&start);
+        scanResult[1] = result->length;
+        vec_deinit(result);
+        free(result);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = setDedup(&twice);
+        hashMs[1] += elapsedMs(&start);
+        hashResult[1] = result->length;
+        vec_deinit(result);
+        free(result);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        scanResult[2] = scanEqual(&a, &shuffled);
+        scanMs[2] += elapsedMs(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        hashResult[2] = setEqual(&a, &shuffled);
+        hashMs[2] += elapsedMs(&start);
+    }
+
+    const char *names[3] = {"union", "dedup", "equal"};
+    int status = 0;
+
+    printf("elements=%d runs=%d\n", numElements, runs);
+
+    for (int i = 0; i < 3; i++) {
+        printf("%s: scan=%.2fus hash=%.2fus result=%d\n", names[i],
+               1e3 * scanMs[i] / runs, 1e3 * hashMs[i] / runs,
+               hashResult[i]);
+
+        if (scanResult[i] != hashResult[i]) {
+            fprintf(stderr, "%s: the versions disagree (%d and %d)\n",
+                    names[i], scanResult[i], hashResult[i]);
+            status = 1;
+        }
+    }
+
+    vec_deinit(&a);
+    vec_deinit(&b);
+    vec_deinit(&twice);
+    vec_deinit(&shuffled);
+    free(pool);
+    return status;
+}
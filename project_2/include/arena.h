@@ -0,0 +1,116 @@
+/**
+ * \file arena.h
+ * \brief Bump allocation of memory that is released all at once
+ *
+ * Optimizing a function creates many small objects, such as the metadata of
+ * every block and its sets, which all live until the optimizer is done with
+ * the function. An arena hands them out from large chunks by advancing an
+ * offset, so that they cost no call to `malloc` or `free` of their own, and
+ * releases all of them at once by moving the offset back.
+ *
+ * Resetting or rewinding an arena keeps its chunks for the allocations that
+ * follow, so an arena that is reused for one function after another only
+ * allocates when a function needs more memory than any before it.
+ */
+#include <stddef.h>
+
+#pragma once
+
+/// A chunk of memory that an arena allocates from
+struct arena_chunk_s;
+
+/// A region of memory that is allocated from in order and released at once
+struct arena_s {
+    /// The size of the chunks that the arena allocates, unless a single
+    /// allocation needs a larger one
+    size_t chunkSize;
+
+    /// The first chunk, which an arena always has
+    struct arena_chunk_s *first;
+
+    /// The chunk that allocations are taken from. The chunks after it are
+    /// free, and are used again once it is full.
+    struct arena_chunk_s *current;
+
+    /// The number of chunks that the arena allocated with `malloc`
+    unsigned int chunks;
+};
+
+/// A region of memory that is allocated from in order and released at once
+typedef struct arena_s arena_t;
+
+/// A position in an arena, which the arena can be rewound to
+struct arena_mark_s {
+    /// The chunk that was current
+    struct arena_chunk_s *chunk;
+
+    /// The number of bytes that were used in that chunk
+    size_t used;
+};
+
+/// A position in an arena
+typedef struct arena_mark_s arena_mark_t;
+
+/**
+ * \brief Create an empty arena
+ *
+ * Note that this function allocates a new arena that must be deleted later.
+ *
+ * \param[in] chunkSize The size of the chunks to allocate memory from
+ * \returns A newly allocated arena
+ */
+arena_t *arenaCreate(size_t chunkSize);
+
+/**
+ * \brief Delete an arena, along with everything allocated from it
+ *
+ * \param[in] arena The arena to delete
+ */
+void arenaDelete(arena_t *arena);
+
+/**
+ * \brief Allocate memory from an arena
+ *
+ * The memory is not initialized, and stays valid until the arena is reset,
+ * rewound to a mark from before the allocation, or deleted.
+ *
+ * \param[in,out] arena The arena to allocate from
+ * \param[in] size The number of bytes to allocate
+ * \param[in] alignment The alignment of the memory, which must be a power of
+ * two
+ * \returns The memory
+ */
+void *arenaAlloc(arena_t *arena, size_t size, size_t alignment);
+
+/**
+ * \brief Allocate an array from an arena
+ *
+ * \param[in,out] arena The arena to allocate from
+ * \param[in] n The number of elements, which may be 0
+ * \param[in] size The size of an element
+ * \returns The memory, aligned for elements of that size and not initialized
+ */
+void *arenaArray(arena_t *arena, int n, size_t size);
+
+/**
+ * \brief Return the current position of an arena
+ *
+ * \param[in] arena The arena
+ * \returns A mark that `arenaRewind` can release the later allocations with
+ */
+arena_mark_t arenaMark(const arena_t *arena);
+
+/**
+ * \brief Release everything allocated from an arena since a mark
+ *
+ * \param[in,out] arena The arena to rewind
+ * \param[in] mark A mark of the arena, taken after the last reset
+ */
+void arenaRewind(arena_t *arena, arena_mark_t mark);
+
+/**
+ * \brief Release everything allocated from an arena, keeping its chunks
+ *
+ * \param[in,out] arena The arena to reset
+ */
+void arenaReset(arena_t *arena);
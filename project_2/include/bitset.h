@@ -0,0 +1,166 @@
+/**
+ * \file bitset.h
+ * \brief Dense sets of small integers, stored as bit vectors
+ *
+ * The dataflow analyses number the values they track from zero, so a set of
+ * those values can be a bit vector with one bit per number. Union, difference
+ * and equality then work on 64 elements at a time, and on 256 when the
+ * program is built with AVX2.
+ *
+ * The words of a set are padded to a multiple of `BITSET_GROUP_WORDS` and
+ * aligned to the size of a group, so that the loops over them never need a
+ * scalar tail. Only sets of the same size may be combined.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#pragma once
+
+/// The number of words that the loops over a set process at once
+#define BITSET_GROUP_WORDS 4
+
+/// A set of the integers from 0 up to some size
+struct bitset_s {
+    /// The number of integers that the set can hold
+    int size;
+
+    /// The number of words in `bits`, a multiple of `BITSET_GROUP_WORDS`
+    int words;
+
+    /// The words, where integer `i` is bit `i % 64` of word `i / 64`
+    uint64_t *bits;
+};
+
+/// A set of the integers from 0 up to some size
+typedef struct bitset_s bitset_t;
+
+/**
+ * \brief Create an empty set
+ *
+ * Note that this function allocates a new set that must be deleted later.
+ *
+ * \param[in] size The number of integers that the set can hold
+ * \returns A newly allocated set
+ */
+bitset_t *bitsetCreate(int size);
+
+/**
+ * \brief Create an empty set in an arena
+ *
+ * The set is released with the arena, and must not be deleted.
+ *
+ * \param[in,out] arena The arena to allocate the set from
+ * \param[in] size The number of integers that the set can hold
+ * \returns The set
+ */
+bitset_t *bitsetCreateIn(arena_t *arena, int size);
+
+/**
+ * \brief Delete a set
+ *
+ * \param[in] set The set to delete
+ */
+void bitsetDelete(bitset_t *set);
+
+/**
+ * \brief Add an integer to a set
+ *
+ * \param[in] set The set to add to
+ * \param[in] i The integer to add, which must be less than the size of the set
+ */
+static inline void bitsetAdd(bitset_t *set, int i) {
+    set->bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/**
+ * \brief Remove an integer from a set
+ *
+ * \param[in] set The set to remove from
+ * \param[in] i The integer to remove, which must be less than the size of the
+ * set
+ */
+static inline void bitsetRemove(bitset_t *set, int i) {
+    set->bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+/**
+ * \brief Return whether a set contains an integer
+ *
+ * \param[in] set The set to inspect
+ * \param[in] i The integer to look for, which must be less than the size of
+ * the set
+ * \returns Whether `i` is in the set
+ */
+static inline bool bitsetContains(const bitset_t *set, int i) {
+    return (set->bits[i / 64] >> (i % 64)) & 1;
+}
+
+/**
+ * \brief Find the smallest integer in a set that isn't less than some bound
+ *
+ * \param[in] set The set to inspect
+ * \param[in] from The bound, which may be the size of the set
+ * \returns The integer, or -1 if the set has none that is at least `from`
+ */
+int bitsetNext(const bitset_t *set, int from);
+
+/**
+ * \brief Remove every integer from a set
+ *
+ * \param[in] set The set to clear
+ */
+void bitsetClear(bitset_t *set);
+
+/**
+ * \brief Add every integer that a set can hold to it
+ *
+ * \param[in] set The set to fill
+ */
+void bitsetFill(bitset_t *set);
+
+/**
+ * \brief Make a set hold the same integers as another one
+ *
+ * \param[out] dst The set to overwrite
+ * \param[in] src The set to copy
+ */
+void bitsetCopy(bitset_t *dst, const bitset_t *src);
+
+/**
+ * \brief Add the integers of one set to another
+ *
+ * \param[in,out] dst The set to add to
+ * \param[in] src The set whose integers are added
+ * \returns Whether `dst` gained any integers
+ */
+bool bitsetUnion(bitset_t *dst, const bitset_t *src);
+
+/**
+ * \brief Remove the integers from a set that another set doesn't hold
+ *
+ * \param[in,out] dst The set to remove from
+ * \param[in] src The set whose integers are kept
+ */
+void bitsetIntersect(bitset_t *dst, const bitset_t *src);
+
+/**
+ * \brief Compute the difference of two sets
+ *
+ * `dst` may be the same set as `a`.
+ *
+ * \param[out] dst The set to store `a - b` in
+ * \param[in] a The set to remove integers from
+ * \param[in] b The integers to remove
+ */
+void bitsetDifference(bitset_t *dst, const bitset_t *a, const bitset_t *b);
+
+/**
+ * \brief Return whether two sets hold the same integers
+ *
+ * \param[in] a A set
+ * \param[in] b A set
+ * \returns Whether the sets are equal
+ */
+bool bitsetEqual(const bitset_t *a, const bitset_t *b);
@@ -0,0 +1,195 @@
+/**
+ * \file dataflow.h
+ * \brief A solver for dataflow analyses over the blocks of a function
+ *
+ * An analysis describes the direction that its facts flow in, how the facts
+ * of the neighbours of a block are combined, how a block transforms them, and
+ * which representation of sets it uses. The solver computes the in and out
+ * set of every block from that, and stores them in the metadata of the block.
+ *
+ * The solver keeps the blocks that have to be evaluated again on a worklist,
+ * which is processed in reverse postorder for forward analyses and in
+ * postorder for backward ones. Every block is evaluated once, and then again
+ * only when the facts flowing into it changed.
+ */
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+
+#include "arena.h"
+#include "bitset.h"
+#include "llvm_utils.h"
+
+#pragma once
+
+/*** type definitions ***/
+
+/// The direction that the facts of an analysis flow in
+typedef enum {
+    /// From the start of a block to its end, and from a block to its
+    /// successors
+    dataflowForward,
+
+    /// From the end of a block to its start, and from a block to its
+    /// predecessors
+    dataflowBackward,
+} dataflow_dir_t;
+
+/// How the facts flowing into a block from its neighbours are combined
+typedef enum {
+    /// A fact holds if it holds for any neighbour
+    meetUnion,
+
+    /// A fact holds if it holds for every neighbour
+    meetIntersection,
+} dataflow_meet_t;
+
+/*** struct definitions ***/
+
+/// The operations on one representation of sets. The sets are passed around
+/// as `void *`, and an analysis only ever combines sets of the same size.
+struct set_ops_s {
+    /// Create an empty set that can hold the elements numbered below `size`.
+    /// When `arena` isn't `NULL`, the set is allocated from it, and released
+    /// with it rather than by `destroy`.
+    void *(*create)(int size, arena_t *arena);
+
+    /// Delete a set that wasn't allocated from an arena
+    void (*destroy)(void *set);
+
+    /// Remove every element from a set
+    void (*clear)(void *set);
+
+    /// Add every element that a set can hold to it
+    void (*fill)(void *set);
+
+    /// Make `dst` hold the same elements as `src`
+    void (*copy)(void *dst, const void *src);
+
+    /// Return whether two sets hold the same elements
+    bool (*equal)(const void *a, const void *b);
+
+    /// Add the elements of `src` to `dst`, and return whether `dst` changed
+    bool (*unionWith)(void *dst, const void *src);
+
+    /// Remove the elements from `dst` that `src` doesn't hold
+    void (*intersectWith)(void *dst, const void *src);
+
+    /// Store `a - b` in `dst`, which may be the same set as `a`
+    void (*difference)(void *dst, const void *a, const void *b);
+};
+
+/// The operations on one representation of sets
+typedef struct set_ops_s set_ops_t;
+
+/// A dataflow analysis over the blocks of a function
+struct dataflow_s {
+    /// The direction that facts flow in
+    dataflow_dir_t direction;
+
+    /// How the facts of the neighbours of a block are combined
+    dataflow_meet_t meet;
+
+    /// The representation of the sets
+    const set_ops_t *ops;
+
+    /// The number of elements that the sets can hold
+    int size;
+
+    /// Fill the `genSet` and `killSet` of a block, which are empty sets
+    /// created with `ops`. May be `NULL` if `transfer` is given, in which case
+    /// the block has no gen and kill sets.
+    void (*genKill)(meta_t *block, void *ctx);
+
+    /// Compute the facts that flow out of a block from the ones that flow
+    /// into it: the out set from the in set in a forward analysis, and the
+    /// other way around in a backward one. When `NULL`, the result is
+    /// $gen[B] \cup (input - kill[B])$.
+    void (*transfer)(meta_t *block, void *result, const void *input,
+                     void *ctx);
+
+    /// Set the facts that flow into the function: into the entry block in a
+    /// forward analysis, and into the blocks that return in a backward one.
+    /// When `NULL`, no facts do.
+    void (*boundary)(void *set, void *ctx);
+
+    /// Passed to each of the callbacks
+    void *ctx;
+
+    /// The arena to allocate the metadata, its sets and the memory that the
+    /// solver works with from, or `NULL` to allocate the metadata with
+    /// `malloc`
+    arena_t *arena;
+};
+
+/// A dataflow analysis over the blocks of a function
+typedef struct dataflow_s dataflow_t;
+
+/*** public variables ***/
+
+/// The operations on `bitset_t`s
+extern const set_ops_t bitsetOps;
+
+/*** public function prototypes ***/
+
+/**
+ * \brief Solve a dataflow analysis for a function
+ *
+ * Creates the metadata of every block, in the order of the function, and
+ * iterates until the in and out sets of every block reach the fixed point of
+ * the analysis. The metadata must be deleted with `meta_vec_delete`, which
+ * leaves what was allocated from the arena of the analysis to the arena.
+ *
+ * \param[in] fn The function to analyze
+ * \param[in] analysis The analysis to solve
+ * \param[out] evaluations If not `NULL`, set to the number of times that a
+ * block was evaluated
+ * \returns A vector of metadata structs
+ */
+meta_vec_t *solveDataflow(LLVMValueRef fn, const dataflow_t *analysis,
+                          unsigned int *evaluations);
+
+/**
+ * \brief Bring the solution of a dataflow analysis up to date after some
+ * blocks changed
+ *
+ * The gen and kill sets of the changed blocks are computed again. If those of
+ * a block differ from before, the blocks that its facts flow into, directly
+ * or not, are solved again, starting from the sets they would have had before
+ * the first evaluation. Only the instructions of blocks may have changed: the
+ * control flow graph and the numbering of the elements of the sets must be
+ * the same as when `solveDataflow` computed the metadata.
+ *
+ * \param[in,out] vec The metadata computed by `solveDataflow`
+ * \param[in] analysis The analysis that the metadata was computed for
+ * \param[in] dirty The positions in `vec` of the blocks that changed
+ * \param[out] evaluations If not `NULL`, set to the number of times that a
+ * block was evaluated
+ * \returns The number of blocks whose gen and kill sets were computed again
+ */
+int updateDataflow(meta_vec_t *vec, const dataflow_t *analysis,
+                   const bitset_t *dirty, unsigned int *evaluations);
+
+/**
+ * \brief Create the metadata of every block of a function, with its edges but
+ * no sets
+ *
+ * This is the control flow graph alone, for passes that need no dataflow
+ * analysis. The metadata must be deleted with `meta_vec_delete`.
+ *
+ * \param[in] fn The function
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL`
+ * \returns A vector of the metadata, in the order of the function
+ */
+meta_vec_t *computeBlocks(LLVMValueRef fn, arena_t *arena);
+
+/**
+ * \brief Find the immediate dominator of every block of a function
+ *
+ * Sets the `rpoIndex` of every block to its position in reverse postorder.
+ *
+ * \param[in,out] vec The metadata of every block, with its edges
+ * \param[in,out] arena The arena to allocate the result from
+ * \returns The position of the immediate dominator of each block, by
+ * position. It is -1 for the entry block and the blocks that it can't reach.
+ */
+int *computeDominators(meta_vec_t *vec, arena_t *arena);
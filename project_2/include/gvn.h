@@ -0,0 +1,82 @@
+/**
+ * \file gvn.h
+ * \brief Global value numbering over the dominator tree
+ *
+ * GVN finds the instructions that compute a value that an instruction which
+ * dominates them already computed, and replaces them with it. It walks the
+ * dominator tree from the entry block with a scoped hash table of the
+ * expressions available in the block it is in: those of the block and of
+ * every block that dominates it. An expression is its opcode, type and
+ * predicate, and the value numbers of its operands, which are the
+ * instructions that replace them, or the operands themselves. The operands of
+ * commutative operators are put in a fixed order, as are those of
+ * comparisons, along with their predicate, so that `a + b` and `b + a` have
+ * the same number.
+ *
+ * Loads are numbered by their address, as long as nothing may have written
+ * to memory since the load or store that made the value available. A store
+ * to a local variable, whose address never escapes, can only change loads
+ * of that variable, and nothing else can change such a variable. Any other
+ * write, such as a store through a pointer or a call, may change any memory
+ * except local variables. A block with more than one predecessor may be
+ * reached from paths that wrote anything, so it starts with no loads
+ * available.
+ *
+ * Numbering only reads the function. Applying the numbers replaces and
+ * erases the redundant instructions, so it has to hold the context.
+ */
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+#pragma once
+
+/// Counts of the work done by GVN on a function, and of what it removed
+struct gvn_stats_s {
+    /// The number of instructions that were numbered
+    unsigned int instructions;
+
+    /// The number of instructions other than loads that were redundant
+    int expressions;
+
+    /// The number of loads that were redundant
+    int loads;
+};
+
+/// Counts of the work done by GVN on a function
+typedef struct gvn_stats_s gvn_stats_t;
+
+/// The value numbers of the instructions of a function
+typedef struct gvn_s gvn_t;
+
+/**
+ * \brief Find the redundant instructions of a function
+ *
+ * The numbers are allocated from `arena`, apart from what `gvn_delete`
+ * releases.
+ *
+ * \param[in] fn The function to number
+ * \param[in,out] arena The arena to allocate the numbers from
+ * \param[out] stats The counts to add the work and the redundant
+ * instructions to
+ * \returns The numbers
+ */
+gvn_t *gvnSolve(LLVMValueRef fn, arena_t *arena, gvn_stats_t *stats);
+
+/**
+ * \brief Replace the redundant instructions of a function
+ *
+ * This erases instructions, so it has to hold the context.
+ *
+ * \param[in] gvn The numbers of the function
+ * \returns Whether the function changed
+ */
+bool gvnApply(gvn_t *gvn);
+
+/**
+ * \brief Delete what the numbers hold outside of their arena
+ *
+ * \param[in] gvn The numbers to delete
+ */
+void gvn_delete(gvn_t *gvn);
@@ -9,6 +9,8 @@
 #include <llvm-c/Core.h>
 #include <stdbool.h>
 
+#include "arena.h"
+#include "bitset.h"
 #include <vec.h>
 
 #pragma once
@@ -21,6 +23,52 @@ typedef vec_t(LLVMBasicBlockRef) bb_vec_t;
 
 /*** struct definitions ***/
 
+/// An entry of a table that looks up the number of a value, such as a store
+struct value_key_s {
+    /// The value that the table is sorted by
+    LLVMValueRef key;
+
+    /// The number of the value
+    int number;
+};
+
+/// An entry of a table that looks up the number of a value
+typedef struct value_key_s value_key_t;
+
+/// The set $S$ of the store instructions in a function. Each store is
+/// numbered, so that sets of them can be bit vectors.
+struct store_set_s {
+    /// The stores, in the order that they appear in the function. The number
+    /// of a store is its index.
+    val_vec_t stores;
+
+    /// Every store, sorted by store
+    value_key_t *byStore;
+
+    /// Every store, keyed by the address it writes to and sorted by address,
+    /// then by number
+    value_key_t *byAddress;
+};
+
+/// The set $S$ of the store instructions in a function
+typedef struct store_set_s store_set_t;
+
+/// The local variables of a function, numbered like the stores in $S$
+struct var_set_s {
+    /// The variables, in the order that they appear in the function. The
+    /// number of a variable is its index.
+    val_vec_t vars;
+
+    /// Every variable, sorted by variable
+    value_key_t *byVar;
+};
+
+/// The local variables of a function
+typedef struct var_set_s var_set_t;
+
+/// The operations on the sets of a dataflow analysis, from `dataflow.h`
+struct set_ops_s;
+
 /// A struct containing a basic block and optimization metadata associated
 /// with basic block
 struct meta_s {
@@ -28,20 +76,43 @@ struct meta_s {
     /// as $B$
     LLVMBasicBlockRef bb;
 
-    /// The gen set, or `gen[B]`
-    val_vec_t *genSet;
+    /// The gen set, or `gen[B]`, of the analysis that computed the metadata.
+    /// For the reaching stores, it is a `bitset_t` of the numbers of stores in
+    /// $S$. It is `NULL` for analyses that have no gen set.
+    void *genSet;
 
     /// The kill set, or `kill[B]`
-    val_vec_t *killSet;
+    void *killSet;
+
+    /// The in set, or `in[B]`, which holds at the start of the block
+    void *inSet;
 
-    /// The in set, or `in[B]`
-    val_vec_t *inSet;
+    /// The out or `out[B]`, which holds at the end of the block
+    void *outSet;
 
-    /// The out or `out[B]`
-    val_vec_t *outSet;
+    /// The operations on the sets, or `NULL` for the metadata of the control
+    /// flow graph alone, which has no sets
+    const struct set_ops_s *ops;
 
-    /// The predecessors to the basic block
-    bb_vec_t *preds;
+    /// The position of the block in the metadata vector, which is also the
+    /// position of the block in its function
+    int index;
+
+    /// The positions in the metadata vector of the predecessors to the basic
+    /// block
+    vec_int_t preds;
+
+    /// The positions of the successors of the basic block, in the order of
+    /// its terminator
+    vec_int_t succs;
+
+    /// The position of the block in reverse postorder of the control flow
+    /// graph. Blocks that can't be reached from the entry block come last.
+    int rpoIndex;
+
+    /// The arena that the metadata, its sets and its edges were allocated
+    /// from, or `NULL` if they were allocated with `malloc`
+    arena_t *arena;
 };
 
 /// A struct containing a basic block and optimization metadata associated
@@ -51,6 +122,22 @@ typedef struct meta_s meta_t;
 /// A vector of basic blocks and associated metadata
 typedef vec_t(meta_t *) meta_vec_t;
 
+/// A hash table from the basic blocks of a function to the positions of
+/// their metadata, so that a block can be found without searching the vector
+struct block_index_s {
+    /// The number of slots, which is a power of two
+    int capacity;
+
+    /// The block in each slot, or `NULL` if the slot is empty
+    LLVMBasicBlockRef *blocks;
+
+    /// The position of the block in each slot
+    int *positions;
+};
+
+/// A hash table from the basic blocks of a function to their positions
+typedef struct block_index_s block_index_t;
+
 /*** public function prototypes ***/
 
 /**
@@ -95,13 +182,12 @@ bool walkBasicblocks(LLVMValueRef function);
  * Given some LLVM basic block, this function computes the "gen" set for the
  * basic block with respect to the rest of the basic blocks.
  *
- * Note that this function initializes a new vector that must be deleted
- * later.
- *
  * \param[in] bb The basic block to inspect
- * \returns A newly allocated vector representing a set of LLVM values
+ * \param[in] S A set of all of the store instructions in the function
+ * \param[out] genSet An empty set of the numbers of stores in `S`, which the
+ * gen set is stored in
  */
-val_vec_t *computeGenSet(LLVMBasicBlockRef bb);
+void computeGenSet(LLVMBasicBlockRef bb, store_set_t *S, bitset_t *genSet);
 
 /**
  * \brief Compute the "kill" set for a basic block
@@ -109,26 +195,55 @@ val_vec_t *computeGenSet(LLVMBasicBlockRef bb);
  * Given some LLVM basic block, this function computes the "kill" set for the
  * basic block with respect to the rest of the basic blocks.
  *
- * Note that this function initializes a new vector that must be deleted
- * later.
- *
  * \param[in] bb The basic block to inspect
- * \param[in] S A set of all of the
- * \returns A newly allocated vector representing a set of LLVM values
+ * \param[in] S A set of all of the store instructions in the function
+ * \param[out] killSet An empty set of the numbers of stores in `S`, which the
+ * kill set is stored in
  */
-val_vec_t *computeKillSet(LLVMBasicBlockRef bb, val_vec_t *S);
+void computeKillSet(LLVMBasicBlockRef bb, store_set_t *S, bitset_t *killSet);
 
 /**
  * \brief Compute the set $S$
  *
  * Compute the set $S$ for a function. The set $S$ is defined as all
- * of the instructions in some function that are store instructions that
- * store constant values.
+ * of the store instructions in some function. Stores of values that aren't
+ * constant are included, since a load that one of them reaches can't be
+ * replaced by a constant.
+ *
+ * Note that this function allocates a new set that must be deleted with
+ * `store_set_delete`.
  *
  * \param[in] fn The function to inspect
- * \returns A vector representing the set $S$
+ * \returns The set $S$, with its stores numbered in the order they appear
+ */
+store_set_t *computeS(LLVMValueRef fn);
+
+/**
+ * \brief Find the number of a store in $S$
+ *
+ * \param[in] S The set to look in
+ * \param[in] store The store instruction to look up
+ * \returns The number of the store, or -1 if it isn't in `S`
+ */
+int storeNumber(store_set_t *S, LLVMValueRef store);
+
+/**
+ * \brief Find the stores in $S$ that write to an address
+ *
+ * \param[in] S The set to look in
+ * \param[in] addr The address that the stores write to
+ * \param[out] count The number of stores found
+ * \returns The first of `count` consecutive entries of `S->byAddress`, in
+ * order of number
  */
-val_vec_t *computeS(LLVMValueRef fn);
+value_key_t *storesTo(store_set_t *S, LLVMValueRef addr, int *count);
+
+/**
+ * \brief Delete a set of stores
+ *
+ * \param[in] S The set to delete
+ */
+void store_set_delete(store_set_t *S);
 
 /**
  * \brief Given some function, compute the optimization metadata for each basic
@@ -144,47 +259,151 @@ val_vec_t *computeS(LLVMValueRef fn);
  * The method creates a vector of metadata structs that contain a reference to
  * the basic block each set corresponds to.
  *
+ * The sets are `bitset_t`s of the numbers of stores in `S`, so that the in
+ * set of a block holds the stores that may reach its start. They are solved
+ * by `solveDataflow`, as a forward analysis whose meet is union.
+ *
  * \param[in] fn A LLVM function containing basic blocks
- * \param[in] S a set of all of the constant store instructions in the
- * function
+ * \param[in] S a set of all of the store instructions in the function
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL` to
+ * allocate it with `malloc`
+ * \param[out] evaluations If not `NULL`, set to the number of times that the
+ * out set of a block was computed before reaching the fixed point
  * \returns A vector of metadata structs
  */
-meta_vec_t *computeBlockMData(LLVMValueRef fn, val_vec_t *S);
+meta_vec_t *computeBlockMData(LLVMValueRef fn, store_set_t *S, arena_t *arena,
+                              unsigned int *evaluations);
 
 /**
- * \brief Find the predecessors for a given basic block
+ * \brief Bring the metadata of a function up to date after some of its
+ * blocks changed
  *
- * Given some basic block, this method will compute the precedessors of the
- * basic block in the control flow graph.
+ * Only the gen and kill sets of the changed blocks are computed again, and
+ * the in and out sets are only solved again where those differ. The blocks
+ * may have had instructions replaced or erased, but not stores, and their
+ * terminators must be the same.
+ *
+ * \param[in,out] vec The metadata computed by `computeBlockMData`
+ * \param[in] S The set of stores that the metadata was computed with
+ * \param[in,out] arena The arena that the metadata was computed with
+ * \param[in] dirty The positions in `vec` of the blocks that changed
+ * \param[out] evaluations If not `NULL`, set to the number of times that the
+ * out set of a block was computed
+ * \returns The number of blocks whose gen and kill sets were computed again
+ */
+int updateBlockMData(meta_vec_t *vec, store_set_t *S, arena_t *arena,
+                     const bitset_t *dirty, unsigned int *evaluations);
+
+/**
+ * \brief Find the local variables of a function
+ *
+ * The variables are the `alloca` instructions that `isLocalVariable` accepts.
+ *
+ * Note that this function allocates a new set that must be deleted with
+ * `var_set_delete`.
+ *
+ * \param[in] fn The function to inspect
+ * \returns The variables, numbered in the order they appear
+ */
+var_set_t *computeVars(LLVMValueRef fn);
+
+/**
+ * \brief Find the number of a local variable
+ *
+ * \param[in] vars The variables to look in
+ * \param[in] var The address to look up
+ * \returns The number of the variable, or -1 if it isn't one of `vars`
+ */
+int varNumber(var_set_t *vars, LLVMValueRef var);
+
+/**
+ * \brief Delete a set of local variables
+ *
+ * \param[in] vars The set to delete
+ */
+void var_set_delete(var_set_t *vars);
+
+/**
+ * \brief Compute which local variables are live at the start and end of
+ * each block
+ *
+ * A variable is live at a point if some path from it loads the variable
+ * before storing to it. The gen set of a block holds the variables that it
+ * loads before storing to them, and the kill set those that it stores to. The
+ * sets are `bitset_t`s of the numbers of variables in `vars`, solved by
+ * `solveDataflow` as a backward analysis whose meet is union.
+ *
+ * \param[in] fn A LLVM function containing basic blocks
+ * \param[in] vars The local variables of the function
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL` to
+ * allocate it with `malloc`
+ * \param[out] evaluations If not `NULL`, set to the number of times that the
+ * in set of a block was computed before reaching the fixed point
+ * \returns A vector of metadata structs
+ */
+meta_vec_t *computeLiveness(LLVMValueRef fn, var_set_t *vars, arena_t *arena,
+                            unsigned int *evaluations);
+
+/**
+ * \brief Find the predecessors and successors of every block
+ *
+ * The edges are read off the terminators of the blocks, in one pass over the
+ * function, and stored as positions in the vector. The lists of edges are
+ * allocated at their final size, from the arena of the metadata if it has one.
+ *
+ * \param[in,out] vec An allocated and initialized vector of metadata,
+ * containing every basic block of a function, with empty `preds` and `succs`
+ */
+void computeEdges(meta_vec_t *vec);
+
+/**
+ * \brief Index the blocks of a metadata vector by block
+ *
+ * Note that this function allocates a new table that must be deleted with
+ * `block_index_delete`.
+ *
+ * \param[in] vec The vector to index
+ * \returns A table from every block in `vec` to its position
+ */
+block_index_t *blockIndexCreate(meta_vec_t *vec);
+
+/**
+ * \brief Find the position of a block in the metadata vector that a table
+ * indexes
+ *
+ * \param[in] index The table to look in
+ * \param[in] bb The basic block to look up
+ * \returns The position of the block, or -1 if the table doesn't hold it
+ */
+int blockIndexFind(const block_index_t *index, LLVMBasicBlockRef bb);
+
+/**
+ * \brief Delete a table of blocks
  *
- * \param[in] vec An allocated and initialized vector of metadata, containing
- * all of the basic blocks that could be predecessors to the current block to
- * inspect.
- * \param[in] currBlock the metadata corresponding to the basic block to
- * compute the precedessors for. This metadata block *must* be in the vector.
- * \returns A new vector with the precedessors of the basic block
+ * \param[in] index The table to delete
  */
-void computePreds(meta_vec_t *vec);
+void block_index_delete(block_index_t *index);
 
 /**
- * \brief Find the metadata block that corresponds to a basic block in a
- * vector.
+ * \brief Return whether an address is a local variable that only loads and
+ * stores use
  *
- * This is a convenienc function that finds the associated metadata structure
- * for some basic block, given a vector struct.
+ * Only the stores in a function can change what such a variable holds, and
+ * it holds an undefined value until the first of them. Any other use, such as
+ * passing the address to a call, could let something else write to it.
  *
- * \param[in] vec The vector to inspect
- * \param[in] bb The basic block for which we want to find the metadata
- * \returns A reference to the metadata entry in the vector that corresponds to
- * the basic block.
+ * \param[in] addr The address to inspect
+ * \returns Whether the address is an `alloca` that is only loaded from and
+ * stored to
  */
-meta_t *vec_find_bb(meta_vec_t *vec, LLVMBasicBlockRef bb);
+bool isLocalVariable(LLVMValueRef addr);
 
 /**
  * \brief Delete a metadata vector and all data inside
  *
  * Given some metadata vector, this will delete all of the vectors inside the
- * metadata vector.
+ * metadata vector, and the sets that they point to. Metadata that was
+ * allocated from an arena is left to it, and only the vector is deleted.
  *
  * \param[in] vec The vector to delete
  */
@@ -7,18 +7,28 @@
  * optimizations for LLVM code. These functions will modify the LLVM model
  * that is passed in.
  *
- * In this file, we implement constant propagation and constant folding.
+ * In this file, we implement constant propagation and constant folding, with
+ * sparse conditional constant propagation or with passes that run until the
+ * fixed point, followed by global value numbering.
  */
 #include <llvm-c/Core.h>
+#include <stdbool.h>
 
 #pragma once
 
 /**
  * \brief Optimize an LLVM program
  *
- * Given some LLVM model, optimize the program in the model until it reaches
- * the fixed point.
+ * Given some LLVM model, optimize every function in the model until it
+ * reaches the fixed point. Functions are optimized concurrently by up to
+ * `jobs` threads, including the calling one.
  *
  * \param m The module to optimize
+ * \param jobs The number of functions to optimize at once
+ * \param printStats Whether to print, for each function, the work that the
+ * dataflow analysis and the optimization passes took to `stdout`
+ * \param classic Whether to run passes of constant propagation and constant
+ * folding until neither changes anything, instead of SCCP
  */
-void optimizeProgram(LLVMModuleRef m);
+void optimizeProgram(LLVMModuleRef m, unsigned int jobs, bool printStats,
+                     bool classic);
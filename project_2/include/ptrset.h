@@ -0,0 +1,134 @@
+/**
+ * \file ptrset.h
+ * \brief Hash sets of pointers, for when the elements can't be numbered
+ *
+ * A bit vector needs every element to have a small number, which requires
+ * knowing all of the elements up front. These sets hold arbitrary pointers
+ * instead, in an open addressing table laid out like a SwissTable: each slot
+ * has a control byte that is either `PTRSET_EMPTY` or seven bits of the hash
+ * of the pointer in the slot. A lookup compares those bytes for a whole group
+ * of `PTRSET_GROUP_SIZE` slots at once, with SSE2 when the processor has it,
+ * and only looks at the slots whose byte matches.
+ *
+ * Elements can be added but not removed, so the table never holds tombstones,
+ * and an empty slot always ends a probe.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma once
+
+/// The number of slots whose control bytes a probe compares at once
+#define PTRSET_GROUP_SIZE 16
+
+/// The control byte of a slot that holds no pointer
+#define PTRSET_EMPTY ((int8_t)-128)
+
+/// A set of pointers
+struct ptrset_s {
+    /// The number of slots, a power of two and a multiple of
+    /// `PTRSET_GROUP_SIZE`
+    int capacity;
+
+    /// The number of pointers in the set
+    int length;
+
+    /// The control byte of each slot, aligned to the size of a group
+    int8_t *ctrl;
+
+    /// The pointer in each slot whose control byte isn't `PTRSET_EMPTY`
+    void **slots;
+};
+
+/// A set of pointers
+typedef struct ptrset_s ptrset_t;
+
+/**
+ * \brief Create an empty set
+ *
+ * Note that this function allocates a new set that must be deleted later.
+ *
+ * \param[in] expected The number of pointers that the set should hold before
+ * it has to grow, which may be 0
+ * \returns A newly allocated set
+ */
+ptrset_t *ptrsetCreate(int expected);
+
+/**
+ * \brief Delete a set
+ *
+ * \param[in] set The set to delete
+ */
+void ptrsetDelete(ptrset_t *set);
+
+/**
+ * \brief Remove every pointer from a set
+ *
+ * \param[in] set The set to clear
+ */
+void ptrsetClear(ptrset_t *set);
+
+/**
+ * \brief Add a pointer to a set
+ *
+ * \param[in,out] set The set to add to
+ * \param[in] ptr The pointer to add, which may be `NULL`
+ * \returns Whether the set didn't hold the pointer yet
+ */
+bool ptrsetInsert(ptrset_t *set, void *ptr);
+
+/**
+ * \brief Return whether a set holds a pointer
+ *
+ * \param[in] set The set to inspect
+ * \param[in] ptr The pointer to look for
+ * \returns Whether `ptr` is in the set
+ */
+bool ptrsetContains(const ptrset_t *set, const void *ptr);
+
+/**
+ * \brief Find the slot that holds a pointer
+ *
+ * A pointer stays in its slot until the set grows, so the slots of a set that
+ * is done growing can number its pointers.
+ *
+ * \param[in] set The set to inspect
+ * \param[in] ptr The pointer to look for
+ * \returns The slot, or -1 if the set doesn't hold `ptr`
+ */
+int ptrsetFind(const ptrset_t *set, const void *ptr);
+
+/**
+ * \brief Add the pointers of one set to another
+ *
+ * \param[in,out] dst The set to add to
+ * \param[in] src The set whose pointers are added
+ * \returns Whether `dst` gained any pointers
+ */
+bool ptrsetUnion(ptrset_t *dst, const ptrset_t *src);
+
+/**
+ * \brief Compute the difference of two sets
+ *
+ * `dst` is cleared first, so it must be a different set from `a` and `b`.
+ *
+ * \param[out] dst The set to store `a - b` in
+ * \param[in] a The set to remove pointers from
+ * \param[in] b The pointers to remove
+ */
+void ptrsetDifference(ptrset_t *dst, const ptrset_t *a, const ptrset_t *b);
+
+/**
+ * \brief Find the first slot of a set that holds a pointer, starting at some
+ * slot
+ *
+ * Iterating over a set looks like
+ * `for (int i = ptrsetNext(set, 0); i >= 0; i = ptrsetNext(set, i + 1))`,
+ * with the pointers in `set->slots[i]`. The order is that of the slots, and
+ * changes when the set grows.
+ *
+ * \param[in] set The set to inspect
+ * \param[in] from The slot to start at, which may be the capacity of the set
+ * \returns The slot, or -1 if no slot from `from` on holds a pointer
+ */
+int ptrsetNext(const ptrset_t *set, int from);
@@ -0,0 +1,88 @@
+/**
+ * \file sccp.h
+ * \brief Sparse conditional constant propagation
+ *
+ * SCCP finds the values of a function that are constant and the blocks that
+ * can't run in one pass, by propagating lattice values along the uses of
+ * each value and along the edges of the control flow graph at the same time.
+ * Every value starts out unknown, and only ever moves down to a constant and
+ * then to overdefined, so each instruction is evaluated a bounded number of
+ * times, and only when one of its operands or one of the edges into its
+ * block changes.
+ *
+ * A branch on a constant only makes the edge that it takes executable, so the
+ * values that reach a phi along the other edge, or that are only computed in
+ * blocks behind it, don't keep the phi from being constant. Loads of local
+ * variables take the meet of the values of the reaching stores in executable
+ * blocks, which covers what constant propagation over the reaching stores
+ * does.
+ *
+ * Solving only reads the function. Applying the solution replaces the
+ * constant instructions, turns branches on constants into unconditional ones
+ * and deletes the blocks that can't run, so it has to hold the context.
+ */
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+
+#include "arena.h"
+#include "llvm_utils.h"
+
+#pragma once
+
+/// Counts of the work done by SCCP on a function, and of what it changed
+struct sccp_stats_s {
+    /// The number of times that an instruction was evaluated
+    unsigned int visits;
+
+    /// The number of instructions that were replaced by constants
+    int constants;
+
+    /// The number of conditional branches that were made unconditional
+    int branches;
+
+    /// The number of blocks that were deleted because they can't run
+    int unreachable;
+};
+
+/// Counts of the work done by SCCP on a function
+typedef struct sccp_stats_s sccp_stats_t;
+
+/// The solution of SCCP for a function
+typedef struct sccp_s sccp_t;
+
+/**
+ * \brief Find the constant values and the executable blocks of a function
+ *
+ * The solution is allocated from `arena`, apart from what `sccp_delete`
+ * releases, and refers to `metadata` and `S` until then.
+ *
+ * \param[in] fn The function to solve
+ * \param[in] S The stores of the function
+ * \param[in] metadata The reaching stores of the blocks of the function, with
+ * their edges
+ * \param[in,out] arena The arena to allocate the solution from
+ * \param[out] stats The counts to add the number of visits to
+ * \returns The solution
+ */
+sccp_t *sccpSolve(LLVMValueRef fn, store_set_t *S, meta_vec_t *metadata,
+                  arena_t *arena, sccp_stats_t *stats);
+
+/**
+ * \brief Change a function according to its solution
+ *
+ * This creates constants and erases instructions and blocks, so it has to
+ * hold the context. The metadata that the solution was computed from no
+ * longer describes the function afterwards.
+ *
+ * \param[in] sccp The solution of the function
+ * \param[out] stats The counts to add the changes to
+ * \returns Whether the function changed
+ */
+bool sccpApply(sccp_t *sccp, sccp_stats_t *stats);
+
+/**
+ * \brief Delete what a solution holds outside of its arena
+ *
+ * \param[in] sccp The solution to delete
+ */
+void sccp_delete(sccp_t *sccp);
@@ -11,6 +11,10 @@
  * will work with most vector types, provided that they hold pointers to data,
  * and not the data or any primitives directly (as is usual with any `void *`
  * "generic" programming.
+ *
+ * The elements are compared as pointers, through a `ptrset_t`, so each
+ * function takes time linear in the lengths of its vectors. The vectors that
+ * they return keep the elements in the order they were first seen.
  */
 #include <stdbool.h>
 
@@ -56,9 +60,9 @@ vec_void_t *setDedup(vec_void_t *a);
  * elements. This function is independent of the order of the vectors, and it
  * will not take duplicated elements into account.
  *
- * This function checks for equality by checking whether a is a subset of b,
- * and whether b is a subset of a. If both conditions are true, then a and b
- * must be equal.
+ * This function checks for equality by checking whether b is a subset of a,
+ * and whether both have the same number of distinct elements. If both
+ * conditions are true, then a and b must be equal.
  *
  * \param[in] a A vector
  * \param[in] b A vector
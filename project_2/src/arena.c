@@ -0,0 +1,125 @@
+/**
+ * \file arena.c
+ * \brief Bump allocation of memory that is released all at once
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/// A chunk of memory that an arena allocates from
+struct arena_chunk_s {
+    /// The chunk after this one
+    struct arena_chunk_s *next;
+
+    /// The number of bytes in `data`
+    size_t size;
+
+    /// The number of bytes at the start of `data` that are allocated
+    size_t used;
+
+    /// The memory of the chunk
+    unsigned char data[];
+};
+
+/// A chunk of memory that an arena allocates from
+typedef struct arena_chunk_s arena_chunk_t;
+
+/*** Private function prototypes ***/
+
+/**
+ * \brief Allocate a chunk with nothing used
+ *
+ * \param[in] size The number of bytes in the chunk
+ * \returns A newly allocated chunk
+ */
+static arena_chunk_t *chunkCreate(size_t size);
+
+/*** Private function definitions ***/
+
+static arena_chunk_t *chunkCreate(size_t size) {
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/*** Public function definitions ***/
+
+arena_t *arenaCreate(size_t chunkSize) {
+    arena_t *arena = malloc(sizeof(arena_t));
+    arena->chunkSize = chunkSize;
+    arena->first = chunkCreate(chunkSize);
+    arena->current = arena->first;
+    arena->chunks = 1;
+    return arena;
+}
+
+void arenaDelete(arena_t *arena) {
+    arena_chunk_t *chunk = arena->first;
+
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+void *arenaAlloc(arena_t *arena, size_t size, size_t alignment) {
+    while (true) {
+        arena_chunk_t *chunk = arena->current;
+        uintptr_t base = (uintptr_t)chunk->data;
+        uintptr_t start =
+            (base + chunk->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        if (start + size <= base + chunk->size) {
+            chunk->used = start + size - base;
+            return (void *)start;
+        }
+
+        // move on to the next chunk, and put a new one in front of it when
+        // there is none or it is too small. The padding for the alignment
+        // fits in a chunk of this size wherever its memory starts.
+        arena_chunk_t *next = chunk->next;
+
+        if (next == NULL || next->size < size + alignment) {
+            size_t chunkSize = size + alignment > arena->chunkSize
+                                   ? size + alignment
+                                   : arena->chunkSize;
+            next = chunkCreate(chunkSize);
+            next->next = chunk->next;
+            chunk->next = next;
+            arena->chunks++;
+        }
+        next->used = 0;
+        arena->current = next;
+    }
+}
+
+void *arenaArray(arena_t *arena, int n, size_t size) {
+    // the alignment of a type divides its size, so the largest power of two
+    // that does is enough
+    size_t alignment = size & -size;
+
+    if (alignment > _Alignof(max_align_t))
+        alignment = _Alignof(max_align_t);
+    return arenaAlloc(arena, size * (n > 0 ? n : 1), alignment);
+}
+
+arena_mark_t arenaMark(const arena_t *arena) {
+    arena_mark_t mark = {arena->current, arena->current->used};
+    return mark;
+}
+
+void arenaRewind(arena_t *arena, arena_mark_t mark) {
+    arena->current = mark.chunk;
+    arena->current->used = mark.used;
+}
+
+void arenaReset(arena_t *arena) {
+    arena->current = arena->first;
+    arena->current->used = 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * \file bitset.c
+ * \brief Dense sets of small integers, stored as bit vectors
+ *
+ * Each operation has a loop over plain 64-bit words, which the compiler is
+ * free to vectorize, and a version written with AVX2 intrinsics that is used
+ * when the program is built for a processor that has them.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "bitset.h"
+
+/// The alignment of the words of a set, which is the size of a group
+#define BITSET_ALIGNMENT (BITSET_GROUP_WORDS * sizeof(uint64_t))
+
+/**
+ * \brief Return the number of words that a set of some size needs
+ *
+ * \param[in] size The number of integers that the set can hold
+ * \returns The number of words
+ */
+static int wordsFor(int size) {
+    // round up to whole groups, and keep at least one so that the words are
+    // never a zero sized allocation
+    int words = (size + 63) / 64;
+    words = (words + BITSET_GROUP_WORDS - 1) / BITSET_GROUP_WORDS *
+            BITSET_GROUP_WORDS;
+
+    if (words == 0)
+        words = BITSET_GROUP_WORDS;
+    return words;
+}
+
+bitset_t *bitsetCreate(int size) {
+    bitset_t *set = malloc(sizeof(bitset_t));
+    set->size = size;
+    set->words = wordsFor(size);
+    set->bits = aligned_alloc(BITSET_ALIGNMENT, set->words * sizeof(uint64_t));
+    memset(set->bits, 0, set->words * sizeof(uint64_t));
+    return set;
+}
+
+bitset_t *bitsetCreateIn(arena_t *arena, int size) {
+    bitset_t *set = arenaAlloc(arena, sizeof(bitset_t), _Alignof(bitset_t));
+    set->size = size;
+    set->words = wordsFor(size);
+    set->bits =
+        arenaAlloc(arena, set->words * sizeof(uint64_t), BITSET_ALIGNMENT);
+    memset(set->bits, 0, set->words * sizeof(uint64_t));
+    return set;
+}
+
+void bitsetDelete(bitset_t *set) {
+    free(set->bits);
+    free(set);
+}
+
+int bitsetNext(const bitset_t *set, int from) {
+    for (int w = from / 64; w < set->words; w++) {
+        uint64_t word = set->bits[w];
+
+        // ignore the integers in the first word that are below the bound
+        if (w == from / 64)
+            word &= ~(uint64_t)0 << (from % 64);
+
+        if (word != 0)
+            return w * 64 + __builtin_ctzll(word);
+    }
+    return -1;
+}
+
+void bitsetClear(bitset_t *set) {
+    memset(set->bits, 0, set->words * sizeof(uint64_t));
+}
+
+void bitsetFill(bitset_t *set) {
+    bitsetClear(set);
+
+    // only the integers below the size are set, so that a full set compares
+    // equal to one that had each of them added
+    memset(set->bits, 0xff, set->size / 64 * sizeof(uint64_t));
+
+    if (set->size % 64 != 0)
+        set->bits[set->size / 64] = ((uint64_t)1 << (set->size % 64)) - 1;
+}
+
+void bitsetCopy(bitset_t *dst, const bitset_t *src) {
+    memcpy(dst->bits, src->bits, dst->words * sizeof(uint64_t));
+}
+
+#ifdef __AVX2__
+
+bool bitsetUnion(bitset_t *dst, const bitset_t *src) {
+    __m256i added = _mm256_setzero_si256();
+
+    for (int i = 0; i < dst->words; i += BITSET_GROUP_WORDS) {
+        __m256i *d = (__m256i *)&dst->bits[i];
+        __m256i old = _mm256_load_si256(d);
+        __m256i merged = _mm256_or_si256(
+            old, _mm256_load_si256((const __m256i *)&src->bits[i]));
+
+        // the bits that were set in `src` but not in `dst`
+        added = _mm256_or_si256(added, _mm256_xor_si256(old, merged));
+        _mm256_store_si256(d, merged);
+    }
+    return !_mm256_testz_si256(added, added);
+}
+
+void bitsetIntersect(bitset_t *dst, const bitset_t *src) {
+    for (int i = 0; i < dst->words; i += BITSET_GROUP_WORDS) {
+        __m256i *d = (__m256i *)&dst->bits[i];
+        _mm256_store_si256(
+            d, _mm256_and_si256(_mm256_load_si256(d),
+                                _mm256_load_si256((const __m256i *)&src->bits[i])));
+    }
+}
+
+void bitsetDifference(bitset_t *dst, const bitset_t *a, const bitset_t *b) {
+    for (int i = 0; i < dst->words; i += BITSET_GROUP_WORDS) {
+        // andnot clears the bits of its second operand that are set in its
+        // first
+        __m256i diff =
+            _mm256_andnot_si256(_mm256_load_si256((const __m256i *)&b->bits[i]),
+                                _mm256_load_si256((const __m256i *)&a->bits[i]));
+        _mm256_store_si256((__m256i *)&dst->bits[i], diff);
+    }
+}
+
+bool bitsetEqual(const bitset_t *a, const bitset_t *b) {
+    __m256i differ = _mm256_setzero_si256();
+
+    for (int i = 0; i < a->words; i += BITSET_GROUP_WORDS) {
+        differ = _mm256_or_si256(
+            differ,
+            _mm256_xor_si256(_mm256_load_si256((const __m256i *)&a->bits[i]),
+                             _mm256_load_si256((const __m256i *)&b->bits[i])));
+    }
+    return _mm256_testz_si256(differ, differ);
+}
+
+#else
+
+bool bitsetUnion(bitset_t *dst, const bitset_t *src) {
+    uint64_t added = 0;
+
+    for (int i = 0; i < dst->words; i++) {
+        uint64_t merged = dst->bits[i] | src->bits[i];
+        added |= merged ^ dst->bits[i];
+        dst->bits[i] = merged;
+    }
+    return added != 0;
+}
+
+void bitsetIntersect(bitset_t *dst, const bitset_t *src) {
+    for (int i = 0; i < dst->words; i++) {
+        dst->bits[i] &= src->bits[i];
+    }
+}
+
+void bitsetDifference(bitset_t *dst, const bitset_t *a, const bitset_t *b) {
+    for (int i = 0; i < dst->words; i++) {
+        dst->bits[i] = a->bits[i] & ~b->bits[i];
+    }
+}
+
+bool bitsetEqual(const bitset_t *a, const bitset_t *b) {
+    // no early exit, so that the loop can be vectorized
+    uint64_t differ = 0;
+
+    for (int i = 0; i < a->words; i++) {
+        differ |= a->bits[i] ^ b->bits[i];
+    }
+    return differ == 0;
+}
+
+#endif
@@ -0,0 +1,666 @@
+/**
+ * \file dataflow.c
+ * \brief A solver for dataflow analyses over the blocks of a function
+ *
+ * This file contains the worklist solver that every analysis in the
+ * optimizer is built on, along with the operations on the sets it uses.
+ */
+#include <assert.h>
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "dataflow.h"
+#include "llvm_utils.h"
+#include "print_utils.h"
+#include "vec.h"
+
+/// The size of the chunks of the arena that holds the memory the solver works
+/// with, when the analysis has no arena of its own
+#define SCRATCH_CHUNK_SIZE (16 * 1024)
+
+/*** Private function definitions ***/
+
+/**
+ * \brief Create an empty `bitset_t`
+ *
+ * \param[in] size The number of elements that the set can hold
+ * \param[in,out] arena The arena to allocate the set from, or `NULL`
+ * \returns The set
+ */
+static void *bitsetOpCreate(int size, arena_t *arena) {
+    return arena != NULL ? bitsetCreateIn(arena, size) : bitsetCreate(size);
+}
+
+/**
+ * \brief Delete a `bitset_t`
+ *
+ * \param[in] set The set to delete
+ */
+static void bitsetOpDestroy(void *set) { bitsetDelete(set); }
+
+/**
+ * \brief Remove every element from a `bitset_t`
+ *
+ * \param[in] set The set to clear
+ */
+static void bitsetOpClear(void *set) { bitsetClear(set); }
+
+/**
+ * \brief Fill a `bitset_t`
+ *
+ * \param[in] set The set to fill
+ */
+static void bitsetOpFill(void *set) { bitsetFill(set); }
+
+/**
+ * \brief Copy a `bitset_t`
+ *
+ * \param[out] dst The set to overwrite
+ * \param[in] src The set to copy
+ */
+static void bitsetOpCopy(void *dst, const void *src) { bitsetCopy(dst, src); }
+
+/**
+ * \brief Compare two `bitset_t`s
+ *
+ * \param[in] a A set
+ * \param[in] b A set
+ * \returns Whether the sets are equal
+ */
+static bool bitsetOpEqual(const void *a, const void *b) {
+    return bitsetEqual(a, b);
+}
+
+/**
+ * \brief Add the elements of one `bitset_t` to another
+ *
+ * \param[in,out] dst The set to add to
+ * \param[in] src The set whose elements are added
+ * \returns Whether `dst` changed
+ */
+static bool bitsetOpUnion(void *dst, const void *src) {
+    return bitsetUnion(dst, src);
+}
+
+/**
+ * \brief Intersect one `bitset_t` with another
+ *
+ * \param[in,out] dst The set to remove from
+ * \param[in] src The set whose elements are kept
+ */
+static void bitsetOpIntersect(void *dst, const void *src) {
+    bitsetIntersect(dst, src);
+}
+
+/**
+ * \brief Compute the difference of two `bitset_t`s
+ *
+ * \param[out] dst The set to store `a - b` in
+ * \param[in] a The set to remove from
+ * \param[in] b The elements to remove
+ */
+static void bitsetOpDifference(void *dst, const void *a, const void *b) {
+    bitsetDifference(dst, a, b);
+}
+
+/**
+ * \brief Start allocating the memory that a call of the solver works with
+ *
+ * The memory comes from the arena of the analysis if it has one. Otherwise
+ * it comes from an arena of its own, so that it still takes a single
+ * allocation.
+ *
+ * \param[in] analysis The analysis being solved
+ * \param[out] mark Set to the position to release the memory from
+ * \returns The arena to allocate from
+ */
+static arena_t *scratchBegin(const dataflow_t *analysis, arena_mark_t *mark) {
+    arena_t *scratch = analysis->arena != NULL
+                           ? analysis->arena
+                           : arenaCreate(SCRATCH_CHUNK_SIZE);
+    *mark = arenaMark(scratch);
+    return scratch;
+}
+
+/**
+ * \brief Release the memory that a call of the solver worked with
+ *
+ * \param[in] analysis The analysis being solved
+ * \param[in,out] scratch The arena returned by `scratchBegin`
+ * \param[in] mark The mark set by `scratchBegin`
+ */
+static void scratchEnd(const dataflow_t *analysis, arena_t *scratch,
+                       arena_mark_t mark) {
+    if (analysis->arena != NULL)
+        arenaRewind(scratch, mark);
+    else
+        arenaDelete(scratch);
+}
+
+/**
+ * \brief Create the metadata of every block of a function, without sets or
+ * edges
+ *
+ * \param[in] fn The function
+ * \param[in] ops The operations on the sets that the metadata will have, or
+ * `NULL`
+ * \param[in,out] arena The arena to allocate the metadata from, or `NULL`
+ * \returns A vector of the metadata, in the order of the function
+ */
+static meta_vec_t *createBlocks(LLVMValueRef fn, const set_ops_t *ops,
+                                arena_t *arena) {
+    meta_vec_t *vec = malloc(sizeof(meta_vec_t));
+    vec_init(vec);
+    vec_reserve(vec, (int)LLVMCountBasicBlocks(fn));
+
+    for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(fn); basicBlock;
+         basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
+        meta_t *metadata =
+            arena != NULL ? arenaAlloc(arena, sizeof(meta_t), _Alignof(meta_t))
+                          : malloc(sizeof(meta_t));
+        metadata->bb = basicBlock;
+        metadata->ops = ops;
+        metadata->arena = arena;
+        metadata->genSet = NULL;
+        metadata->killSet = NULL;
+        metadata->inSet = NULL;
+        metadata->outSet = NULL;
+        metadata->index = vec->length;
+        vec_init(&metadata->preds);
+        vec_init(&metadata->succs);
+        vec_push(vec, metadata);
+    }
+    return vec;
+}
+
+/**
+ * \brief Find the common dominator of two blocks that is closest to them
+ *
+ * \param[in] vec The metadata of every block, in reverse postorder
+ * \param[in] idom The immediate dominator of each block that has one so far
+ * \param[in] a The position of a block
+ * \param[in] b The position of another block
+ * \returns The position of the dominator
+ */
+static int intersectDominators(meta_vec_t *vec, const int *idom, int a,
+                               int b) {
+    // a dominator comes before the blocks it dominates in reverse postorder,
+    // so the later of the two walks up until they meet
+    while (a != b) {
+        while (vec->data[a]->rpoIndex > vec->data[b]->rpoIndex) {
+            a = idom[a];
+        }
+        while (vec->data[b]->rpoIndex > vec->data[a]->rpoIndex) {
+            b = idom[b];
+        }
+    }
+    return a;
+}
+
+/**
+ * \brief Order the blocks of a function in reverse postorder
+ *
+ * The order is that of a depth first search from the entry block, which is
+ * the first block in the vector, followed by the blocks that the search
+ * can't reach. Sets the `rpoIndex` of every block to its position.
+ *
+ * \param[in] vec The metadata of every block in the function
+ * \param[in,out] scratch The arena to allocate the order from
+ * \returns An array of the metadata in reverse postorder
+ */
+static meta_t **reversePostorder(meta_vec_t *vec, arena_t *scratch) {
+    int n = vec->length;
+    meta_t **order = arenaArray(scratch, n, sizeof(meta_t *));
+
+    // the blocks on the path from the entry block, along with the next of
+    // their successors to visit. They are only needed until the order is
+    // done, so they go back to the arena then.
+    arena_mark_t mark = arenaMark(scratch);
+    meta_t **stack = arenaArray(scratch, n, sizeof(meta_t *));
+    int *nextSucc = arenaArray(scratch, n, sizeof(int));
+    int depth = 0;
+
+    // blocks are finished in postorder, which fills the order from the back
+    int finished = n;
+
+    meta_t *it;
+    int i;
+
+    // -1 marks a block that hasn't been visited, and n one that has been
+    // visited but not finished
+    vec_foreach(vec, it, i) { it->rpoIndex = -1; }
+
+    if (n > 0) {
+        stack[depth] = vec->data[0];
+        nextSucc[depth++] = 0;
+        vec->data[0]->rpoIndex = n;
+    }
+
+    while (depth > 0) {
+        meta_t *top = stack[depth - 1];
+
+        if (nextSucc[depth - 1] < top->succs.length) {
+            meta_t *succ = vec->data[top->succs.data[nextSucc[depth - 1]++]];
+
+            if (succ->rpoIndex == -1) {
+                succ->rpoIndex = n;
+                stack[depth] = succ;
+                nextSucc[depth++] = 0;
+            }
+        } else {
+            order[--finished] = top;
+            depth--;
+        }
+    }
+
+    // the reachable blocks are at the back, so move them to the front and
+    // put the unreachable ones after them, in the order of the function
+    int reachable = n - finished;
+    memmove(order, order + finished, sizeof(meta_t *) * reachable);
+
+    vec_foreach(vec, it, i) {
+        if (it->rpoIndex == -1)
+            order[reachable++] = it;
+    }
+
+    for (i = 0; i < n; i++) {
+        order[i]->rpoIndex = i;
+    }
+    arenaRewind(scratch, mark);
+    return order;
+}
+
+/**
+ * \brief Compute the facts flowing into a block from its neighbours
+ *
+ * \param[in] vec The metadata of every block
+ * \param[in] block The block to compute the facts for
+ * \param[out] input The set to store the facts in
+ * \param[in] analysis The analysis being solved
+ */
+static void meetNeighbours(meta_vec_t *vec, meta_t *block, void *input,
+                           const dataflow_t *analysis) {
+    const set_ops_t *ops = analysis->ops;
+    bool forward = analysis->direction == dataflowForward;
+
+    // the neighbours that facts flow from, and whether the block is where
+    // facts enter the function
+    vec_int_t *neighbours = forward ? &block->preds : &block->succs;
+    bool boundary = forward ? block->index == 0 : block->succs.length == 0;
+
+    if (boundary) {
+        ops->clear(input);
+
+        if (analysis->boundary != NULL)
+            analysis->boundary(input, analysis->ctx);
+        return;
+    }
+
+    // the meet of no sets is the identity of the meet
+    if (analysis->meet == meetIntersection)
+        ops->fill(input);
+    else
+        ops->clear(input);
+
+    int neighbourIdx;
+    int i;
+
+    vec_foreach(neighbours, neighbourIdx, i) {
+        meta_t *neighbour = vec->data[neighbourIdx];
+        const void *facts = forward ? neighbour->outSet : neighbour->inSet;
+
+        if (analysis->meet == meetIntersection)
+            ops->intersectWith(input, facts);
+        else
+            ops->unionWith(input, facts);
+    }
+}
+
+/**
+ * \brief Apply the transfer function of an analysis to a block
+ *
+ * \param[in] analysis The analysis being solved
+ * \param[in] block The block to evaluate
+ * \param[out] result The set to store the facts flowing out of the block in
+ * \param[in] input The facts flowing into the block
+ */
+static void transfer(const dataflow_t *analysis, meta_t *block, void *result,
+                     const void *input) {
+    if (analysis->transfer != NULL) {
+        analysis->transfer(block, result, input, analysis->ctx);
+    } else {
+        // $ result = GEN[B] \cup (input - KILL[B])
+        analysis->ops->difference(result, input, block->killSet);
+        analysis->ops->unionWith(result, block->genSet);
+    }
+}
+
+/**
+ * \brief Set the result of a block to its starting value
+ *
+ * The result starts out as what the block produces when the meet of its
+ * neighbours is the identity, such as its gen set for a union. It only ever
+ * grows from there for a union, or shrinks for an intersection, and the
+ * first sweep changes fewer results than if they started out empty or full.
+ *
+ * \param[in] analysis The analysis being solved
+ * \param[in] block The block whose result to set
+ */
+static void seedResult(const dataflow_t *analysis, meta_t *block) {
+    bool forward = analysis->direction == dataflowForward;
+    void *input = forward ? block->inSet : block->outSet;
+    void *result = forward ? block->outSet : block->inSet;
+
+    if (analysis->meet == meetIntersection)
+        analysis->ops->fill(input);
+    else
+        analysis->ops->clear(input);
+    transfer(analysis, block, result, input);
+}
+
+/**
+ * \brief Return the position of a block on the worklist
+ *
+ * \param[in] analysis The analysis being solved
+ * \param[in] block The block
+ * \param[in] n The number of blocks
+ * \returns The position, which is in reverse postorder for a forward
+ * analysis and in postorder for a backward one
+ */
+static int worklistPos(const dataflow_t *analysis, meta_t *block, int n) {
+    return analysis->direction == dataflowForward ? block->rpoIndex
+                                                  : n - 1 - block->rpoIndex;
+}
+
+/**
+ * \brief Find the blocks that the result of a block flows into
+ *
+ * \param[in] block The block
+ * \param[in] analysis The analysis being solved
+ * \returns The positions in the metadata vector of the successors of the
+ * block for a forward analysis, or of its predecessors for a backward one
+ */
+static const vec_int_t *flowTargets(const meta_t *block,
+                                    const dataflow_t *analysis) {
+    return analysis->direction == dataflowForward ? &block->succs
+                                                  : &block->preds;
+}
+
+/**
+ * \brief Evaluate blocks until none are left on the worklist
+ *
+ * \param[in] vec The metadata of every block
+ * \param[in] order The metadata in reverse postorder
+ * \param[in] analysis The analysis being solved
+ * \param[in,out] pending The worklist positions of the blocks to evaluate,
+ * which is empty on return
+ * \param[in,out] scratch The arena to allocate temporary sets from
+ * \returns The number of blocks evaluated
+ */
+static unsigned int runWorklist(meta_vec_t *vec, meta_t **order,
+                                const dataflow_t *analysis, bitset_t *pending,
+                                arena_t *scratch) {
+    const set_ops_t *ops = analysis->ops;
+    bool forward = analysis->direction == dataflowForward;
+    int n = vec->length;
+
+    // The number of times that a block was evaluated. Without a worklist,
+    // this would be the number of blocks for every sweep over the function.
+    unsigned int evalCounter = 0;
+
+    // the result that each block had before it was recomputed
+    void *oldResult = ops->create(analysis->size, scratch);
+
+    // Take the pending blocks in order, and start over from the first one
+    // once the end is reached, so that a block is usually evaluated after the
+    // neighbours that changed in the same sweep
+    int pos = 0;
+
+    while ((pos = bitsetNext(pending, pos)) != -1 ||
+           (pos = bitsetNext(pending, 0)) != -1) {
+        bitsetRemove(pending, pos);
+        meta_t *currMeta = forward ? order[pos] : order[n - 1 - pos];
+        evalCounter++;
+
+        void *input = forward ? currMeta->inSet : currMeta->outSet;
+        void *result = forward ? currMeta->outSet : currMeta->inSet;
+        meetNeighbours(vec, currMeta, input, analysis);
+
+        // retain the old result for comparison
+        ops->copy(oldResult, result);
+        transfer(analysis, currMeta, result, input);
+
+        // the blocks that the result flows into have to see it
+        if (!ops->equal(oldResult, result)) {
+            const vec_int_t *targets = flowTargets(currMeta, analysis);
+            int target;
+            int i;
+
+            vec_foreach(targets, target, i) {
+                bitsetAdd(pending, worklistPos(analysis, vec->data[target], n));
+            }
+        }
+        pos++;
+    }
+    return evalCounter;
+}
+
+/*** Public variables ***/
+
+const set_ops_t bitsetOps = {
+    .create = bitsetOpCreate,
+    .destroy = bitsetOpDestroy,
+    .clear = bitsetOpClear,
+    .fill = bitsetOpFill,
+    .copy = bitsetOpCopy,
+    .equal = bitsetOpEqual,
+    .unionWith = bitsetOpUnion,
+    .intersectWith = bitsetOpIntersect,
+    .difference = bitsetOpDifference,
+};
+
+/*** Public function definitions ***/
+
+meta_vec_t *solveDataflow(LLVMValueRef fn, const dataflow_t *analysis,
+                          unsigned int *evaluations) {
+    const set_ops_t *ops = analysis->ops;
+    arena_t *arena = analysis->arena;
+    meta_vec_t *vec = createBlocks(fn, ops, arena);
+    meta_t *metadata;
+    int i;
+
+    vec_foreach(vec, metadata, i) {
+        if (analysis->genKill != NULL) {
+            metadata->genSet = ops->create(analysis->size, arena);
+            metadata->killSet = ops->create(analysis->size, arena);
+            analysis->genKill(metadata, analysis->ctx);
+        }
+
+        metadata->inSet = ops->create(analysis->size, arena);
+        metadata->outSet = ops->create(analysis->size, arena);
+        seedResult(analysis, metadata);
+    }
+    computeEdges(vec);
+
+    arena_mark_t mark;
+    arena_t *scratch = scratchBegin(analysis, &mark);
+    meta_t **order = reversePostorder(vec, scratch);
+
+    // every block is evaluated at least once
+    bitset_t *pending = bitsetCreateIn(scratch, vec->length);
+    bitsetFill(pending);
+    unsigned int evalCounter =
+        runWorklist(vec, order, analysis, pending, scratch);
+
+    scratchEnd(analysis, scratch, mark);
+#ifdef DEBUG
+    printf("(solveDataflow) Reached fixed point after %u evaluations of "
+           "%d blocks\n",
+           evalCounter, vec->length);
+#endif
+
+    if (evaluations != NULL)
+        *evaluations = evalCounter;
+    return vec;
+}
+
+int updateDataflow(meta_vec_t *vec, const dataflow_t *analysis,
+                   const bitset_t *dirty, unsigned int *evaluations) {
+    const set_ops_t *ops = analysis->ops;
+    int n = vec->length;
+    arena_mark_t mark;
+    arena_t *scratch = scratchBegin(analysis, &mark);
+
+    // the worklist positions of the blocks whose transfer function changed,
+    // each of which goes on the stack once
+    bitset_t *affected = bitsetCreateIn(scratch, n);
+    int *stack = arenaArray(scratch, n, sizeof(int));
+    int depth = 0;
+    int regenerated = 0;
+
+    // the gen and kill sets are computed into these, and only copied to the
+    // block when they differ from its own
+    void *newGen = NULL;
+    void *newKill = NULL;
+
+    if (analysis->genKill != NULL) {
+        newGen = ops->create(analysis->size, scratch);
+        newKill = ops->create(analysis->size, scratch);
+    }
+
+    for (int i = bitsetNext(dirty, 0); i != -1; i = bitsetNext(dirty, i + 1)) {
+        meta_t *block = vec->data[i];
+        void *oldGen = block->genSet;
+        void *oldKill = block->killSet;
+        bool changed = true;
+        regenerated++;
+
+        // without gen and kill sets, there is no telling whether the transfer
+        // function of the block is the same as before
+        if (analysis->genKill != NULL) {
+            ops->clear(newGen);
+            ops->clear(newKill);
+            block->genSet = newGen;
+            block->killSet = newKill;
+            analysis->genKill(block, analysis->ctx);
+            block->genSet = oldGen;
+            block->killSet = oldKill;
+
+            changed = !ops->equal(oldGen, newGen) ||
+                      !ops->equal(oldKill, newKill);
+
+            if (changed) {
+                ops->copy(oldGen, newGen);
+                ops->copy(oldKill, newKill);
+            }
+        }
+
+        if (changed) {
+            bitsetAdd(affected, worklistPos(analysis, block, n));
+            stack[depth++] = worklistPos(analysis, block, n);
+        }
+    }
+
+    meta_t **order = arenaArray(scratch, n, sizeof(meta_t *));
+    meta_t *it;
+    int i;
+
+    vec_foreach(vec, it, i) { order[it->rpoIndex] = it; }
+
+    // A fact that a changed block no longer produces may still be in the sets
+    // of the blocks that it flows into, and around a loop those would keep
+    // each other's facts alive. So every block that the changed ones reach
+    // starts over from its starting value, while the others keep theirs.
+    while (depth > 0) {
+        int pos = stack[--depth];
+        meta_t *block = analysis->direction == dataflowForward
+                            ? order[pos]
+                            : order[n - 1 - pos];
+        const vec_int_t *targets = flowTargets(block, analysis);
+        int target;
+
+        seedResult(analysis, block);
+
+        vec_foreach(targets, target, i) {
+            int targetPos = worklistPos(analysis, vec->data[target], n);
+
+            if (!bitsetContains(affected, targetPos)) {
+                bitsetAdd(affected, targetPos);
+                stack[depth++] = targetPos;
+            }
+        }
+    }
+
+    unsigned int evalCounter =
+        runWorklist(vec, order, analysis, affected, scratch);
+
+    scratchEnd(analysis, scratch, mark);
+#ifdef DEBUG
+    printf("(updateDataflow) Regenerated %d blocks, then evaluated %u\n",
+           regenerated, evalCounter);
+#endif
+
+    if (evaluations != NULL)
+        *evaluations = evalCounter;
+    return regenerated;
+}
+
+meta_vec_t *computeBlocks(LLVMValueRef fn, arena_t *arena) {
+    meta_vec_t *vec = createBlocks(fn, NULL, arena);
+    computeEdges(vec);
+    return vec;
+}
+
+int *computeDominators(meta_vec_t *vec, arena_t *arena) {
+    int n = vec->length;
+    int *idom = arenaArray(arena, n, sizeof(int));
+    arena_mark_t mark = arenaMark(arena);
+    meta_t **order = reversePostorder(vec, arena);
+
+    for (int i = 0; i < n; i++) {
+        idom[i] = -1;
+    }
+
+    // the algorithm of Cooper, Harvey and Kennedy: the entry block is its own
+    // dominator while it runs, and every other block intersects the
+    // dominators of the predecessors that have one yet, in reverse postorder
+    // until nothing changes
+    if (n > 0)
+        idom[0] = 0;
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (int i = 1; i < n; i++) {
+            meta_t *block = order[i];
+            int newIdom = -1;
+            int pred;
+            int j;
+
+            vec_foreach(&block->preds, pred, j) {
+                if (idom[pred] == -1)
+                    continue;
+
+                newIdom = newIdom == -1
+                              ? pred
+                              : intersectDominators(vec, idom, pred, newIdom);
+            }
+
+            if (newIdom != idom[block->index]) {
+                idom[block->index] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    if (n > 0)
+        idom[0] = -1;
+    arenaRewind(arena, mark);
+    return idom;
+}
@@ -0,0 +1,658 @@
+/**
+ * \file gvn.c
+ * \brief Global value numbering over the dominator tree
+ *
+ * This file contains the walk over the dominator tree and the scoped hash
+ * table it numbers expressions with. The table chains the entries of each
+ * bucket from the newest one, and the entries are kept in the order they were
+ * added, so leaving a block takes its entries off the front of their chains
+ * in reverse order, which uncovers the ones they hid.
+ *
+ * The C API of LLVM 14 can't read the `nsw`, `nuw` and `exact` flags of an
+ * instruction, so instructions that only differ in them have the same
+ * number. The one that is kept dominates the ones it replaces, so it has
+ * already run, and with IR from C, where clang only sets those flags on
+ * arithmetic whose overflow is undefined, it producing poison means the
+ * program was already undefined.
+ */
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "dataflow.h"
+#include "gvn.h"
+#include "llvm_utils.h"
+#include "ptrset.h"
+#include "vec.h"
+
+/*** Private type definitions ***/
+
+/// An expression, or a memory location, whose value is available
+struct gvn_entry_s {
+    /// The hash of the key
+    uint64_t hash;
+
+    /// The opcode, which is `LLVMLoad` for a memory location
+    LLVMOpcode opcode;
+
+    /// The type of the value, or the type that a GEP indexes into
+    LLVMTypeRef type;
+
+    /// The predicate of a comparison, whether a GEP is in bounds, or whether
+    /// the address of a memory location is a local variable
+    int extra;
+
+    /// The number of operands
+    int numOperands;
+
+    /// The value numbers of the operands, or the address of a memory location
+    LLVMValueRef *operands;
+
+    /// The value
+    LLVMValueRef value;
+
+    /// For a memory location, the generation of memory that the value
+    /// belongs to
+    unsigned int generation;
+
+    /// The entry that this one hides in its bucket, or -1
+    int next;
+};
+
+/// An expression, or a memory location, whose value is available
+typedef struct gvn_entry_s gvn_entry_t;
+
+/// A block on the path of the walk from the entry block
+struct gvn_frame_s {
+    /// The position of the block
+    int block;
+
+    /// The index in `children` of the next child to visit
+    int nextChild;
+
+    /// The number of entries before the block added its own
+    int mark;
+
+    /// The generation of the local variables at the end of the block
+    unsigned int localGeneration;
+
+    /// The generation of the rest of memory at the end of the block
+    unsigned int memoryGeneration;
+};
+
+/// A block on the path of the walk from the entry block
+typedef struct gvn_frame_s gvn_frame_t;
+
+/// The state of the walk, which is also the numbering once it is done
+struct gvn_s {
+    /// The function that was numbered
+    LLVMValueRef fn;
+
+    /// The instructions of the function. The slot of an instruction is its
+    /// index in `replacement`.
+    ptrset_t *insts;
+
+    /// The value that replaces the instruction in each slot, or `NULL` if it
+    /// is kept
+    LLVMValueRef *replacement;
+
+    /// The local variables of the function
+    var_set_t *vars;
+
+    /// The entries of the table, in the order they were added
+    gvn_entry_t *entries;
+
+    /// The number of entries
+    int numEntries;
+
+    /// The newest entry of each bucket, or -1
+    int *buckets;
+
+    /// The number of buckets less one, which masks a hash to a bucket
+    uint64_t bucketMask;
+
+    /// The value numbers of the operands of the instruction being numbered
+    val_vec_t key;
+
+    /// The generation that the next write to memory starts. Every generation
+    /// is only ever used for one stretch of the function.
+    unsigned int nextGeneration;
+
+    /// The generation of the local variables
+    unsigned int localGeneration;
+
+    /// The generation of the rest of memory
+    unsigned int memoryGeneration;
+
+    /// The counts to add to
+    gvn_stats_t *stats;
+};
+
+/*** Private function prototypes ***/
+
+/**
+ * \brief Return the value number of a value
+ *
+ * \param[in] gvn The numbering
+ * \param[in] value The value
+ * \returns The value that replaces `value`, or `value` itself
+ */
+static LLVMValueRef valueNumber(const gvn_t *gvn, LLVMValueRef value);
+
+/**
+ * \brief Hash the key of an entry
+ *
+ * \param[in] opcode The opcode
+ * \param[in] type The type
+ * \param[in] extra The predicate or flag
+ * \param[in] operands The value numbers of the operands
+ * \param[in] numOperands The number of operands
+ * \returns The hash
+ */
+static uint64_t hashKey(LLVMOpcode opcode, LLVMTypeRef type, int extra,
+                        LLVMValueRef *operands, int numOperands);
+
+/**
+ * \brief Find the newest entry of the table with some key
+ *
+ * \param[in] gvn The numbering
+ * \param[in] hash The hash of the key
+ * \param[in] opcode The opcode
+ * \param[in] type The type
+ * \param[in] extra The predicate or flag
+ * \param[in] operands The value numbers of the operands
+ * \param[in] numOperands The number of operands
+ * \returns The index of the entry, or -1 if there is none
+ */
+static int findEntry(const gvn_t *gvn, uint64_t hash, LLVMOpcode opcode,
+                     LLVMTypeRef type, int extra, LLVMValueRef *operands,
+                     int numOperands);
+
+/**
+ * \brief Add an entry to the table, hiding any older one with the same key
+ *
+ * \param[in,out] gvn The numbering
+ * \param[in,out] arena The arena to copy the operands to
+ * \param[in] entry The entry, whose operands are copied
+ */
+static void pushEntry(gvn_t *gvn, arena_t *arena, gvn_entry_t entry);
+
+/**
+ * \brief Return whether an instruction other than a load or a store may
+ * write to memory
+ *
+ * \param[in] inst The instruction
+ * \returns Whether it may
+ */
+static bool mayWriteMemory(LLVMValueRef inst);
+
+/**
+ * \brief Fill the key of an instruction that computes a value from its
+ * operands alone
+ *
+ * The operands go in `gvn->key`, in a fixed order when their order doesn't
+ * matter.
+ *
+ * \param[in,out] gvn The numbering
+ * \param[in] inst The instruction
+ * \param[out] type The type of the key
+ * \param[out] extra The predicate or flag of the key
+ * \returns Whether the instruction is such an expression
+ */
+static bool expressionKey(gvn_t *gvn, LLVMValueRef inst, LLVMTypeRef *type,
+                          int *extra);
+
+/**
+ * \brief Number a load, or a store, which makes the value it stores available
+ * at its address
+ *
+ * \param[in,out] gvn The numbering
+ * \param[in,out] arena The arena to allocate entries from
+ * \param[in] inst The load or store
+ * \param[in] slot The slot of `inst`
+ */
+static void numberMemory(gvn_t *gvn, arena_t *arena, LLVMValueRef inst,
+                         int slot);
+
+/**
+ * \brief Number the instructions of a block
+ *
+ * \param[in,out] gvn The numbering
+ * \param[in,out] arena The arena to allocate entries from
+ * \param[in] bb The block
+ */
+static void numberBlock(gvn_t *gvn, arena_t *arena, LLVMBasicBlockRef bb);
+
+/*** Private function definitions ***/
+
+static LLVMValueRef valueNumber(const gvn_t *gvn, LLVMValueRef value) {
+    if (!LLVMIsAInstruction(value))
+        return value;
+
+    LLVMValueRef replacement =
+        gvn->replacement[ptrsetFind(gvn->insts, value)];
+    return replacement != NULL ? replacement : value;
+}
+
+static uint64_t hashKey(LLVMOpcode opcode, LLVMTypeRef type, int extra,
+                        LLVMValueRef *operands, int numOperands) {
+    uint64_t hash = ((uint64_t)opcode << 32) ^ (uint64_t)(unsigned int)extra;
+    hash = (hash ^ (uintptr_t)type) * 0x9e3779b97f4a7c15ull;
+
+    for (int i = 0; i < numOperands; i++) {
+        hash = (hash ^ (uintptr_t)operands[i]) * 0x9e3779b97f4a7c15ull;
+    }
+    // the high bits are the best mixed, and the mask takes the low ones
+    return hash ^ (hash >> 29);
+}
+
+static int findEntry(const gvn_t *gvn, uint64_t hash, LLVMOpcode opcode,
+                     LLVMTypeRef type, int extra, LLVMValueRef *operands,
+                     int numOperands) {
+    for (int i = gvn->buckets[hash & gvn->bucketMask]; i >= 0;
+         i = gvn->entries[i].next) {
+        const gvn_entry_t *entry = &gvn->entries[i];
+
+        if (entry->hash != hash || entry->opcode != opcode ||
+            entry->type != type || entry->extra != extra ||
+            entry->numOperands != numOperands)
+            continue;
+
+        bool same = true;
+
+        for (int j = 0; j < numOperands && same; j++) {
+            same = entry->operands[j] == operands[j];
+        }
+        if (same)
+            return i;
+    }
+    return -1;
+}
+
+static void pushEntry(gvn_t *gvn, arena_t *arena, gvn_entry_t entry) {
+    LLVMValueRef *operands =
+        arenaArray(arena, entry.numOperands, sizeof(LLVMValueRef));
+
+    for (int i = 0; i < entry.numOperands; i++) {
+        operands[i] = entry.operands[i];
+    }
+    entry.operands = operands;
+
+    int *bucket = &gvn->buckets[entry.hash & gvn->bucketMask];
+    entry.next = *bucket;
+    *bucket = gvn->numEntries;
+    gvn->entries[gvn->numEntries++] = entry;
+}
+
+static bool mayWriteMemory(LLVMValueRef inst) {
+    switch (LLVMGetInstructionOpcode(inst)) {
+    case LLVMCall:
+    case LLVMInvoke:
+    case LLVMCallBr:
+    case LLVMFence:
+    case LLVMAtomicRMW:
+    case LLVMAtomicCmpXchg:
+    case LLVMVAArg:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * \brief Return the predicate of an integer comparison with its operands
+ * swapped
+ *
+ * \param[in] predicate The predicate
+ * \returns The predicate that gives the same result for swapped operands
+ */
+static LLVMIntPredicate swapICmp(LLVMIntPredicate predicate) {
+    switch (predicate) {
+    case LLVMIntUGT:
+        return LLVMIntULT;
+    case LLVMIntUGE:
+        return LLVMIntULE;
+    case LLVMIntULT:
+        return LLVMIntUGT;
+    case LLVMIntULE:
+        return LLVMIntUGE;
+    case LLVMIntSGT:
+        return LLVMIntSLT;
+    case LLVMIntSGE:
+        return LLVMIntSLE;
+    case LLVMIntSLT:
+        return LLVMIntSGT;
+    case LLVMIntSLE:
+        return LLVMIntSGE;
+    default:
+        return predicate;
+    }
+}
+
+/**
+ * \brief Return the predicate of a floating point comparison with its
+ * operands swapped
+ *
+ * \param[in] predicate The predicate
+ * \returns The predicate that gives the same result for swapped operands
+ */
+static LLVMRealPredicate swapFCmp(LLVMRealPredicate predicate) {
+    switch (predicate) {
+    case LLVMRealOGT:
+        return LLVMRealOLT;
+    case LLVMRealOGE:
+        return LLVMRealOLE;
+    case LLVMRealOLT:
+        return LLVMRealOGT;
+    case LLVMRealOLE:
+        return LLVMRealOGE;
+    case LLVMRealUGT:
+        return LLVMRealULT;
+    case LLVMRealUGE:
+        return LLVMRealULE;
+    case LLVMRealULT:
+        return LLVMRealUGT;
+    case LLVMRealULE:
+        return LLVMRealUGE;
+    default:
+        return predicate;
+    }
+}
+
+static bool expressionKey(gvn_t *gvn, LLVMValueRef inst, LLVMTypeRef *type,
+                          int *extra) {
+    LLVMOpcode opcode = LLVMGetInstructionOpcode(inst);
+    bool commutative = false;
+    *type = LLVMTypeOf(inst);
+    *extra = 0;
+
+    if (LLVMIsABinaryOperator(inst)) {
+        commutative = opcode == LLVMAdd || opcode == LLVMMul ||
+                      opcode == LLVMAnd || opcode == LLVMOr ||
+                      opcode == LLVMXor || opcode == LLVMFAdd ||
+                      opcode == LLVMFMul;
+    } else if (opcode == LLVMICmp) {
+        *extra = LLVMGetICmpPredicate(inst);
+    } else if (opcode == LLVMFCmp) {
+        *extra = LLVMGetFCmpPredicate(inst);
+    } else if (opcode == LLVMGetElementPtr) {
+        // the type indexed into decides the offsets, which the operands
+        // alone don't
+        *type = LLVMGetGEPSourceElementType(inst);
+        *extra = LLVMIsInBounds(inst);
+    } else if (!LLVMIsACastInst(inst) && opcode != LLVMSelect) {
+        return false;
+    }
+
+    int numOperands = LLVMGetNumOperands(inst);
+    vec_clear(&gvn->key);
+
+    for (int i = 0; i < numOperands; i++) {
+        vec_push(&gvn->key, valueNumber(gvn, LLVMGetOperand(inst, i)));
+    }
+
+    // order the operands by address when their order doesn't matter, which
+    // is the same wherever the expression appears
+    LLVMValueRef *operands = gvn->key.data;
+
+    if (numOperands == 2 && (uintptr_t)operands[0] > (uintptr_t)operands[1] &&
+        (commutative || opcode == LLVMICmp || opcode == LLVMFCmp)) {
+        LLVMValueRef first = operands[0];
+        operands[0] = operands[1];
+        operands[1] = first;
+
+        if (opcode == LLVMICmp)
+            *extra = swapICmp(*extra);
+        else if (opcode == LLVMFCmp)
+            *extra = swapFCmp(*extra);
+    }
+    return true;
+}
+
+static void numberMemory(gvn_t *gvn, arena_t *arena, LLVMValueRef inst,
+                         int slot) {
+    bool load = LLVMIsALoadInst(inst) != NULL;
+
+    // volatile and atomic accesses stay, and may synchronize with writes
+    // from elsewhere
+    if (LLVMGetVolatile(inst) ||
+        LLVMGetOrdering(inst) != LLVMAtomicOrderingNotAtomic) {
+        gvn->memoryGeneration = gvn->nextGeneration++;
+        return;
+    }
+
+    LLVMValueRef addr = valueNumber(gvn, LLVMGetOperand(inst, load ? 0 : 1));
+    LLVMValueRef value =
+        load ? inst : valueNumber(gvn, LLVMGetOperand(inst, 0));
+    bool local = varNumber(gvn->vars, addr) >= 0;
+
+    // a store through any other pointer may write to any memory but the local
+    // variables
+    if (!load && !local)
+        gvn->memoryGeneration = gvn->nextGeneration++;
+
+    unsigned int generation =
+        local ? gvn->localGeneration : gvn->memoryGeneration;
+    gvn_entry_t entry = {
+        .opcode = LLVMLoad,
+        .type = LLVMTypeOf(value),
+        .extra = local,
+        .numOperands = 1,
+        .operands = &addr,
+        .value = value,
+        .generation = generation,
+    };
+    entry.hash = hashKey(LLVMLoad, entry.type, local, &addr, 1);
+
+    if (load) {
+        int found = findEntry(gvn, entry.hash, LLVMLoad, entry.type, local,
+                              &addr, 1);
+
+        // the newest entry for the address is the only one that can be
+        // current
+        if (found >= 0 && gvn->entries[found].generation == generation) {
+            gvn->replacement[slot] = gvn->entries[found].value;
+            gvn->stats->loads++;
+            return;
+        }
+    }
+    pushEntry(gvn, arena, entry);
+}
+
+static void numberBlock(gvn_t *gvn, arena_t *arena, LLVMBasicBlockRef bb) {
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+        int slot = ptrsetFind(gvn->insts, inst);
+        gvn->stats->instructions++;
+
+        if (LLVMIsALoadInst(inst) || LLVMIsAStoreInst(inst)) {
+            numberMemory(gvn, arena, inst, slot);
+            continue;
+        }
+        if (mayWriteMemory(inst)) {
+            gvn->memoryGeneration = gvn->nextGeneration++;
+            continue;
+        }
+
+        LLVMTypeRef type;
+        int extra;
+
+        if (!expressionKey(gvn, inst, &type, &extra))
+            continue;
+
+        LLVMOpcode opcode = LLVMGetInstructionOpcode(inst);
+        LLVMValueRef *operands = gvn->key.data;
+        int numOperands = gvn->key.length;
+        uint64_t hash = hashKey(opcode, type, extra, operands, numOperands);
+        int found =
+            findEntry(gvn, hash, opcode, type, extra, operands, numOperands);
+
+        if (found >= 0) {
+            gvn->replacement[slot] = gvn->entries[found].value;
+            gvn->stats->expressions++;
+            continue;
+        }
+
+        gvn_entry_t entry = {
+            .hash = hash,
+            .opcode = opcode,
+            .type = type,
+            .extra = extra,
+            .numOperands = numOperands,
+            .operands = operands,
+            .value = inst,
+        };
+        pushEntry(gvn, arena, entry);
+    }
+}
+
+/*** Public function definitions ***/
+
+gvn_t *gvnSolve(LLVMValueRef fn, arena_t *arena, gvn_stats_t *stats) {
+    gvn_t *gvn = arenaAlloc(arena, sizeof(gvn_t), _Alignof(gvn_t));
+    gvn->fn = fn;
+    gvn->stats = stats;
+    gvn->insts = ptrsetCreate(0);
+    vec_init(&gvn->key);
+
+    meta_vec_t *blocks = computeBlocks(fn, arena);
+    int *idom = computeDominators(blocks, arena);
+    int n = blocks->length;
+    meta_t *meta;
+    int i;
+
+    vec_foreach(blocks, meta, i) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(meta->bb); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            ptrsetInsert(gvn->insts, inst);
+        }
+    }
+
+    // every instruction adds at most one entry
+    int numInsts = gvn->insts->length;
+    int numBuckets = 16;
+
+    while (numBuckets < 2 * numInsts) {
+        numBuckets *= 2;
+    }
+
+    gvn->replacement =
+        arenaArray(arena, gvn->insts->capacity, sizeof(LLVMValueRef));
+    gvn->entries = arenaArray(arena, numInsts, sizeof(gvn_entry_t));
+    gvn->buckets = arenaArray(arena, numBuckets, sizeof(int));
+    gvn->bucketMask = numBuckets - 1;
+    gvn->numEntries = 0;
+    gvn->vars = computeVars(fn);
+    gvn->nextGeneration = 0;
+
+    for (i = 0; i < gvn->insts->capacity; i++) {
+        gvn->replacement[i] = NULL;
+    }
+    for (i = 0; i < numBuckets; i++) {
+        gvn->buckets[i] = -1;
+    }
+
+    // the children of each block in the dominator tree, one block after
+    // another
+    int *firstChild = arenaArray(arena, n + 1, sizeof(int));
+    int *children = arenaArray(arena, n, sizeof(int));
+    int *nextChild = arenaArray(arena, n, sizeof(int));
+
+    for (i = 0; i <= n; i++) {
+        firstChild[i] = 0;
+    }
+    for (i = 0; i < n; i++) {
+        if (idom[i] >= 0)
+            firstChild[idom[i] + 1]++;
+    }
+    for (i = 0; i < n; i++) {
+        firstChild[i + 1] += firstChild[i];
+        nextChild[i] = firstChild[i];
+    }
+    for (i = 0; i < n; i++) {
+        if (idom[i] >= 0)
+            children[nextChild[idom[i]]++] = i;
+    }
+
+    // walk the tree depth first, so that the table holds the entries of the
+    // blocks that dominate the current one. The blocks that the entry block
+    // can't reach aren't in the tree, and aren't numbered.
+    gvn_frame_t *stack = arenaArray(arena, n, sizeof(gvn_frame_t));
+    int depth = 0;
+    int block = n > 0 ? 0 : -1;
+
+    while (block >= 0 || depth > 0) {
+        if (block >= 0) {
+            meta = blocks->data[block];
+
+            // a block with a single predecessor continues where its immediate
+            // dominator ended, and any other may be reached after any write
+            if (depth == 0 || meta->preds.length != 1) {
+                gvn->localGeneration = gvn->nextGeneration++;
+                gvn->memoryGeneration = gvn->nextGeneration++;
+            } else {
+                gvn->localGeneration = stack[depth - 1].localGeneration;
+                gvn->memoryGeneration = stack[depth - 1].memoryGeneration;
+            }
+
+            gvn_frame_t *frame = &stack[depth++];
+            frame->block = block;
+            frame->nextChild = firstChild[block];
+            frame->mark = gvn->numEntries;
+            numberBlock(gvn, arena, meta->bb);
+            frame->localGeneration = gvn->localGeneration;
+            frame->memoryGeneration = gvn->memoryGeneration;
+            block = -1;
+            continue;
+        }
+
+        gvn_frame_t *top = &stack[depth - 1];
+
+        if (top->nextChild < firstChild[top->block + 1]) {
+            block = children[top->nextChild++];
+            continue;
+        }
+
+        // leaving the block uncovers the entries that its own hid
+        while (gvn->numEntries > top->mark) {
+            gvn_entry_t *entry = &gvn->entries[--gvn->numEntries];
+            gvn->buckets[entry->hash & gvn->bucketMask] = entry->next;
+        }
+        depth--;
+    }
+
+    var_set_delete(gvn->vars);
+    gvn->vars = NULL;
+    meta_vec_delete(blocks);
+    return gvn;
+}
+
+bool gvnApply(gvn_t *gvn) {
+    val_vec_t toDelete;
+    vec_init(&toDelete);
+
+    for (int slot = ptrsetNext(gvn->insts, 0); slot >= 0;
+         slot = ptrsetNext(gvn->insts, slot + 1)) {
+        if (gvn->replacement[slot] == NULL)
+            continue;
+
+        LLVMValueRef inst = gvn->insts->slots[slot];
+        LLVMReplaceAllUsesWith(inst, gvn->replacement[slot]);
+        vec_push(&toDelete, inst);
+    }
+
+    LLVMValueRef inst;
+    int i;
+    vec_foreach(&toDelete, inst, i) { LLVMInstructionEraseFromParent(inst); }
+
+    bool changed = toDelete.length > 0;
+    vec_deinit(&toDelete);
+    return changed;
+}
+
+void gvn_delete(gvn_t *gvn) {
+    ptrsetDelete(gvn->insts);
+    vec_deinit(&gvn->key);
+}
@@ -11,14 +11,159 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/IRReader.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bitset.h"
+#include "dataflow.h"
 #include "llvm_utils.h"
 #include "print_utils.h"
-#include "set_utils.h"
 #include "vec.h"
 
+/*** Private function definitions ***/
+
+/**
+ * \brief Order two entries of a store table by key, then by number
+ *
+ * \param[in] a A `value_key_t`
+ * \param[in] b A `value_key_t`
+ * \returns A negative number, zero or a positive number as `a` sorts before,
+ * with or after `b`
+ */
+static int compareValueKeys(const void *a, const void *b) {
+    const value_key_t *x = a;
+    const value_key_t *y = b;
+
+    if (x->key != y->key)
+        return (uintptr_t)x->key < (uintptr_t)y->key ? -1 : 1;
+    return (x->number > y->number) - (x->number < y->number);
+}
+
+/**
+ * \brief Find the first entry of a sorted table whose key isn't less than
+ * some value
+ *
+ * \param[in] table The table, sorted by `compareValueKeys`
+ * \param[in] n The number of entries in the table
+ * \param[in] key The value to look for
+ * \returns The index of the entry, or `n` if every key is less than `key`
+ */
+static int lowerBound(value_key_t *table, int n, LLVMValueRef key) {
+    int lo = 0;
+    int hi = n;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if ((uintptr_t)table[mid].key < (uintptr_t)key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * \brief Hash a basic block into a slot of a block index
+ *
+ * Blocks are allocated on the heap, so the low bits of their addresses are
+ * always zero. Multiplying by a large odd constant mixes the other bits into
+ * the high ones, which pick the slot.
+ *
+ * \param[in] bb The block to hash
+ * \param[in] capacity The number of slots, which must be a power of two
+ * \returns The slot to start probing from
+ */
+static unsigned int hashBlock(LLVMBasicBlockRef bb, int capacity) {
+    uint64_t h = (uint64_t)(uintptr_t)bb * 0x9e3779b97f4a7c15ull;
+    int bits = __builtin_ctz((unsigned int)capacity);
+    return (unsigned int)(h >> (64 - bits));
+}
+
+/**
+ * \brief Allocate the list of edges of a block at its final size
+ *
+ * \param[in] block The metadata of the block
+ * \param[in,out] edges The empty `preds` or `succs` of the block
+ * \param[in] count The number of edges that will be pushed to the list
+ */
+static void reserveEdges(meta_t *block, vec_int_t *edges, int count) {
+    if (block->arena == NULL) {
+        vec_reserve(edges, count);
+        return;
+    }
+
+    // the list never grows past the count, so it never reallocates memory
+    // that belongs to the arena
+    edges->data = arenaAlloc(block->arena, sizeof(int) * count, _Alignof(int));
+    edges->capacity = count;
+}
+
+/**
+ * \brief Compute the gen and kill sets of a block for the reaching stores
+ *
+ * \param[in,out] block The metadata of the block, with empty gen and kill sets
+ * \param[in] ctx The set $S$, as a `store_set_t *`
+ */
+static void reachingGenKill(meta_t *block, void *ctx) {
+    computeGenSet(block->bb, ctx, block->genSet);
+    computeKillSet(block->bb, ctx, block->killSet);
+}
+
+/**
+ * \brief Compute the gen and kill sets of a block for the liveness of local
+ * variables
+ *
+ * \param[in,out] block The metadata of the block, with empty gen and kill sets
+ * \param[in] ctx The variables, as a `var_set_t *`
+ */
+static void livenessGenKill(meta_t *block, void *ctx) {
+    var_set_t *vars = ctx;
+    bitset_t *uses = block->genSet;
+    bitset_t *defs = block->killSet;
+
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(block->bb); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+        int var = -1;
+
+        if (LLVMIsALoadInst(inst)) {
+            var = varNumber(vars, LLVMGetOperand(inst, 0));
+
+            // a load after a store in the same block sees that store
+            if (var != -1 && !bitsetContains(defs, var))
+                bitsetAdd(uses, var);
+        } else if (LLVMIsAStoreInst(inst)) {
+            var = varNumber(vars, LLVMGetOperand(inst, 1));
+
+            if (var != -1)
+                bitsetAdd(defs, var);
+        }
+    }
+}
+
+/**
+ * \brief Describe the analysis of the stores that reach each block
+ *
+ * \param[in] S The stores of the function
+ * \param[in] arena The arena to allocate the metadata from, or `NULL`
+ * \returns The analysis
+ */
+static dataflow_t reachingStores(store_set_t *S, arena_t *arena) {
+    dataflow_t analysis = {
+        .direction = dataflowForward,
+        .meet = meetUnion,
+        .ops = &bitsetOps,
+        .size = S->stores.length,
+        .genKill = reachingGenKill,
+        .ctx = S,
+        .arena = arena,
+    };
+    return analysis;
+}
+
+/*** Public function definitions ***/
+
 LLVMModuleRef createLLVMModel(char *fp) {
     char *err = 0;
     LLVMMemoryBufferRef ll_f = 0;
@@ -40,91 +185,56 @@ LLVMModuleRef createLLVMModel(char *fp) {
     return m;
 }
 
-val_vec_t *computeGenSet(LLVMBasicBlockRef bb) {
-    // initialize the empty set
-    val_vec_t *genSet = malloc(sizeof(val_vec_t));
-    vec_init(genSet);
-
+void computeGenSet(LLVMBasicBlockRef bb, store_set_t *S, bitset_t *genSet) {
     // iterate over the instructions in the basic block
     for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
          inst = LLVMGetNextInstruction(inst)) {
-        // if the instruction is a store instruction, store it in the set
-        // We do this later, because first we need to remove any other
-        // instructions that get killed by the current instruction, otherwise
-        // it will get removed in the next step
-        if (LLVMIsAStoreInst(inst)) {
+        // only store instructions write to memory
+        if (!LLVMIsAStoreInst(inst))
+            continue;
 #ifdef DEBUG
-            println("(gen set) found store instruction");
+        println("(gen set) found store instruction");
 #endif
-        }
-        // get memory location of the store instruction
-        LLVMValueRef newStoreLoc = LLVMGetOperand(inst, 1);
-
-        // check to see if any of the instructions already stored in the
-        // vector reference the same location, if so, remove them
-        int i;
-        LLVMValueRef val;
-        vec_foreach(genSet, val, i) {
-            LLVMValueRef oldStoreLoc = LLVMGetOperand(val, 1);
+        // An earlier store to the same location in this block is overwritten
+        // by this one
+        int count;
+        value_key_t *sameLoc = storesTo(S, LLVMGetOperand(inst, 1), &count);
 
-            if (oldStoreLoc == newStoreLoc) {
-#ifdef DEBUG
-                println("(gen set) redundant location");
-#endif
-                vec_remove(genSet, val);
-            }
+        for (int i = 0; i < count; i++) {
+            bitsetRemove(genSet, sameLoc[i].number);
         }
-        vec_push(genSet, inst);
+        bitsetAdd(genSet, storeNumber(S, inst));
     }
-    return genSet;
 }
 
-val_vec_t *computeKillSet(LLVMBasicBlockRef bb, val_vec_t *S) {
-    val_vec_t *killSet = malloc(sizeof(val_vec_t));
-    vec_init(killSet);
-
-    // loop through again, for each instruction I, check if it kills an
-    // instruction in S and add that instruction to the kill set
-    // This method works because all of the instructions are added in
-    // order, so if we are looking at a store instruction, and it has a
-    // match in the list, every instruction that comes after the current
-    // one also follows it in the basic block, so it cannot be killed by
-    // the current instruction, hence there is no point looking at any
-    // of those instructions.
+void computeKillSet(LLVMBasicBlockRef bb, store_set_t *S, bitset_t *killSet) {
+    // for each instruction I, add every store in S that writes to the same
+    // location to the kill set. The stores of this block that I overwrites
+    // are killed too, which doesn't matter, since the block's own stores
+    // that reach its end are added back by the gen set.
     for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
          inst = LLVMGetNextInstruction(inst)) {
-        // only need to look at instructions that store constants, otherwise
-        // skip to next instruction
-        if (!(LLVMIsAStoreInst(inst) &&
-              LLVMIsAConstant(LLVMGetOperand(inst, 0))))
+        // any store overwrites what was stored to its location before,
+        // whether it stores a constant or not
+        if (!LLVMIsAStoreInst(inst))
             continue;
 
 #ifdef DEBUG
-        println("(kill set) found constant store instruction");
+        println("(kill set) found store instruction");
 #endif
 
-        LLVMValueRef currLoc = LLVMGetOperand(inst, 1);
-
-        int i;            // loop index iterator
-        LLVMValueRef val; // loop value iterator
-        vec_foreach(S, val, i) {
-            LLVMValueRef listLoc = LLVMGetOperand(val, 1);
+        int count;
+        value_key_t *sameLoc = storesTo(S, LLVMGetOperand(inst, 1), &count);
 
-            if (currLoc == listLoc) {
-                vec_push(killSet, val);
-#ifdef DEBUG
-                println("(kill set) constant store instruction kills previous "
-                        "instruction");
-#endif
-            }
+        for (int i = 0; i < count; i++) {
+            bitsetAdd(killSet, sameLoc[i].number);
         }
     }
-    return killSet;
 }
 
-val_vec_t *computeS(LLVMValueRef fn) {
-    val_vec_t *S = malloc(sizeof(val_vec_t));
-    vec_init(S);
+store_set_t *computeS(LLVMValueRef fn) {
+    store_set_t *S = malloc(sizeof(store_set_t));
+    vec_init(&S->stores);
 
     // loop through all of the basic blocks in the function, and loop
     // through each instruction in the basic blocks, adding appropriate
@@ -133,182 +243,228 @@ val_vec_t *computeS(LLVMValueRef fn) {
          basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
         for (LLVMValueRef inst = LLVMGetFirstInstruction(basicBlock); inst;
              inst = LLVMGetNextInstruction(inst)) {
-            if (LLVMIsAStoreInst(inst) &&
-                LLVMIsAConstant(LLVMGetOperand(inst, 1))) {
+            if (LLVMIsAStoreInst(inst)) {
 #ifdef DEBUG
                 println("(computeS) found store inst");
 #endif
-                vec_push(S, inst);
+                vec_push(&S->stores, inst);
             }
         }
     }
+
+    // build the tables that map stores and addresses to numbers
+    int n = S->stores.length;
+    S->byStore = malloc(sizeof(value_key_t) * (n > 0 ? n : 1));
+    S->byAddress = malloc(sizeof(value_key_t) * (n > 0 ? n : 1));
+
+    for (int i = 0; i < n; i++) {
+        LLVMValueRef store = S->stores.data[i];
+        S->byStore[i] = (value_key_t){store, i};
+        S->byAddress[i] = (value_key_t){LLVMGetOperand(store, 1), i};
+    }
+    qsort(S->byStore, n, sizeof(value_key_t), compareValueKeys);
+    qsort(S->byAddress, n, sizeof(value_key_t), compareValueKeys);
     return S;
 }
 
-meta_vec_t *computeBlockMData(LLVMValueRef fn, val_vec_t *S) {
-    meta_vec_t *vec = malloc(sizeof(meta_vec_t));
-    vec_init(vec);
+int storeNumber(store_set_t *S, LLVMValueRef store) {
+    int n = S->stores.length;
+    int i = lowerBound(S->byStore, n, store);
 
-    // whether any change was applied
-    bool changed = false;
+    if (i < n && S->byStore[i].key == store)
+        return S->byStore[i].number;
+    return -1;
+}
 
-    // initialize the metadata vector with each input set as the null set,
-    // the output set as equal to GEN[B], and compute gen/kill for each of the
-    // blocks
-    for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(fn); basicBlock;
-         basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
-        meta_t *metadata = malloc(sizeof(meta_t));
-        metadata->bb = basicBlock;
+value_key_t *storesTo(store_set_t *S, LLVMValueRef addr, int *count) {
+    int n = S->stores.length;
+    int first = lowerBound(S->byAddress, n, addr);
+    int end = first;
 
-        // set gen/kill sets for the bb
-        metadata->genSet = computeGenSet(basicBlock);
-        metadata->killSet = computeKillSet(basicBlock, S);
+    while (end < n && S->byAddress[end].key == addr) {
+        end++;
+    }
+    *count = end - first;
+    return &S->byAddress[first];
+}
 
-        val_vec_t *inSet = malloc(sizeof(val_vec_t));
-        vec_init(inSet);
-        metadata->inSet = inSet;
+void store_set_delete(store_set_t *S) {
+    vec_deinit(&S->stores);
+    free(S->byStore);
+    free(S->byAddress);
+    free(S);
+}
 
-        val_vec_t *outSet = malloc(sizeof(val_vec_t));
-        vec_init(outSet);
+meta_vec_t *computeBlockMData(LLVMValueRef fn, store_set_t *S, arena_t *arena,
+                              unsigned int *evaluations) {
+    dataflow_t analysis = reachingStores(S, arena);
+    return solveDataflow(fn, &analysis, evaluations);
+}
 
-        metadata->preds = malloc(sizeof(bb_vec_t));
-        vec_init(metadata->preds);
+int updateBlockMData(meta_vec_t *vec, store_set_t *S, arena_t *arena,
+                     const bitset_t *dirty, unsigned int *evaluations) {
+    dataflow_t analysis = reachingStores(S, arena);
+    return updateDataflow(vec, &analysis, dirty, evaluations);
+}
 
-        LLVMValueRef bbIterator;
-        int idx;
+var_set_t *computeVars(LLVMValueRef fn) {
+    var_set_t *vars = malloc(sizeof(var_set_t));
+    vec_init(&vars->vars);
 
-        // copy gen to out
-        vec_foreach(metadata->genSet, bbIterator, idx) {
-            vec_push(outSet, bbIterator);
+    for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(fn); basicBlock;
+         basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(basicBlock); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            if (isLocalVariable(inst))
+                vec_push(&vars->vars, inst);
         }
-#ifdef DEBUG
-        println("(computeBlockMData) copied gen set to out set");
-#endif
-        metadata->outSet = outSet;
-        vec_push(vec, metadata);
     }
-    computePreds(vec);
-
-    // A debugging counter to keep track of how many in/out iterations the
-    // function goes through before reaching a fixed point
-    unsigned inOutCounter = 0;
-
-    // keep applying these changes until we reach a fixed point
-    do {
-
-        inOutCounter++;
-        int idx0;
-        meta_t *currMeta;
-
-        // iterate through each basic block
-        vec_foreach(vec, currMeta, idx0) {
-            // IN[B] = union of all the preds of the current BB
-            LLVMBasicBlockRef currPred;
-            int idx3;
-
-            vec_foreach(currMeta->preds, currPred, idx3) {
-                // the meta block that corresponds to the precedessor BB
-                meta_t *predMeta = vec_find_bb(vec, currPred);
-
-                // there is no reason that predMeta should be null. If it is,
-                // there are very large issues that need to be dealt with
-                assert(predMeta != NULL);
-                val_vec_t *oldInSet = currMeta->inSet;
-                currMeta->inSet = (val_vec_t *)setUnion(
-                    (vec_void_t *)oldInSet, (vec_void_t *)predMeta->outSet);
-                vec_deinit(oldInSet);
-                free(oldInSet);
-            }
-
-            // $ OUT[B] = GEN[B] \cup (IN[B] - KILL[B])
-            // retain old out set for comparison
-            val_vec_t *oldOut = currMeta->outSet;
-
-            // IN[B] - KILL[B]
-            val_vec_t b;
-            vec_init(&b);
 
-            int idx2;
-            LLVMValueRef temp;
+    int n = vars->vars.length;
+    vars->byVar = malloc(sizeof(value_key_t) * (n > 0 ? n : 1));
 
-            // copy IN[B] to vector `b`
-            vec_foreach(currMeta->inSet, temp, idx2) { vec_push(&b, temp); }
-
-            // remove any elements that that are in IN[B] that are also in
-            // KILL[B]
-            vec_foreach(currMeta->killSet, temp, idx2) {
-                int found = -1;
-                vec_find(&b, temp, found);
+    for (int i = 0; i < n; i++) {
+        vars->byVar[i] = (value_key_t){vars->vars.data[i], i};
+    }
+    qsort(vars->byVar, n, sizeof(value_key_t), compareValueKeys);
+    return vars;
+}
 
-                if (found != -1) {
-                    vec_remove(&b, temp);
-                }
-            }
+int varNumber(var_set_t *vars, LLVMValueRef var) {
+    int n = vars->vars.length;
+    int i = lowerBound(vars->byVar, n, var);
 
-            // set union between `b` and GEN[B]
-            currMeta->outSet = (val_vec_t *)setUnion(
-                (vec_void_t *)currMeta->genSet, (vec_void_t *)&b);
+    if (i < n && vars->byVar[i].key == var)
+        return vars->byVar[i].number;
+    return -1;
+}
 
-            vec_deinit(&b);
+void var_set_delete(var_set_t *vars) {
+    vec_deinit(&vars->vars);
+    free(vars->byVar);
+    free(vars);
+}
 
-            changed =
-                !setEqual((vec_void_t *)oldOut, (vec_void_t *)currMeta->outSet);
-            vec_deinit(oldOut);
-            free(oldOut);
-        }
-    } while (changed);
-#ifdef DEBUG
-    printf("(computeMBlockData) Reached fixed point after %d iterations\n",
-           inOutCounter);
-#endif
-    return vec;
+meta_vec_t *computeLiveness(LLVMValueRef fn, var_set_t *vars, arena_t *arena,
+                            unsigned int *evaluations) {
+    dataflow_t liveness = {
+        .direction = dataflowBackward,
+        .meet = meetUnion,
+        .ops = &bitsetOps,
+        .size = vars->vars.length,
+        .genKill = livenessGenKill,
+        .ctx = vars,
+        .arena = arena,
+    };
+    return solveDataflow(fn, &liveness, evaluations);
 }
 
-void computePreds(meta_vec_t *vec) {
-    // To get a precedessor, you need to work backwards from the successors.
+void computeEdges(meta_vec_t *vec) {
     // With the LLVM API, you get the terminating instruction for a basic
-    // block, and compute the successor from there.
-
-    // iterator for loop
+    // block, and compute the successors from there. The predecessors are
+    // the reverse of those edges.
+    block_index_t *index = blockIndexCreate(vec);
+    int *numPreds = calloc(vec->length > 0 ? vec->length : 1, sizeof(int));
     meta_t *it;
     int a;
+    int succ;
+    int i;
+
     vec_foreach(vec, it, a) {
         LLVMValueRef term = LLVMGetBasicBlockTerminator(it->bb);
-        unsigned int numSuccessors = LLVMGetNumSuccessors(term);
+        int numSuccessors = term ? (int)LLVMGetNumSuccessors(term) : 0;
 
 #ifdef DEBUG
-        printf("(computePreds) There are %d successors\n", numSuccessors);
+        printf("(computeEdges) There are %d successors\n", numSuccessors);
 #endif
+        reserveEdges(it, &it->succs, numSuccessors);
 
-        // loop through each successor and add the current block as a
-        // predecessor to each successor
-        for (unsigned int i = 0; i < numSuccessors; i++) {
-            LLVMBasicBlockRef succ = LLVMGetSuccessor(term, i);
+        for (i = 0; i < numSuccessors; i++) {
+            succ = blockIndexFind(index, LLVMGetSuccessor(term, i));
 
-            meta_t *potentialSuccessor;
-            int b;
+            // there is no reason that the successor should be missing. If
+            // it is, there are very large issues that need to be dealt with
+            assert(succ != -1);
+            vec_push(&it->succs, succ);
+            numPreds[succ]++;
+        }
+    }
 
-            vec_foreach(vec, potentialSuccessor, b) {
-                if (potentialSuccessor->bb == succ) {
-                    vec_push(potentialSuccessor->preds, it->bb);
-#ifdef DEBUG
-                    println("--> (computePreds) Found successor");
-#endif
-                }
-            }
+    // the predecessors are counted now, so their lists can be allocated
+    vec_foreach(vec, it, a) { reserveEdges(it, &it->preds, numPreds[a]); }
+
+    vec_foreach(vec, it, a) {
+        vec_foreach(&it->succs, succ, i) {
+            vec_push(&vec->data[succ]->preds, a);
         }
     }
+    free(numPreds);
+    block_index_delete(index);
 }
 
-meta_t *vec_find_bb(meta_vec_t *vec, LLVMBasicBlockRef bb) {
+block_index_t *blockIndexCreate(meta_vec_t *vec) {
+    block_index_t *index = malloc(sizeof(block_index_t));
+
+    // keep the table at most half full, so that probes stay short
+    index->capacity = 16;
+
+    while (index->capacity < 2 * vec->length) {
+        index->capacity *= 2;
+    }
+    index->blocks = calloc(index->capacity, sizeof(LLVMBasicBlockRef));
+    index->positions = malloc(sizeof(int) * index->capacity);
+
     meta_t *it;
     int i;
 
     vec_foreach(vec, it, i) {
-        if (it->bb == bb)
-            return it;
+        unsigned int slot = hashBlock(it->bb, index->capacity);
+
+        while (index->blocks[slot] != NULL) {
+            slot = (slot + 1) & (index->capacity - 1);
+        }
+        index->blocks[slot] = it->bb;
+        index->positions[slot] = i;
+    }
+    return index;
+}
+
+int blockIndexFind(const block_index_t *index, LLVMBasicBlockRef bb) {
+    unsigned int slot = hashBlock(bb, index->capacity);
+
+    // the table always has an empty slot, which ends the search
+    while (index->blocks[slot] != NULL) {
+        if (index->blocks[slot] == bb)
+            return index->positions[slot];
+        slot = (slot + 1) & (index->capacity - 1);
     }
-    return NULL;
+    return -1;
+}
+
+void block_index_delete(block_index_t *index) {
+    free(index->blocks);
+    free(index->positions);
+    free(index);
+}
+
+bool isLocalVariable(LLVMValueRef addr) {
+    if (!LLVMIsAAllocaInst(addr))
+        return false;
+
+    for (LLVMUseRef use = LLVMGetFirstUse(addr); use;
+         use = LLVMGetNextUse(use)) {
+        LLVMValueRef user = LLVMGetUser(use);
+
+        // volatile accesses have to stay, and storing the address itself
+        // lets it escape
+        if (LLVMIsALoadInst(user) && !LLVMGetVolatile(user))
+            continue;
+        if (LLVMIsAStoreInst(user) && !LLVMGetVolatile(user) &&
+            LLVMGetOperand(user, 0) != addr)
+            continue;
+        return false;
+    }
+    return true;
 }
 
 void meta_vec_delete(meta_vec_t *vec) {
@@ -317,16 +473,22 @@ void meta_vec_delete(meta_vec_t *vec) {
     int i = 0;
 
     vec_foreach(vec, it, i) {
-        vec_deinit(it->genSet);
-        free(it->genSet);
-        vec_deinit(it->killSet);
-        free(it->killSet);
-        vec_deinit(it->inSet);
-        free(it->inSet);
-        vec_deinit(it->outSet);
-        free(it->outSet);
-        vec_deinit(it->preds);
-        free(it->preds);
+        // the arena releases everything that was allocated from it at once
+        if (it->arena != NULL)
+            continue;
+
+        // analyses that have their own transfer function have no gen or kill
+        // sets, and the control flow graph alone has no sets at all
+        if (it->genSet != NULL)
+            it->ops->destroy(it->genSet);
+        if (it->killSet != NULL)
+            it->ops->destroy(it->killSet);
+        if (it->inSet != NULL) {
+            it->ops->destroy(it->inSet);
+            it->ops->destroy(it->outSet);
+        }
+        vec_deinit(&it->preds);
+        vec_deinit(&it->succs);
         free(it);
     }
     vec_deinit(vec);
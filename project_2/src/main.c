@@ -9,7 +9,10 @@
  * for the actual optimization code.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "llvm_utils.h"
 #include "optimizer.h"
@@ -20,23 +23,59 @@
  *
  * Parse command line arguments and call the main functions for the optimizer
  * program.
+ *
+ * Usage: `optimizer [-j jobs] [-s] [-c] file`, where `jobs` is the number of
+ * functions to optimize at once. It defaults to the number of online
+ * processors. `-s` prints the work done for each function to `stdout`. `-c`
+ * runs passes of constant propagation and folding until the fixed point
+ * instead of SCCP. Global value numbering runs after either.
  */
 int main(int argc, char *argv[]) {
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool printStats = false;
+    bool classic = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:sc")) != -1) {
+        switch (opt) {
+        case 'j':
+            jobs = strtol(optarg, NULL, 10);
+
+            if (jobs < 1) {
+                fprintln(stderr, "The number of jobs must be at least 1");
+                return 1;
+            }
+            break;
+        case 's':
+            printStats = true;
+            break;
+        case 'c':
+            classic = true;
+            break;
+        default:
+            fprintln(stderr, "Usage: optimizer [-j jobs] [-s] [-c] file");
+            return 1;
+        }
+    }
+
+    if (jobs < 1)
+        jobs = 1;
+
     // bail out if there is no input file
-    if (argc < 2) {
+    if (optind >= argc) {
         fprintln(stderr, "Missing input filepath");
         return 1;
     }
 
     // check whether the given file path is valid
-    char *fp = argv[1];
+    char *fp = argv[optind];
     LLVMModuleRef m = createLLVMModel(fp);
 
     if (m == NULL) {
         fprintln(stderr, "Invalid filepath or file received");
         return 1;
     }
-    optimizeProgram(m);
+    optimizeProgram(m, (unsigned int)jobs, printStats, classic);
 
     // print LLVM program to stdout
     LLVMDumpModule(m);
@@ -7,18 +7,98 @@
  * optimizations for LLVM code. These functions will modify the LLVM model
  * that is passed in.
  *
- * In this file, we implement constant propagation and constant folding.
+ * In this file, we implement constant propagation and constant folding, both
+ * as sparse conditional constant propagation in a single pass and as passes
+ * of propagation over the reaching stores and folding of binary operators
+ * that run until neither changes anything. Global value numbering then
+ * removes the instructions that compute a value again.
+ *
+ * Functions are optimized independently of each other, by a pool of worker
+ * threads. All functions share one LLVM context, which isn't thread safe:
+ * creating constants and replacing or erasing instructions touch tables and
+ * use lists that belong to the context, like the uses of a global or of a
+ * constant that appears in several functions. The dataflow analysis only
+ * reads the function it analyzes, so workers run it concurrently, and take
+ * turns changing the IR.
  */
 #include <llvm-c/Core.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+#include "bitset.h"
+#include "gvn.h"
 #include "llvm_utils.h"
 #include "optimizer.h"
 #include "print_utils.h"
+#include "sccp.h"
 #include "vec.h"
 
+/// The size of the chunks of the arena that each worker allocates the
+/// metadata of its functions from
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/*** Private type definitions ***/
+
+/// Counts of the work done to optimize a function
+struct fn_stats_s {
+    /// The number of basic blocks
+    int blocks;
+
+    /// The number of stores in $S$
+    int stores;
+
+    /// The number of out sets computed by the dataflow analysis
+    unsigned int evaluations;
+
+    /// The number of times that the gen and kill sets of a block were
+    /// computed again after a pass changed it
+    int regenerated;
+
+    /// The number of out sets computed again after passes
+    unsigned int reevaluations;
+
+    /// The number of passes of propagation and folding
+    unsigned int passes;
+
+    /// The work done and the changes made by SCCP
+    sccp_stats_t sccp;
+
+    /// The work done and the instructions removed by GVN
+    gvn_stats_t gvn;
+};
+
+/// Counts of the work done to optimize a function
+typedef struct fn_stats_s fn_stats_t;
+
+/// The functions of a module, which the workers take one at a time
+struct fn_queue_s {
+    /// The functions that have a body
+    val_vec_t functions;
+
+    /// The counts for each function, in the same order
+    fn_stats_t *stats;
+
+    /// The index of the next function to optimize
+    int next;
+
+    /// Whether to run passes of propagation and folding until the fixed point
+    /// instead of SCCP
+    bool classic;
+
+    /// Guards `next`
+    pthread_mutex_t queueLock;
+
+    /// Held while changing the IR, which shares the context with every other
+    /// function
+    pthread_mutex_t contextLock;
+};
+
+/// The functions of a module, which the workers take one at a time
+typedef struct fn_queue_s fn_queue_t;
+
 /*** Private function prototypes ***/
 
 /**
@@ -26,9 +106,27 @@
  *
  * \param[in] fn The function to optimize
  * \param[in] basicBlocks The metadata and basic blocks in the function
+ * \param[in] S The stores that the sets in the metadata are numbered by
+ * \param[out] dirty The positions in `basicBlocks` of the blocks that were
+ * changed are added to this set
+ * \param[in] index The positions of the blocks in `basicBlocks`
  * \returns Whether any optimization was performed
  */
-static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks);
+static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks,
+                      store_set_t *S, bitset_t *dirty,
+                      const block_index_t *index);
+
+/**
+ * \brief Mark the blocks that replacing an instruction changes
+ *
+ * These are the block of the instruction and the blocks of its users.
+ *
+ * \param[in] index The positions of the blocks in the metadata
+ * \param[out] dirty The set to add the positions of the blocks to
+ * \param[in] inst The instruction about to be replaced
+ */
+static void markDirty(const block_index_t *index, bitset_t *dirty,
+                      LLVMValueRef inst);
 
 /**
  * \brief Perform constant folding on a basic block
@@ -36,13 +134,56 @@ static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks);
  * Given some basic block, optimize the basic block if it can be optimized.
  *
  * \param[in] bb The basic block to optimize
+ * \param[in] index The positions of the blocks in the metadata
+ * \param[out] dirty The positions in the metadata of the blocks that were
+ * changed are added to this set
  * \returns Whether any optimization was performed
  */
-static bool constFold(LLVMBasicBlockRef bb);
+static bool constFold(LLVMBasicBlockRef bb, const block_index_t *index,
+                      bitset_t *dirty);
+
+/**
+ * \brief Run passes of propagation and folding until neither changes the
+ * function
+ *
+ * \param[in] fn The function to optimize
+ * \param[in,out] metadata The reaching stores of the blocks, which are kept
+ * up to date with the passes
+ * \param[in] S The stores of the function
+ * \param[in] contextLock The lock to hold while changing the IR
+ * \param[in,out] arena The arena that the metadata was allocated from
+ * \param[out] stats The counts of the work done
+ */
+static void foldUntilFixed(LLVMValueRef fn, meta_vec_t *metadata,
+                           store_set_t *S, pthread_mutex_t *contextLock,
+                           arena_t *arena, fn_stats_t *stats);
+
+/**
+ * \brief Optimize a function until it reaches the fixed point
+ *
+ * \param[in] fn The function to optimize
+ * \param[in] contextLock The lock to hold while changing the IR
+ * \param[in,out] arena The arena to allocate the metadata from, which is
+ * reset once the function is done
+ * \param[in] classic Whether to run the passes of propagation and folding
+ * instead of SCCP
+ * \param[out] stats The counts of the work done
+ */
+static void optimizeFunction(LLVMValueRef fn, pthread_mutex_t *contextLock,
+                             arena_t *arena, bool classic, fn_stats_t *stats);
+
+/**
+ * \brief Optimize functions from a queue until it is empty
+ *
+ * \param[in] arg The queue, as a `fn_queue_t *`
+ * \returns `NULL`
+ */
+static void *optimizeWorker(void *arg);
 
 /*** Private function definitions ***/
 
-static bool constFold(LLVMBasicBlockRef bb) {
+static bool constFold(LLVMBasicBlockRef bb, const block_index_t *index,
+                      bitset_t *dirty) {
     // to_delete stores all the instructions that need to be deleted
     // We cannot delete instructions when we are actually iterating over a list
     // It won't create wrong code but will miss some instructions
@@ -81,6 +222,7 @@ static bool constFold(LLVMBasicBlockRef bb) {
 
                 if (newInst) {
                     changed = true;
+                    markDirty(index, dirty, instruction);
                     LLVMReplaceAllUsesWith(instruction, newInst);
                     vec_push(&toDelete, instruction);
                 }
@@ -96,61 +238,60 @@ static bool constFold(LLVMBasicBlockRef bb) {
     return changed;
 }
 
-static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks) {
+static void markDirty(const block_index_t *index, bitset_t *dirty,
+                      LLVMValueRef inst) {
+    bitsetAdd(dirty, blockIndexFind(index, LLVMGetInstructionParent(inst)));
+
+    for (LLVMUseRef use = LLVMGetFirstUse(inst); use;
+         use = LLVMGetNextUse(use)) {
+        bitsetAdd(dirty, blockIndexFind(
+                             index, LLVMGetInstructionParent(LLVMGetUser(use))));
+    }
+}
+
+static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks,
+                      store_set_t *S, bitset_t *dirty,
+                      const block_index_t *index) {
     bool changed = false;
 
     // loop through each basic block, then each instruction in each basic
     // block
     int i;
     meta_t *meta;
-    val_vec_t R;
-    vec_init(&R);
+    bitset_t *R = bitsetCreate(S->stores.length);
 
     // deletion queue
     val_vec_t toDelete;
     vec_init(&toDelete);
 
-    vec_foreach(basicBlocks, meta, i) {
-        vec_deinit(&R);
-        vec_init(&R);
+    // the stores in R that a load may read, kept for every load so that it
+    // only allocates when it has to grow
+    val_vec_t temp;
+    vec_init(&temp);
 
+    vec_foreach(basicBlocks, meta, i) {
         // copy IN[B] to R
-        LLVMValueRef temp;
-        int j;
-        vec_foreach(meta->inSet, temp, j) { vec_push(&R, temp); }
-
-#ifdef DEBUG
-        printf("(constProp) R initially has %d values\n", R.length);
-#endif
+        bitsetCopy(R, meta->inSet);
 
         // loop through each instruction in the basic block
         LLVMBasicBlockRef basicBlock = meta->bb;
 
         for (LLVMValueRef inst = LLVMGetFirstInstruction(basicBlock); inst;
              inst = LLVMGetNextInstruction(inst)) {
-            // if I is a constant store instruction, add it to R
-            if (LLVMIsAStoreInst(inst) &&
-                LLVMIsAConstant(LLVMGetOperand(inst, 0))) {
-                vec_push(&R, inst);
-#ifdef DEBUG
-                println("(constProp) Add constant store instruction to R");
-#endif
-            } else if (LLVMIsAStoreInst(inst)) {
+            if (LLVMIsAStoreInst(inst)) {
                 // if I is a store instruction, remove everything in R that is
-                // killed by the instruction I
-                LLVMValueRef tempInst;
-                LLVMValueRef addr = LLVMGetOperand(inst, 1);
-                vec_foreach(&R, tempInst, j) {
-                    LLVMValueRef otherAddr = LLVMGetOperand(tempInst, 1);
-
-                    if (otherAddr == addr) {
-                        vec_remove(&R, tempInst);
+                // killed by the instruction I, then add I to R
+                int count;
+                value_key_t *killed =
+                    storesTo(S, LLVMGetOperand(inst, 1), &count);
+
+                for (int j = 0; j < count; j++) {
+                    bitsetRemove(R, killed[j].number);
+                }
 #ifdef DEBUG
-                        println(
-                            "(constProp) Removed killed instructions in set R");
+                println("(constProp) Removed killed instructions in set R");
 #endif
-                    }
-                }
+                bitsetAdd(R, storeNumber(S, inst));
             } else if (LLVMIsALoadInst(inst)) {
                 // If I is a load instruction that loads from the address
                 // represented by the variable %t, then find all the store
@@ -159,44 +300,48 @@ static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks) {
                 // all of the uses of instruction I by the constant in the store
                 // isntructions mark the load instructions for deletion, then
                 // delete them later
+                LLVMValueRef loadAddr = LLVMGetOperand(inst, 0);
+
+                // anything but a local variable may be written to behind the
+                // back of the stores in R
+                if (!isLocalVariable(loadAddr))
+                    continue;
 
                 // Find all store instructions in R that write to address that
                 // the current instruction loads from, and figure out if all
                 // of the store instructions are constant store instructions
-                LLVMValueRef loadAddr = LLVMGetOperand(inst, 1);
-                LLVMValueRef it;
-                int j;
+                int count;
+                value_key_t *candidates = storesTo(S, loadAddr, &count);
 
-                val_vec_t temp;
-                vec_init(&temp);
+                vec_clear(&temp);
 
-                vec_foreach(&R, it, j) {
-                    if (LLVMIsAStoreInst(it) &&
-                        (LLVMGetOperand(it, 1) == loadAddr)) {
+                for (int j = 0; j < count; j++) {
+                    if (bitsetContains(R, candidates[j].number)) {
 #ifdef DEBUG
                         println("(constProp) Found store instruction that "
                                 "stores to this load address");
 #endif
-                        vec_push(&temp, it);
+                        vec_push(&temp, S->stores.data[candidates[j].number]);
                     }
                 }
 
                 // bail if no optimizations can be made
-                if (R.length < 1) {
-                    vec_deinit(&temp);
+                if (temp.length < 1) {
                     continue;
                 }
 
                 // need to make sure all store ops are writing the same constant
                 // to memory
                 bool allConstStoreInsts = true;
-                LLVMValueRef constant = LLVMGetOperand(R.data[0], 0);
+                LLVMValueRef constant = LLVMGetOperand(temp.data[0], 0);
+                LLVMValueRef it;
+                int j;
 
                 // check and see if everything in temp stores constants and
                 // write the same constant value
                 vec_foreach(&temp, it, j) {
                     LLVMValueRef storedVal = LLVMGetOperand(it, 0);
-                    if (!(LLVMIsAStoreInst(it) && LLVMIsAConstant(storedVal) &&
+                    if (!(LLVMIsAConstant(storedVal) &&
                           (storedVal == constant))) {
                         allConstStoreInsts = false;
                     }
@@ -204,19 +349,18 @@ static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks) {
 
                 // bail out if no optimizations can be made
                 if (!allConstStoreInsts) {
-                    vec_deinit(&temp);
                     continue;
                 }
 
                 // replace all uses of the current load instruction with a
                 // store instruction that stores a constant
+                markDirty(index, dirty, inst);
                 LLVMReplaceAllUsesWith(inst, constant);
 #ifdef DEBUG
                 println(
                     "(constProp) Replacing load instruction(s) with constant");
 #endif
                 changed = true;
-                vec_deinit(&temp);
                 vec_push(&toDelete, inst);
             }
         }
@@ -231,28 +375,25 @@ static bool constProp(LLVMValueRef fn, meta_vec_t *basicBlocks) {
     // otherwise, we hvae reached a fixed point
     changed = changed || toDelete.length > 0;
     vec_deinit(&toDelete);
-    vec_deinit(&R);
+    vec_deinit(&temp);
+    bitsetDelete(R);
     return changed;
 }
 
-/*** Public function definitions ***/
-
-void optimizeProgram(LLVMModuleRef m) {
-    // get metadata for each basic block
-    LLVMValueRef function = LLVMGetFirstFunction(m);
-    val_vec_t *S = computeS(function);
-    meta_vec_t *metadata = computeBlockMData(function, S);
-
-#ifdef DEBUG
-    printf("(optimizeProgram) %d basic blocks in metadata vector\n",
-           metadata->length);
-#endif
-
+static void foldUntilFixed(LLVMValueRef function, meta_vec_t *metadata,
+                           store_set_t *S, pthread_mutex_t *contextLock,
+                           arena_t *arena, fn_stats_t *stats) {
     bool changed = false;
 
     // the number of passes the optimization routine makes
     unsigned int optimizationPasses = 0;
 
+    // the positions in the metadata of the blocks that a pass changed
+    bitset_t *dirty = bitsetCreateIn(arena, metadata->length);
+    block_index_t *index = blockIndexCreate(metadata);
+    stats->regenerated = 0;
+    stats->reevaluations = 0;
+
     // continue optimizing until the fixed-point
     do {
         optimizationPasses++;
@@ -261,25 +402,179 @@ void optimizeProgram(LLVMModuleRef m) {
                optimizationPasses);
 #endif
         changed = false;
-        changed |= constProp(function, metadata);
+        bitsetClear(dirty);
+        pthread_mutex_lock(contextLock);
+        changed |= constProp(function, metadata, S, dirty, index);
 
-        for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(function);
-             basicBlock; basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
-            changed |= constFold(basicBlock);
+        meta_t *meta;
+        int i;
+
+        vec_foreach(metadata, meta, i) {
+            changed |= constFold(meta->bb, index, dirty);
+        }
+        pthread_mutex_unlock(contextLock);
+
+        // the next pass has to see what this one did to the sets of the
+        // blocks it changed
+        if (changed) {
+            unsigned int evaluations;
+            stats->regenerated +=
+                updateBlockMData(metadata, S, arena, dirty, &evaluations);
+            stats->reevaluations += evaluations;
         }
     } while (changed);
 
-    // deallocate the data structures that were initialized for optimization
+    block_index_delete(index);
+    stats->passes = optimizationPasses;
+}
+
+static void optimizeFunction(LLVMValueRef function,
+                             pthread_mutex_t *contextLock, arena_t *arena,
+                             bool classic, fn_stats_t *stats) {
+    // get metadata for each basic block
+    store_set_t *S = computeS(function);
+    meta_vec_t *metadata =
+        computeBlockMData(function, S, arena, &stats->evaluations);
+    stats->blocks = metadata->length;
+    stats->stores = S->stores.length;
+
+#ifdef DEBUG
+    printf("(optimizeProgram) %d basic blocks in metadata vector\n",
+           metadata->length);
+#endif
+
+    if (classic) {
+        foldUntilFixed(function, metadata, S, contextLock, arena, stats);
+    } else {
+        // SCCP reaches its fixed point in one pass, and only reads the
+        // function until it applies the solution
+        sccp_t *sccp = sccpSolve(function, S, metadata, arena, &stats->sccp);
+        pthread_mutex_lock(contextLock);
+        sccpApply(sccp, &stats->sccp);
+        pthread_mutex_unlock(contextLock);
+        sccp_delete(sccp);
+        stats->passes = 1;
+    }
+
+    // the constants are known by now, so expressions that only differed in
+    // them get the same number
+    gvn_t *gvn = gvnSolve(function, arena, &stats->gvn);
+    pthread_mutex_lock(contextLock);
+    gvnApply(gvn);
+    pthread_mutex_unlock(contextLock);
+    gvn_delete(gvn);
+
+    // deallocate the data structures that were initialized for optimization,
+    // and release everything that was allocated from the arena at once
     meta_vec_delete(metadata);
+    arenaReset(arena);
 
 #ifdef DEBUG
     println("(optimizeProgram) Deallocated metadata vector");
 #endif
 
-    vec_deinit(S);
-    free(S);
+    store_set_delete(S);
 
 #ifdef DEBUG
     println("(optimizeProgram) Deallocated S vector");
 #endif
 }
+
+static void *optimizeWorker(void *arg) {
+    fn_queue_t *queue = arg;
+
+    // every function starts from an empty arena, which keeps the chunks that
+    // the functions before it needed
+    arena_t *arena = arenaCreate(ARENA_CHUNK_SIZE);
+
+    while (true) {
+        pthread_mutex_lock(&queue->queueLock);
+        int idx = queue->next++;
+        pthread_mutex_unlock(&queue->queueLock);
+
+        if (idx >= queue->functions.length)
+            break;
+        optimizeFunction(queue->functions.data[idx], &queue->contextLock,
+                         arena, queue->classic, &queue->stats[idx]);
+    }
+    arenaDelete(arena);
+    return NULL;
+}
+
+/*** Public function definitions ***/
+
+void optimizeProgram(LLVMModuleRef m, unsigned int jobs, bool printStats,
+                     bool classic) {
+    fn_queue_t queue;
+    vec_init(&queue.functions);
+    queue.next = 0;
+    queue.classic = classic;
+    pthread_mutex_init(&queue.queueLock, NULL);
+    pthread_mutex_init(&queue.contextLock, NULL);
+
+    // declarations have no body to optimize
+    for (LLVMValueRef fn = LLVMGetFirstFunction(m); fn;
+         fn = LLVMGetNextFunction(fn)) {
+        if (!LLVMIsDeclaration(fn))
+            vec_push(&queue.functions, fn);
+    }
+
+    queue.stats =
+        calloc(queue.functions.length > 0 ? queue.functions.length : 1,
+               sizeof(fn_stats_t));
+
+    // there is no point in more workers than functions, and the calling
+    // thread is one of them
+    if (jobs > (unsigned int)queue.functions.length)
+        jobs = queue.functions.length;
+
+    pthread_t *workers = malloc(sizeof(pthread_t) * (jobs > 1 ? jobs - 1 : 1));
+    unsigned int started = 0;
+
+    for (; started + 1 < jobs; started++) {
+        if (pthread_create(&workers[started], NULL, optimizeWorker, &queue) !=
+            0)
+            break;
+    }
+    optimizeWorker(&queue);
+
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+#ifdef DEBUG
+    printf("(optimizeProgram) Optimized %d functions with %u workers\n",
+           queue.functions.length, started + 1);
+#endif
+
+    // the workers finish functions in any order, so the counts are printed
+    // once they are all done
+    if (printStats) {
+        for (int i = 0; i < queue.functions.length; i++) {
+            fn_stats_t *stats = &queue.stats[i];
+            const char *name = LLVMGetValueName(queue.functions.data[i]);
+
+            if (classic) {
+                printf("%s: blocks=%d stores=%d evaluations=%u passes=%u "
+                       "regenerated=%d reevaluations=%u",
+                       name, stats->blocks, stats->stores, stats->evaluations,
+                       stats->passes, stats->regenerated,
+                       stats->reevaluations);
+            } else {
+                printf("%s: blocks=%d stores=%d evaluations=%u visits=%u "
+                       "constants=%d branches=%d unreachable=%d",
+                       name, stats->blocks, stats->stores, stats->evaluations,
+                       stats->sccp.visits, stats->sccp.constants,
+                       stats->sccp.branches, stats->sccp.unreachable);
+            }
+            printf(" expressions=%d loads=%d\n", stats->gvn.expressions,
+                   stats->gvn.loads);
+        }
+    }
+    free(queue.stats);
+
+    pthread_mutex_destroy(&queue.queueLock);
+    pthread_mutex_destroy(&queue.contextLock);
+    vec_deinit(&queue.functions);
+}
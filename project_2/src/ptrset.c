@@ -0,0 +1,270 @@
+/**
+ * \file ptrset.c
+ * \brief Hash sets of pointers, stored in open addressing tables
+ *
+ * Finding the slots of a group whose control byte has some value uses SSE2
+ * when the program is built for a processor that has it, and a loop over the
+ * bytes of the group otherwise.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ptrset.h"
+
+/*** Private function prototypes ***/
+
+/**
+ * \brief Hash a pointer
+ *
+ * The low seven bits of the hash are the control byte of the pointer, and the
+ * rest select the group that its probe starts at.
+ *
+ * \param[in] ptr The pointer to hash
+ * \returns The hash
+ */
+static uint64_t hashPtr(const void *ptr);
+
+/**
+ * \brief Return the slots of a group whose control byte has some value
+ *
+ * \param[in] ctrl The control bytes of the group
+ * \param[in] byte The value to look for
+ * \returns A mask with bit `i` set if slot `i` of the group matches
+ */
+static unsigned int groupMatch(const int8_t *ctrl, int8_t byte);
+
+/**
+ * \brief Return the slots of a group that are empty
+ *
+ * \param[in] ctrl The control bytes of the group
+ * \returns A mask with bit `i` set if slot `i` of the group is empty
+ */
+static unsigned int groupEmpty(const int8_t *ctrl);
+
+/**
+ * \brief Find the slot that holds a pointer, or the one it would be added to
+ *
+ * \param[in] set The set to search
+ * \param[in] ptr The pointer to look for
+ * \param[in] hash The hash of `ptr`
+ * \param[out] found Set to whether the set holds `ptr`
+ * \returns The slot holding `ptr` if the set has it, and otherwise the first
+ * empty slot of its probe sequence
+ */
+static int findSlot(const ptrset_t *set, const void *ptr, uint64_t hash,
+                    bool *found);
+
+/**
+ * \brief Allocate the slots of a set, all of them empty
+ *
+ * \param[in,out] set The set whose slots to allocate
+ * \param[in] capacity The number of slots
+ */
+static void allocSlots(ptrset_t *set, int capacity);
+
+/**
+ * \brief Double the number of slots of a set, keeping its pointers
+ *
+ * \param[in,out] set The set to grow
+ */
+static void grow(ptrset_t *set);
+
+/*** Private function definitions ***/
+
+static uint64_t hashPtr(const void *ptr) {
+    // the finalizer of MurmurHash3, so that the low bits depend on all of the
+    // bits of the pointer and not only on its alignment
+    uint64_t hash = (uintptr_t)ptr;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+#ifdef __SSE2__
+
+static unsigned int groupMatch(const int8_t *ctrl, int8_t byte) {
+    __m128i group = _mm_load_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+}
+
+static unsigned int groupEmpty(const int8_t *ctrl) {
+    // only the empty control byte has its sign bit set, and movemask gathers
+    // the sign bits
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+}
+
+#else
+
+static unsigned int groupMatch(const int8_t *ctrl, int8_t byte) {
+    unsigned int mask = 0;
+
+    for (int i = 0; i < PTRSET_GROUP_SIZE; i++) {
+        mask |= (unsigned int)(ctrl[i] == byte) << i;
+    }
+    return mask;
+}
+
+static unsigned int groupEmpty(const int8_t *ctrl) {
+    return groupMatch(ctrl, PTRSET_EMPTY);
+}
+
+#endif
+
+static int findSlot(const ptrset_t *set, const void *ptr, uint64_t hash,
+                    bool *found) {
+    int8_t byte = hash & 0x7f;
+    int groupMask = set->capacity / PTRSET_GROUP_SIZE - 1;
+    int group = (hash >> 7) & groupMask;
+
+    // the distance between groups grows by one each step, which visits every
+    // group when their number is a power of two. The table is never full, so
+    // an empty slot ends the search.
+    for (int step = 1;; step++) {
+        int first = group * PTRSET_GROUP_SIZE;
+        const int8_t *ctrl = &set->ctrl[first];
+
+        for (unsigned int match = groupMatch(ctrl, byte); match != 0;
+             match &= match - 1) {
+            int slot = first + __builtin_ctz(match);
+
+            if (set->slots[slot] == ptr) {
+                *found = true;
+                return slot;
+            }
+        }
+
+        unsigned int empty = groupEmpty(ctrl);
+
+        if (empty != 0) {
+            *found = false;
+            return first + __builtin_ctz(empty);
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+static void allocSlots(ptrset_t *set, int capacity) {
+    set->capacity = capacity;
+    set->ctrl = aligned_alloc(PTRSET_GROUP_SIZE, capacity);
+    set->slots = malloc(sizeof(void *) * capacity);
+    memset(set->ctrl, PTRSET_EMPTY, capacity);
+}
+
+static void grow(ptrset_t *set) {
+    int oldCapacity = set->capacity;
+    int8_t *oldCtrl = set->ctrl;
+    void **oldSlots = set->slots;
+
+    allocSlots(set, 2 * oldCapacity);
+
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldCtrl[i] == PTRSET_EMPTY)
+            continue;
+
+        uint64_t hash = hashPtr(oldSlots[i]);
+        bool found;
+        int slot = findSlot(set, oldSlots[i], hash, &found);
+        set->ctrl[slot] = hash & 0x7f;
+        set->slots[slot] = oldSlots[i];
+    }
+    free(oldCtrl);
+    free(oldSlots);
+}
+
+/*** Public function definitions ***/
+
+ptrset_t *ptrsetCreate(int expected) {
+    ptrset_t *set = malloc(sizeof(ptrset_t));
+    set->length = 0;
+
+    // the table is kept at most 7/8 full, so that probes stay short and
+    // always reach an empty slot
+    int capacity = PTRSET_GROUP_SIZE;
+
+    while (capacity / 8 * 7 < expected) {
+        capacity *= 2;
+    }
+    allocSlots(set, capacity);
+    return set;
+}
+
+void ptrsetDelete(ptrset_t *set) {
+    free(set->ctrl);
+    free(set->slots);
+    free(set);
+}
+
+void ptrsetClear(ptrset_t *set) {
+    memset(set->ctrl, PTRSET_EMPTY, set->capacity);
+    set->length = 0;
+}
+
+bool ptrsetInsert(ptrset_t *set, void *ptr) {
+    uint64_t hash = hashPtr(ptr);
+    bool found;
+    int slot = findSlot(set, ptr, hash, &found);
+
+    if (found)
+        return false;
+
+    if (set->length + 1 > set->capacity / 8 * 7) {
+        grow(set);
+        slot = findSlot(set, ptr, hash, &found);
+    }
+    set->ctrl[slot] = hash & 0x7f;
+    set->slots[slot] = ptr;
+    set->length++;
+    return true;
+}
+
+bool ptrsetContains(const ptrset_t *set, const void *ptr) {
+    bool found;
+    findSlot(set, ptr, hashPtr(ptr), &found);
+    return found;
+}
+
+int ptrsetFind(const ptrset_t *set, const void *ptr) {
+    bool found;
+    int slot = findSlot(set, ptr, hashPtr(ptr), &found);
+    return found ? slot : -1;
+}
+
+bool ptrsetUnion(ptrset_t *dst, const ptrset_t *src) {
+    bool changed = false;
+
+    for (int i = ptrsetNext(src, 0); i >= 0; i = ptrsetNext(src, i + 1)) {
+        changed |= ptrsetInsert(dst, src->slots[i]);
+    }
+    return changed;
+}
+
+void ptrsetDifference(ptrset_t *dst, const ptrset_t *a, const ptrset_t *b) {
+    ptrsetClear(dst);
+
+    for (int i = ptrsetNext(a, 0); i >= 0; i = ptrsetNext(a, i + 1)) {
+        if (!ptrsetContains(b, a->slots[i]))
+            ptrsetInsert(dst, a->slots[i]);
+    }
+}
+
+int ptrsetNext(const ptrset_t *set, int from) {
+    for (int group = from / PTRSET_GROUP_SIZE;
+         group * PTRSET_GROUP_SIZE < set->capacity; group++) {
+        unsigned int full =
+            ~groupEmpty(&set->ctrl[group * PTRSET_GROUP_SIZE]) &
+            ((1u << PTRSET_GROUP_SIZE) - 1);
+
+        // ignore the slots in the first group that are before the start
+        if (group == from / PTRSET_GROUP_SIZE)
+            full &= ~0u << (from % PTRSET_GROUP_SIZE);
+
+        if (full != 0)
+            return group * PTRSET_GROUP_SIZE + __builtin_ctz(full);
+    }
+    return -1;
+}
@@ -0,0 +1,1074 @@
+/**
+ * \file sccp.c
+ * \brief Sparse conditional constant propagation
+ *
+ * This file contains the solver of Wegman and Zadeck, with one worklist of
+ * the edges that became executable and one of the instructions whose
+ * operands changed. Integer constants are kept as their bits rather than as
+ * LLVM constants while solving, since creating a constant changes the
+ * context, and are only turned into constants when the solution is applied.
+ */
+#include <llvm-c/Core.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bitset.h"
+#include "llvm_utils.h"
+#include "ptrset.h"
+#include "sccp.h"
+#include "vec.h"
+
+/*** Private type definitions ***/
+
+/// The height of a value in the lattice, from the top down
+typedef enum {
+    /// Nothing that computes the value has been seen to run yet
+    latticeUnknown,
+
+    /// The value is the same constant whenever it is computed
+    latticeConstant,
+
+    /// The value may differ from one run to another, or isn't tracked
+    latticeOverdefined,
+} lattice_state_t;
+
+/// The lattice value of an SSA value
+struct lattice_s {
+    /// The height of the value
+    lattice_state_t state;
+
+    /// The bits of a constant integer of at most 64 bits, zero extended
+    uint64_t bits;
+
+    /// The constant, if it appears in the function. An integer that the
+    /// solver computed has none until the solution is applied.
+    LLVMValueRef constant;
+};
+
+/// The lattice value of an SSA value
+typedef struct lattice_s lattice_t;
+
+/// The state of the solver, which is also the solution once it is done
+struct sccp_s {
+    /// The function that was solved
+    LLVMValueRef fn;
+
+    /// The stores of the function
+    store_set_t *S;
+
+    /// The metadata of the blocks, for their edges
+    meta_vec_t *blocks;
+
+    /// The positions of the blocks in `blocks`
+    block_index_t *index;
+
+    /// The instructions of the function. The slot of an instruction is its
+    /// number in the arrays below.
+    ptrset_t *insts;
+
+    /// The lattice value of the instruction in each slot
+    lattice_t *cells;
+
+    /// The position of the block of the instruction in each slot
+    int *blockOf;
+
+    /// The positions of the blocks that can run
+    bitset_t *executable;
+
+    /// The number of the first edge out of each block. The edges out of a
+    /// block are numbered in the order of its successors.
+    int *firstEdge;
+
+    /// The position of the block that each edge goes to
+    int *edgeTarget;
+
+    /// The edges that can be taken
+    bitset_t *executableEdges;
+
+    /// For the slot of each load of a local variable, the index in `reaching`
+    /// of the first store that reaches it. It is -1 for every other
+    /// instruction.
+    int *firstReaching;
+
+    /// For the slot of each load of a local variable, the number of stores
+    /// that reach it
+    int *numReaching;
+
+    /// The numbers of the stores that reach each load, one load after another
+    vec_int_t reaching;
+
+    /// For each store, the index in `readers` of the first load that it
+    /// reaches, with one more entry at the end
+    int *firstReader;
+
+    /// The slots of the loads that each store reaches, one store after
+    /// another
+    int *readers;
+
+    /// The position of the block of each store
+    int *storeBlock;
+
+    /// The slots of the instructions to evaluate again
+    int *ssaWork;
+
+    /// The number of slots in `ssaWork`
+    int ssaLength;
+
+    /// The slots that are in `ssaWork`
+    bitset_t *queued;
+
+    /// The edges that became executable and whose target hasn't seen them yet
+    int *edgeWork;
+
+    /// The number of edges in `edgeWork`
+    int edgeLength;
+
+    /// The number of times that an instruction was evaluated
+    unsigned int visits;
+};
+
+/*** Private function prototypes ***/
+
+/**
+ * \brief Return the width of an integer type the solver computes with
+ *
+ * \param[in] type The type
+ * \returns The number of bits, or 0 for any other type, including integers of
+ * more than 64 bits
+ */
+static int intWidth(LLVMTypeRef type);
+
+/**
+ * \brief Return the lattice value of an operand
+ *
+ * \param[in] sccp The solver
+ * \param[in] value The operand
+ * \returns The value
+ */
+static lattice_t operandValue(const sccp_t *sccp, LLVMValueRef value);
+
+/**
+ * \brief Return the meet of two lattice values of the same type
+ *
+ * \param[in] a A value
+ * \param[in] b Another value
+ * \returns The highest value that is at most both
+ */
+static lattice_t meet(lattice_t a, lattice_t b);
+
+/**
+ * \brief Compute a binary operator on two integers
+ *
+ * \param[in] opcode The operator
+ * \param[in] x The bits of the first operand
+ * \param[in] y The bits of the second operand
+ * \param[in] width The width of the operands
+ * \param[out] result The bits of the result
+ * \returns Whether the result is defined, which it isn't for a division by
+ * zero, an overflowing signed division or a shift by the width or more
+ */
+static bool foldBinary(LLVMOpcode opcode, uint64_t x, uint64_t y, int width,
+                       uint64_t *result);
+
+/**
+ * \brief Compare two integers
+ *
+ * \param[in] predicate The comparison
+ * \param[in] x The bits of the first operand
+ * \param[in] y The bits of the second operand
+ * \param[in] width The width of the operands
+ * \returns The result of the comparison
+ */
+static bool foldICmp(LLVMIntPredicate predicate, uint64_t x, uint64_t y,
+                     int width);
+
+/**
+ * \brief Return the number of executable edges from one block to another
+ *
+ * \param[in] sccp The solver
+ * \param[in] from The position of the block the edges start at
+ * \param[in] to The position of the block the edges go to
+ * \returns The number of edges, which is more than one when several
+ * successors of `from` are `to`
+ */
+static int executableEdgesTo(const sccp_t *sccp, int from, int to);
+
+/**
+ * \brief Compute the lattice value of an instruction from its operands
+ *
+ * \param[in] sccp The solver
+ * \param[in] inst The instruction, which isn't a terminator
+ * \param[in] slot The slot of `inst`
+ * \returns The value
+ */
+static lattice_t evaluate(const sccp_t *sccp, LLVMValueRef inst, int slot);
+
+/**
+ * \brief Find the successor that a terminator always takes
+ *
+ * \param[in] sccp The solver
+ * \param[in] term The terminator
+ * \param[out] state The height of the condition. Terminators without a
+ * condition count as overdefined.
+ * \returns The index of the successor, or -1 if the condition isn't constant
+ */
+static int takenSuccessor(const sccp_t *sccp, LLVMValueRef term,
+                          lattice_state_t *state);
+
+/**
+ * \brief Queue an instruction to be evaluated again, if its block can run
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] slot The slot of the instruction
+ */
+static void pushSlot(sccp_t *sccp, int slot);
+
+/**
+ * \brief Queue the loads that a store reaches
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] store The store
+ */
+static void pushReaders(sccp_t *sccp, LLVMValueRef store);
+
+/**
+ * \brief Lower the lattice value of an instruction, and queue its users if it
+ * changed
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] inst The instruction
+ * \param[in] slot The slot of `inst`
+ * \param[in] value The new value, which is ignored unless it is lower
+ */
+static void lower(sccp_t *sccp, LLVMValueRef inst, int slot, lattice_t value);
+
+/**
+ * \brief Make an edge executable, and queue it if it wasn't
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] edge The number of the edge
+ */
+static void markEdge(sccp_t *sccp, int edge);
+
+/**
+ * \brief Evaluate an instruction, marking the edges that a terminator takes
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] inst The instruction
+ * \param[in] slot The slot of `inst`
+ */
+static void visit(sccp_t *sccp, LLVMValueRef inst, int slot);
+
+/**
+ * \brief Follow an edge that became executable
+ *
+ * The first edge into a block evaluates the whole block, and any later one
+ * only its phis.
+ *
+ * \param[in,out] sccp The solver
+ * \param[in] block The position of the block that the edge goes to
+ */
+static void enterBlock(sccp_t *sccp, int block);
+
+/**
+ * \brief Empty both worklists
+ *
+ * \param[in,out] sccp The solver
+ */
+static void propagate(sccp_t *sccp);
+
+/**
+ * \brief Give up on the conditions that are still unknown
+ *
+ * A branch on a value that is unknown once both worklists are empty takes no
+ * edge. Such a condition only comes from reading a variable before any store,
+ * so it is made overdefined, which makes the branch take every edge.
+ *
+ * \param[in,out] sccp The solver
+ * \returns Whether any condition was changed
+ */
+static bool resolveConditions(sccp_t *sccp);
+
+/**
+ * \brief Number the instructions and find the stores that reach each load
+ *
+ * \param[in,out] sccp The solver, whose function and metadata are set
+ * \param[in,out] arena The arena to allocate from
+ */
+static void initialize(sccp_t *sccp, arena_t *arena);
+
+/**
+ * \brief Drop the incoming values of the phis of a block that come from edges
+ * that can't be taken
+ *
+ * \param[in] sccp The solution
+ * \param[in] builder A builder to create the phis that replace them with
+ * \param[in] block The position of the block
+ * \returns Whether any phi changed
+ */
+static bool prunePhis(const sccp_t *sccp, LLVMBuilderRef builder, int block);
+
+/*** Private function definitions ***/
+
+static int intWidth(LLVMTypeRef type) {
+    if (LLVMGetTypeKind(type) != LLVMIntegerTypeKind)
+        return 0;
+
+    unsigned int width = LLVMGetIntTypeWidth(type);
+    return width <= 64 ? (int)width : 0;
+}
+
+/**
+ * \brief Return the mask of the bits of an integer of some width
+ *
+ * \param[in] width The width, from 1 to 64
+ * \returns The mask
+ */
+static uint64_t widthMask(int width) {
+    return width == 64 ? ~0ull : (1ull << width) - 1;
+}
+
+/**
+ * \brief Interpret the bits of an integer as a signed number
+ *
+ * \param[in] bits The bits, zero extended
+ * \param[in] width The width of the integer, from 1 to 64
+ * \returns The number
+ */
+static int64_t signExtend(uint64_t bits, int width) {
+    return (int64_t)(bits << (64 - width)) >> (64 - width);
+}
+
+static lattice_t operandValue(const sccp_t *sccp, LLVMValueRef value) {
+    lattice_t result = {latticeOverdefined, 0, NULL};
+
+    if (LLVMIsAInstruction(value))
+        return sccp->cells[ptrsetFind(sccp->insts, value)];
+
+    // undef may be a different value at every use
+    if (!LLVMIsAConstant(value) || LLVMIsUndef(value))
+        return result;
+
+    // the bits of a constant expression such as `ptrtoint` aren't known
+    // until it is linked, so only integer literals are computed with
+    bool integer = intWidth(LLVMTypeOf(value)) > 0;
+
+    if (integer && !LLVMIsAConstantInt(value))
+        return result;
+
+    result.state = latticeConstant;
+    result.constant = value;
+
+    if (integer)
+        result.bits = LLVMConstIntGetZExtValue(value);
+    return result;
+}
+
+static lattice_t meet(lattice_t a, lattice_t b) {
+    if (a.state == latticeUnknown)
+        return b;
+    if (b.state == latticeUnknown || a.state == latticeOverdefined)
+        return a;
+    if (b.state == latticeOverdefined)
+        return b;
+
+    // constants in the IR are unique, and only integers have no constant
+    bool same = a.constant != NULL && b.constant != NULL
+                    ? a.constant == b.constant
+                    : a.bits == b.bits;
+
+    if (same)
+        return a.constant != NULL ? a : b;
+
+    lattice_t overdefined = {latticeOverdefined, 0, NULL};
+    return overdefined;
+}
+
+static bool foldBinary(LLVMOpcode opcode, uint64_t x, uint64_t y, int width,
+                       uint64_t *result) {
+    int64_t sx = signExtend(x, width);
+    int64_t sy = signExtend(y, width);
+    int64_t minimum = signExtend(1ull << (width - 1), width);
+
+    switch (opcode) {
+    case LLVMAdd:
+        *result = x + y;
+        break;
+    case LLVMSub:
+        *result = x - y;
+        break;
+    case LLVMMul:
+        *result = x * y;
+        break;
+    case LLVMUDiv:
+    case LLVMURem:
+        if (y == 0)
+            return false;
+        *result = opcode == LLVMUDiv ? x / y : x % y;
+        break;
+    case LLVMSDiv:
+    case LLVMSRem:
+        if (sy == 0 || (sx == minimum && sy == -1))
+            return false;
+        *result = (uint64_t)(opcode == LLVMSDiv ? sx / sy : sx % sy);
+        break;
+    case LLVMShl:
+    case LLVMLShr:
+    case LLVMAShr:
+        if (y >= (uint64_t)width)
+            return false;
+        *result = opcode == LLVMShl    ? x << y
+                  : opcode == LLVMLShr ? x >> y
+                                       : (uint64_t)(sx >> y);
+        break;
+    case LLVMAnd:
+        *result = x & y;
+        break;
+    case LLVMOr:
+        *result = x | y;
+        break;
+    case LLVMXor:
+        *result = x ^ y;
+        break;
+    default:
+        return false;
+    }
+    *result &= widthMask(width);
+    return true;
+}
+
+static bool foldICmp(LLVMIntPredicate predicate, uint64_t x, uint64_t y,
+                     int width) {
+    int64_t sx = signExtend(x, width);
+    int64_t sy = signExtend(y, width);
+
+    switch (predicate) {
+    case LLVMIntEQ:
+        return x == y;
+    case LLVMIntNE:
+        return x != y;
+    case LLVMIntUGT:
+        return x > y;
+    case LLVMIntUGE:
+        return x >= y;
+    case LLVMIntULT:
+        return x < y;
+    case LLVMIntULE:
+        return x <= y;
+    case LLVMIntSGT:
+        return sx > sy;
+    case LLVMIntSGE:
+        return sx >= sy;
+    case LLVMIntSLT:
+        return sx < sy;
+    default:
+        return sx <= sy;
+    }
+}
+
+static int executableEdgesTo(const sccp_t *sccp, int from, int to) {
+    meta_t *meta = sccp->blocks->data[from];
+    int count = 0;
+
+    for (int i = 0; i < meta->succs.length; i++) {
+        if (meta->succs.data[i] == to &&
+            bitsetContains(sccp->executableEdges, sccp->firstEdge[from] + i))
+            count++;
+    }
+    return count;
+}
+
+static lattice_t evaluate(const sccp_t *sccp, LLVMValueRef inst, int slot) {
+    lattice_t unknown = {latticeUnknown, 0, NULL};
+    lattice_t overdefined = {latticeOverdefined, 0, NULL};
+    LLVMOpcode opcode = LLVMGetInstructionOpcode(inst);
+
+    if (opcode == LLVMPHI) {
+        lattice_t value = unknown;
+        int block = sccp->blockOf[slot];
+
+        // only the edges that can be taken bring values in
+        for (unsigned int i = 0; i < LLVMCountIncoming(inst); i++) {
+            int pred =
+                blockIndexFind(sccp->index, LLVMGetIncomingBlock(inst, i));
+
+            if (executableEdgesTo(sccp, pred, block) == 0)
+                continue;
+
+            LLVMValueRef incoming = LLVMGetIncomingValue(inst, i);
+            value = meet(value, operandValue(sccp, incoming));
+
+            if (value.state == latticeOverdefined)
+                break;
+        }
+        return value;
+    }
+
+    if (opcode == LLVMLoad) {
+        if (sccp->firstReaching[slot] < 0)
+            return overdefined;
+
+        lattice_t value = unknown;
+        const int *stores = &sccp->reaching.data[sccp->firstReaching[slot]];
+
+        // a store in a block that can't run never reaches the load
+        for (int i = 0; i < sccp->numReaching[slot]; i++) {
+            if (!bitsetContains(sccp->executable, sccp->storeBlock[stores[i]]))
+                continue;
+
+            LLVMValueRef store = sccp->S->stores.data[stores[i]];
+            value = meet(value, operandValue(sccp, LLVMGetOperand(store, 0)));
+
+            if (value.state == latticeOverdefined)
+                break;
+        }
+        return value;
+    }
+
+    if (opcode == LLVMSelect) {
+        LLVMValueRef condition = LLVMGetOperand(inst, 0);
+
+        // a select on a vector picks each element on its own
+        if (intWidth(LLVMTypeOf(condition)) != 1)
+            return overdefined;
+
+        lattice_t cond = operandValue(sccp, condition);
+
+        if (cond.state == latticeUnknown)
+            return unknown;
+        if (cond.state == latticeConstant)
+            return operandValue(sccp, LLVMGetOperand(inst, cond.bits ? 1 : 2));
+        return meet(operandValue(sccp, LLVMGetOperand(inst, 1)),
+                    operandValue(sccp, LLVMGetOperand(inst, 2)));
+    }
+
+    // everything else is computed on integers from integers
+    int width = intWidth(LLVMTypeOf(inst));
+    bool binary = LLVMIsABinaryOperator(inst) != NULL;
+    bool compare = opcode == LLVMICmp;
+    bool cast = opcode == LLVMZExt || opcode == LLVMSExt || opcode == LLVMTrunc;
+
+    if (!(binary || compare || cast) || width == 0)
+        return overdefined;
+
+    int operandWidth = intWidth(LLVMTypeOf(LLVMGetOperand(inst, 0)));
+
+    if (operandWidth == 0)
+        return overdefined;
+
+    lattice_t x = operandValue(sccp, LLVMGetOperand(inst, 0));
+    lattice_t y = cast ? x : operandValue(sccp, LLVMGetOperand(inst, 1));
+
+    if (x.state == latticeOverdefined || y.state == latticeOverdefined)
+        return overdefined;
+    if (x.state == latticeUnknown || y.state == latticeUnknown)
+        return unknown;
+
+    lattice_t value = {latticeConstant, 0, NULL};
+
+    if (binary) {
+        if (!foldBinary(opcode, x.bits, y.bits, width, &value.bits))
+            return overdefined;
+    } else if (compare) {
+        value.bits = foldICmp(LLVMGetICmpPredicate(inst), x.bits, y.bits,
+                              operandWidth);
+    } else if (opcode == LLVMSExt) {
+        value.bits =
+            (uint64_t)signExtend(x.bits, operandWidth) & widthMask(width);
+    } else {
+        value.bits = x.bits & widthMask(width);
+    }
+    return value;
+}
+
+static int takenSuccessor(const sccp_t *sccp, LLVMValueRef term,
+                          lattice_state_t *state) {
+    *state = latticeOverdefined;
+    LLVMOpcode opcode = LLVMGetInstructionOpcode(term);
+
+    if (opcode == LLVMBr && LLVMIsConditional(term)) {
+        lattice_t cond = operandValue(sccp, LLVMGetCondition(term));
+        *state = cond.state;
+
+        // the first successor is the one taken when the condition is true
+        if (cond.state == latticeConstant)
+            return cond.bits ? 0 : 1;
+    } else if (opcode == LLVMSwitch) {
+        LLVMValueRef condition = LLVMGetOperand(term, 0);
+
+        if (intWidth(LLVMTypeOf(condition)) == 0)
+            return -1;
+
+        lattice_t cond = operandValue(sccp, condition);
+        *state = cond.state;
+
+        if (cond.state != latticeConstant)
+            return -1;
+
+        // the operands are the condition and the default successor, then the
+        // value and successor of each case
+        unsigned int numSuccessors = LLVMGetNumSuccessors(term);
+
+        for (unsigned int i = 1; i < numSuccessors; i++) {
+            if (LLVMConstIntGetZExtValue(LLVMGetOperand(term, 2 * i)) ==
+                cond.bits)
+                return i;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+static void pushSlot(sccp_t *sccp, int slot) {
+    // a block that can't run yet is evaluated whole once it can
+    if (!bitsetContains(sccp->executable, sccp->blockOf[slot]) ||
+        bitsetContains(sccp->queued, slot))
+        return;
+
+    bitsetAdd(sccp->queued, slot);
+    sccp->ssaWork[sccp->ssaLength++] = slot;
+}
+
+static void pushReaders(sccp_t *sccp, LLVMValueRef store) {
+    int number = storeNumber(sccp->S, store);
+
+    for (int i = sccp->firstReader[number]; i < sccp->firstReader[number + 1];
+         i++) {
+        pushSlot(sccp, sccp->readers[i]);
+    }
+}
+
+static void lower(sccp_t *sccp, LLVMValueRef inst, int slot, lattice_t value) {
+    lattice_t *cell = &sccp->cells[slot];
+
+    // values only move down, so a constant that doesn't match the one before
+    // is overdefined
+    if (value.state == latticeConstant && cell->state == latticeConstant)
+        value = meet(*cell, value);
+    if (value.state <= cell->state)
+        return;
+
+    *cell = value;
+
+    for (LLVMUseRef use = LLVMGetFirstUse(inst); use;
+         use = LLVMGetNextUse(use)) {
+        LLVMValueRef user = LLVMGetUser(use);
+
+        if (LLVMIsAStoreInst(user) && LLVMGetOperand(user, 0) == inst)
+            pushReaders(sccp, user);
+        else
+            pushSlot(sccp, ptrsetFind(sccp->insts, user));
+    }
+}
+
+static void markEdge(sccp_t *sccp, int edge) {
+    if (bitsetContains(sccp->executableEdges, edge))
+        return;
+
+    bitsetAdd(sccp->executableEdges, edge);
+    sccp->edgeWork[sccp->edgeLength++] = edge;
+}
+
+static void visit(sccp_t *sccp, LLVMValueRef inst, int slot) {
+    sccp->visits++;
+
+    if (LLVMIsATerminatorInst(inst)) {
+        int block = sccp->blockOf[slot];
+        meta_t *meta = sccp->blocks->data[block];
+        lattice_state_t state;
+        int taken = takenSuccessor(sccp, inst, &state);
+
+        // an unknown condition takes no edge until it is known
+        if (state == latticeUnknown)
+            return;
+
+        for (int i = 0; i < meta->succs.length; i++) {
+            if (taken < 0 || i == taken)
+                markEdge(sccp, sccp->firstEdge[block] + i);
+        }
+        return;
+    }
+
+    if (LLVMGetTypeKind(LLVMTypeOf(inst)) == LLVMVoidTypeKind)
+        return;
+    lower(sccp, inst, slot, evaluate(sccp, inst, slot));
+}
+
+static void enterBlock(sccp_t *sccp, int block) {
+    LLVMBasicBlockRef bb = sccp->blocks->data[block]->bb;
+
+    if (bitsetContains(sccp->executable, block)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb);
+             inst && LLVMIsAPHINode(inst);
+             inst = LLVMGetNextInstruction(inst)) {
+            visit(sccp, inst, ptrsetFind(sccp->insts, inst));
+        }
+        return;
+    }
+
+    bitsetAdd(sccp->executable, block);
+
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+        // the stores of the block now reach their loads
+        if (LLVMIsAStoreInst(inst))
+            pushReaders(sccp, inst);
+        else
+            visit(sccp, inst, ptrsetFind(sccp->insts, inst));
+    }
+}
+
+static void propagate(sccp_t *sccp) {
+    while (sccp->edgeLength > 0 || sccp->ssaLength > 0) {
+        while (sccp->edgeLength > 0) {
+            int edge = sccp->edgeWork[--sccp->edgeLength];
+            enterBlock(sccp, sccp->edgeTarget[edge]);
+        }
+
+        while (sccp->ssaLength > 0) {
+            int slot = sccp->ssaWork[--sccp->ssaLength];
+            bitsetRemove(sccp->queued, slot);
+            visit(sccp, sccp->insts->slots[slot], slot);
+        }
+    }
+}
+
+static bool resolveConditions(sccp_t *sccp) {
+    lattice_t overdefined = {latticeOverdefined, 0, NULL};
+    bool changed = false;
+
+    for (int block = bitsetNext(sccp->executable, 0); block >= 0;
+         block = bitsetNext(sccp->executable, block + 1)) {
+        LLVMValueRef term =
+            LLVMGetBasicBlockTerminator(sccp->blocks->data[block]->bb);
+        lattice_state_t state;
+
+        if (term == NULL)
+            continue;
+
+        takenSuccessor(sccp, term, &state);
+
+        if (state != latticeUnknown)
+            continue;
+
+        // only instructions are ever unknown
+        LLVMValueRef condition = LLVMGetOperand(term, 0);
+        lower(sccp, condition, ptrsetFind(sccp->insts, condition), overdefined);
+        changed = true;
+    }
+    return changed;
+}
+
+static void initialize(sccp_t *sccp, arena_t *arena) {
+    meta_vec_t *blocks = sccp->blocks;
+    store_set_t *S = sccp->S;
+    int numStores = S->stores.length;
+    meta_t *meta;
+    int i;
+
+    // the slots only number the instructions once the set is done growing
+    sccp->insts = ptrsetCreate(0);
+
+    vec_foreach(blocks, meta, i) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(meta->bb); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            ptrsetInsert(sccp->insts, inst);
+        }
+    }
+
+    int capacity = sccp->insts->capacity;
+    sccp->cells = arenaArray(arena, capacity, sizeof(lattice_t));
+    sccp->blockOf = arenaArray(arena, capacity, sizeof(int));
+    sccp->firstReaching = arenaArray(arena, capacity, sizeof(int));
+    sccp->numReaching = arenaArray(arena, capacity, sizeof(int));
+    sccp->storeBlock = arenaArray(arena, numStores, sizeof(int));
+    memset(sccp->cells, 0, sizeof(lattice_t) * capacity);
+    vec_init(&sccp->reaching);
+
+    // find the stores that reach each load of a local variable, like
+    // constant propagation does
+    var_set_t *vars = computeVars(sccp->fn);
+    bitset_t *R = bitsetCreateIn(arena, numStores);
+
+    vec_foreach(blocks, meta, i) {
+        bitsetCopy(R, meta->inSet);
+
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(meta->bb); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            int slot = ptrsetFind(sccp->insts, inst);
+            sccp->blockOf[slot] = i;
+            sccp->firstReaching[slot] = -1;
+
+            if (LLVMIsAStoreInst(inst)) {
+                int count;
+                value_key_t *killed =
+                    storesTo(S, LLVMGetOperand(inst, 1), &count);
+
+                for (int j = 0; j < count; j++) {
+                    bitsetRemove(R, killed[j].number);
+                }
+
+                int number = storeNumber(S, inst);
+                bitsetAdd(R, number);
+                sccp->storeBlock[number] = i;
+                continue;
+            }
+
+            LLVMValueRef addr = LLVMIsALoadInst(inst) ? LLVMGetOperand(inst, 0)
+                                                      : NULL;
+
+            if (addr == NULL || varNumber(vars, addr) < 0)
+                continue;
+
+            int count;
+            value_key_t *candidates = storesTo(S, addr, &count);
+            int first = sccp->reaching.length;
+            bool sameType = true;
+
+            for (int j = 0; j < count; j++) {
+                if (!bitsetContains(R, candidates[j].number))
+                    continue;
+
+                LLVMValueRef stored =
+                    LLVMGetOperand(S->stores.data[candidates[j].number], 0);
+                sameType &= LLVMTypeOf(stored) == LLVMTypeOf(inst);
+                vec_push(&sccp->reaching, candidates[j].number);
+            }
+
+            // a load of another type than the stores reinterprets their bits
+            if (!sameType) {
+                sccp->reaching.length = first;
+                continue;
+            }
+            sccp->firstReaching[slot] = first;
+            sccp->numReaching[slot] = sccp->reaching.length - first;
+        }
+    }
+    var_set_delete(vars);
+
+    // invert the lists, so that a store can queue the loads that it reaches
+    sccp->firstReader = arenaArray(arena, numStores + 1, sizeof(int));
+    sccp->readers = arenaArray(arena, sccp->reaching.length, sizeof(int));
+    int *next = arenaArray(arena, numStores, sizeof(int));
+    memset(sccp->firstReader, 0, sizeof(int) * (numStores + 1));
+
+    for (i = 0; i < sccp->reaching.length; i++) {
+        sccp->firstReader[sccp->reaching.data[i] + 1]++;
+    }
+    for (i = 0; i < numStores; i++) {
+        sccp->firstReader[i + 1] += sccp->firstReader[i];
+        next[i] = sccp->firstReader[i];
+    }
+    for (int slot = ptrsetNext(sccp->insts, 0); slot >= 0;
+         slot = ptrsetNext(sccp->insts, slot + 1)) {
+        if (sccp->firstReaching[slot] < 0)
+            continue;
+
+        for (int j = 0; j < sccp->numReaching[slot]; j++) {
+            int store = sccp->reaching.data[sccp->firstReaching[slot] + j];
+            sccp->readers[next[store]++] = slot;
+        }
+    }
+
+    // number the edges
+    int numEdges = 0;
+    sccp->firstEdge = arenaArray(arena, blocks->length, sizeof(int));
+
+    vec_foreach(blocks, meta, i) {
+        sccp->firstEdge[i] = numEdges;
+        numEdges += meta->succs.length;
+    }
+
+    sccp->edgeTarget = arenaArray(arena, numEdges, sizeof(int));
+
+    vec_foreach(blocks, meta, i) {
+        for (int j = 0; j < meta->succs.length; j++) {
+            sccp->edgeTarget[sccp->firstEdge[i] + j] = meta->succs.data[j];
+        }
+    }
+
+    sccp->executable = bitsetCreateIn(arena, blocks->length);
+    sccp->executableEdges = bitsetCreateIn(arena, numEdges);
+    sccp->ssaWork = arenaArray(arena, capacity, sizeof(int));
+    sccp->ssaLength = 0;
+    sccp->queued = bitsetCreateIn(arena, capacity);
+    sccp->edgeWork = arenaArray(arena, numEdges, sizeof(int));
+    sccp->edgeLength = 0;
+    sccp->visits = 0;
+}
+
+static bool prunePhis(const sccp_t *sccp, LLVMBuilderRef builder, int block) {
+    LLVMBasicBlockRef bb = sccp->blocks->data[block]->bb;
+    bool changed = false;
+    LLVMValueRef phi = LLVMGetFirstInstruction(bb);
+    val_vec_t values;
+    bb_vec_t preds;
+    vec_init(&values);
+    vec_init(&preds);
+
+    while (phi && LLVMIsAPHINode(phi)) {
+        LLVMValueRef next = LLVMGetNextInstruction(phi);
+        unsigned int numIncoming = LLVMCountIncoming(phi);
+        vec_clear(&values);
+        vec_clear(&preds);
+
+        // a block that branches here twice has two entries, and keeps as
+        // many as it has edges left
+        for (unsigned int i = 0; i < numIncoming; i++) {
+            LLVMBasicBlockRef pred = LLVMGetIncomingBlock(phi, i);
+            int edges = executableEdgesTo(
+                sccp, blockIndexFind(sccp->index, pred), block);
+            int kept = 0;
+
+            for (int j = 0; j < preds.length; j++) {
+                kept += preds.data[j] == pred;
+            }
+            if (kept < edges) {
+                vec_push(&values, LLVMGetIncomingValue(phi, i));
+                vec_push(&preds, pred);
+            }
+        }
+
+        // the C API can't remove incoming values, so the phi is rebuilt
+        if ((unsigned int)values.length < numIncoming) {
+            LLVMPositionBuilderBefore(builder, phi);
+            LLVMValueRef pruned = LLVMBuildPhi(builder, LLVMTypeOf(phi), "");
+            LLVMAddIncoming(pruned, values.data, preds.data, values.length);
+            LLVMReplaceAllUsesWith(phi, pruned);
+            LLVMInstructionEraseFromParent(phi);
+            changed = true;
+        }
+        phi = next;
+    }
+    vec_deinit(&values);
+    vec_deinit(&preds);
+    return changed;
+}
+
+/*** Public function definitions ***/
+
+sccp_t *sccpSolve(LLVMValueRef fn, store_set_t *S, meta_vec_t *metadata,
+                  arena_t *arena, sccp_stats_t *stats) {
+    sccp_t *sccp = arenaAlloc(arena, sizeof(sccp_t), _Alignof(sccp_t));
+    sccp->fn = fn;
+    sccp->S = S;
+    sccp->blocks = metadata;
+    sccp->index = blockIndexCreate(metadata);
+    initialize(sccp, arena);
+
+    // the entry block always runs
+    if (metadata->length > 0)
+        enterBlock(sccp, 0);
+
+    do {
+        propagate(sccp);
+    } while (resolveConditions(sccp));
+
+    stats->visits += sccp->visits;
+    return sccp;
+}
+
+bool sccpApply(sccp_t *sccp, sccp_stats_t *stats) {
+    LLVMBuilderRef builder =
+        LLVMCreateBuilderInContext(LLVMGetTypeContext(LLVMTypeOf(sccp->fn)));
+    val_vec_t toDelete;
+    vec_init(&toDelete);
+    bool changed = false;
+    meta_t *meta;
+    int i;
+
+    // replace the instructions that are constant. The ones in blocks that
+    // can't run go away with their blocks.
+    vec_foreach(sccp->blocks, meta, i) {
+        if (!bitsetContains(sccp->executable, i))
+            continue;
+
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(meta->bb); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            lattice_t *cell = &sccp->cells[ptrsetFind(sccp->insts, inst)];
+
+            if (cell->state != latticeConstant)
+                continue;
+
+            LLVMValueRef constant =
+                cell->constant != NULL
+                    ? cell->constant
+                    : LLVMConstInt(LLVMTypeOf(inst), cell->bits, false);
+            LLVMReplaceAllUsesWith(inst, constant);
+            vec_push(&toDelete, inst);
+        }
+    }
+
+    LLVMValueRef inst;
+    vec_foreach(&toDelete, inst, i) { LLVMInstructionEraseFromParent(inst); }
+    stats->constants += toDelete.length;
+    changed |= toDelete.length > 0;
+    vec_deinit(&toDelete);
+
+    // a branch on a constant only ever takes one of its edges
+    vec_foreach(sccp->blocks, meta, i) {
+        if (!bitsetContains(sccp->executable, i))
+            continue;
+
+        LLVMValueRef term = LLVMGetBasicBlockTerminator(meta->bb);
+        lattice_state_t state;
+        int taken = takenSuccessor(sccp, term, &state);
+
+        if (taken < 0)
+            continue;
+
+        LLVMPositionBuilderBefore(builder, term);
+        LLVMBuildBr(builder, LLVMGetSuccessor(term, taken));
+        LLVMInstructionEraseFromParent(term);
+        stats->branches++;
+        changed = true;
+    }
+
+    vec_foreach(sccp->blocks, meta, i) {
+        if (bitsetContains(sccp->executable, i))
+            changed |= prunePhis(sccp, builder, i);
+    }
+
+    // the blocks that can't run only refer to each other now, so their values
+    // are dropped before any of them is deleted
+    vec_foreach(sccp->blocks, meta, i) {
+        if (bitsetContains(sccp->executable, i))
+            continue;
+
+        for (inst = LLVMGetFirstInstruction(meta->bb); inst;
+             inst = LLVMGetNextInstruction(inst)) {
+            if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind)
+                LLVMReplaceAllUsesWith(inst, LLVMGetUndef(LLVMTypeOf(inst)));
+        }
+    }
+
+    vec_foreach(sccp->blocks, meta, i) {
+        if (bitsetContains(sccp->executable, i))
+            continue;
+
+        while ((inst = LLVMGetFirstInstruction(meta->bb)) != NULL) {
+            LLVMInstructionEraseFromParent(inst);
+        }
+    }
+
+    vec_foreach(sccp->blocks, meta, i) {
+        if (bitsetContains(sccp->executable, i))
+            continue;
+
+        LLVMDeleteBasicBlock(meta->bb);
+        stats->unreachable++;
+        changed = true;
+    }
+
+    LLVMDisposeBuilder(builder);
+    return changed;
+}
+
+void sccp_delete(sccp_t *sccp) {
+    block_index_delete(sccp->index);
+    ptrsetDelete(sccp->insts);
+    vec_deinit(&sccp->reaching);
+}
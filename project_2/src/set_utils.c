@@ -1,61 +1,69 @@
 #include <stdbool.h>
 
+#include "ptrset.h"
 #include "set_utils.h"
 #include "vec.h"
 
 vec_void_t *setUnion(vec_void_t *a, vec_void_t *b) {
-    vec_void_t tempSet;
-    vec_init(&tempSet);
+    vec_void_t *unionSet = malloc(sizeof(vec_void_t));
+    vec_init(unionSet);
+    ptrset_t *seen = ptrsetCreate(a->length + b->length);
     int i;
     void *it;
 
-    // add all elements from set a
-    vec_foreach(a, it, i) { vec_push(&tempSet, it); }
+    // add all elements from set a, then those from set b that a doesn't have
+    vec_foreach(a, it, i) {
+        if (ptrsetInsert(seen, it))
+            vec_push(unionSet, it);
+    }
 
-    // add all elements from set b
-    vec_foreach(b, it, i) { vec_push(&tempSet, it); }
-    vec_void_t *dedupedSet = setDedup(&tempSet);
-    vec_deinit(&tempSet);
-    return dedupedSet;
+    vec_foreach(b, it, i) {
+        if (ptrsetInsert(seen, it))
+            vec_push(unionSet, it);
+    }
+    ptrsetDelete(seen);
+    return unionSet;
 }
 
 vec_void_t *setDedup(vec_void_t *a) {
     vec_void_t *newSet = malloc(sizeof(vec_void_t));
     vec_init(newSet);
+    ptrset_t *seen = ptrsetCreate(a->length);
     void *it;
     int i = 0;
-    int found = -1;
 
-    // Create a new vector, checking to see if each element can be found to
-    // avoid adding duplicates
+    // Create a new vector, keeping each element only the first time that it
+    // is added to the hash set
     vec_foreach(a, it, i) {
-        vec_find(newSet, it, found);
-
-        if (found == -1)
+        if (ptrsetInsert(seen, it))
             vec_push(newSet, it);
     }
+    ptrsetDelete(seen);
     return newSet;
 }
 
 bool setEqual(vec_void_t *a, vec_void_t *b) {
+    ptrset_t *inA = ptrsetCreate(a->length);
+    ptrset_t *inB = ptrsetCreate(b->length);
     bool equal = true;
     void *it;
     int i;
-    int found = -1;
 
-    vec_foreach(a, it, i) {
-        vec_find(b, it, found);
-
-        if (found == -1)
-            equal = false;
-    }
+    vec_foreach(a, it, i) { ptrsetInsert(inA, it); }
 
+    // every element of b must be in a, and then the sets are equal if they
+    // have as many distinct elements
     vec_foreach(b, it, i) {
-        vec_find(a, it, found);
-
-        if (found == -1)
+        if (!ptrsetContains(inA, it)) {
             equal = false;
+            break;
+        }
+        ptrsetInsert(inB, it);
     }
+    equal = equal && inA->length == inB->length;
+
+    ptrsetDelete(inA);
+    ptrsetDelete(inB);
     return equal;
 }
 
@@ -0,0 +1,75 @@
+; ModuleID = 'test5.c'
+source_filename = "test5.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@g = dso_local global i32 0, align 4
+
+; long x = (long)&g; return x == 0;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @null_check() #0 {
+  %1 = alloca i64, align 8
+  store i64 ptrtoint (i32* @g to i64), i64* %1, align 8
+  %2 = load i64, i64* %1, align 8
+  %3 = icmp eq i64 %2, 0
+  %4 = zext i1 %3 to i32
+  ret i32 %4
+}
+
+; long x = (long)&g; return (x & 3) + (x - x);
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i64 @low_bits() #0 {
+  %1 = alloca i64, align 8
+  store i64 ptrtoint (i32* @g to i64), i64* %1, align 8
+  %2 = load i64, i64* %1, align 8
+  %3 = and i64 %2, 3
+  %4 = load i64, i64* %1, align 8
+  %5 = load i64, i64* %1, align 8
+  %6 = sub nsw i64 %4, %5
+  %7 = add nsw i64 %3, %6
+  ret i64 %7
+}
+
+; if (&g == 0) return 1; return 2;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @branch() #0 {
+  %1 = alloca i32, align 4
+  br i1 icmp eq (i64 ptrtoint (i32* @g to i64), i64 0), label %2, label %3
+
+2:                                                ; preds = %0
+  store i32 1, i32* %1, align 4
+  br label %4
+
+3:                                                ; preds = %0
+  store i32 2, i32* %1, align 4
+  br label %4
+
+4:                                                ; preds = %3, %2
+  %5 = load i32, i32* %1, align 4
+  ret i32 %5
+}
+
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @main() #0 {
+  %1 = call i32 @null_check()
+  %2 = call i64 @low_bits()
+  %3 = trunc i64 %2 to i32
+  %4 = call i32 @branch()
+  %5 = mul nsw i32 %1, 100
+  %6 = mul nsw i32 %3, 10
+  %7 = add nsw i32 %5, %6
+  %8 = add nsw i32 %7, %4
+  ret i32 %8
+}
+
+attributes #0 = { noinline nounwind optnone uwtable "frame-pointer"="all" "min-legal-vector-width"="0" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 7, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 1}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"Ubuntu clang version 14.0.6"}
@@ -0,0 +1,151 @@
+; ModuleID = 'test6.c'
+source_filename = "test6.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; int x = 0; return x != 0 && n > 3;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @phi_branch(i32 %0) #0 {
+  %2 = alloca i32, align 4
+  %3 = alloca i32, align 4
+  store i32 %0, i32* %2, align 4
+  store i32 0, i32* %3, align 4
+  %4 = load i32, i32* %3, align 4
+  %5 = icmp ne i32 %4, 0
+  br i1 %5, label %6, label %9
+
+6:                                                ; preds = %1
+  %7 = load i32, i32* %2, align 4
+  %8 = icmp sgt i32 %7, 3
+  br label %9
+
+9:                                                ; preds = %6, %1
+  %10 = phi i1 [ false, %1 ], [ %8, %6 ]
+  %11 = zext i1 %10 to i32
+  ret i32 %11
+}
+
+; int k = 2, r; switch (k) { case 1: r = 10; break; case 2: r = 20; break;
+; default: r = 30; } return r;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @switch_const() #0 {
+  %1 = alloca i32, align 4
+  %2 = alloca i32, align 4
+  store i32 2, i32* %1, align 4
+  %3 = load i32, i32* %1, align 4
+  switch i32 %3, label %6 [
+    i32 1, label %4
+    i32 2, label %5
+  ]
+
+4:                                                ; preds = %0
+  store i32 10, i32* %2, align 4
+  br label %7
+
+5:                                                ; preds = %0
+  store i32 20, i32* %2, align 4
+  br label %7
+
+6:                                                ; preds = %0
+  store i32 30, i32* %2, align 4
+  br label %7
+
+7:                                                ; preds = %6, %5, %4
+  %8 = load i32, i32* %2, align 4
+  ret i32 %8
+}
+
+; int x, c = 0; if (c) x = 5; if (n > 100) return x; return n;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @dead_store(i32 %0) #0 {
+  %2 = alloca i32, align 4
+  %3 = alloca i32, align 4
+  %4 = alloca i32, align 4
+  %5 = alloca i32, align 4
+  store i32 %0, i32* %3, align 4
+  store i32 0, i32* %5, align 4
+  %6 = load i32, i32* %5, align 4
+  %7 = icmp ne i32 %6, 0
+  br i1 %7, label %8, label %9
+
+8:                                                ; preds = %1
+  store i32 5, i32* %4, align 4
+  br label %9
+
+9:                                                ; preds = %8, %1
+  %10 = load i32, i32* %3, align 4
+  %11 = icmp sgt i32 %10, 100
+  br i1 %11, label %12, label %14
+
+12:                                               ; preds = %9
+  %13 = load i32, i32* %4, align 4
+  store i32 %13, i32* %2, align 4
+  br label %16
+
+14:                                               ; preds = %9
+  %15 = load i32, i32* %3, align 4
+  store i32 %15, i32* %2, align 4
+  br label %16
+
+16:                                               ; preds = %14, %12
+  %17 = load i32, i32* %2, align 4
+  ret i32 %17
+}
+
+; int flag; if (n > 100) { if (flag) return 1; return 2; } return 0;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @uninit(i32 %0) #0 {
+  %2 = alloca i32, align 4
+  %3 = alloca i32, align 4
+  %4 = alloca i32, align 4
+  store i32 %0, i32* %3, align 4
+  %5 = load i32, i32* %3, align 4
+  %6 = icmp sgt i32 %5, 100
+  br i1 %6, label %7, label %12
+
+7:                                                ; preds = %1
+  %8 = load i32, i32* %4, align 4
+  %9 = icmp ne i32 %8, 0
+  br i1 %9, label %10, label %11
+
+10:                                               ; preds = %7
+  store i32 1, i32* %2, align 4
+  br label %13
+
+11:                                               ; preds = %7
+  store i32 2, i32* %2, align 4
+  br label %13
+
+12:                                               ; preds = %1
+  store i32 0, i32* %2, align 4
+  br label %13
+
+13:                                               ; preds = %12, %11, %10
+  %14 = load i32, i32* %2, align 4
+  ret i32 %14
+}
+
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @main() #0 {
+  %1 = call i32 @phi_branch(i32 7)
+  %2 = call i32 @switch_const()
+  %3 = call i32 @dead_store(i32 7)
+  %4 = call i32 @uninit(i32 7)
+  %5 = mul nsw i32 %1, 100
+  %6 = add nsw i32 %5, %2
+  %7 = add nsw i32 %6, %3
+  %8 = add nsw i32 %7, %4
+  ret i32 %8
+}
+
+attributes #0 = { noinline nounwind optnone uwtable "frame-pointer"="all" "min-legal-vector-width"="0" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 7, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 1}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"Ubuntu clang version 14.0.6"}
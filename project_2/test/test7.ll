@@ -0,0 +1,150 @@
+; ModuleID = 'test7.c'
+source_filename = "test7.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; return (a + b) * (b + a);
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @commute(i32 %0, i32 %1) #0 {
+  %3 = alloca i32, align 4
+  %4 = alloca i32, align 4
+  store i32 %0, i32* %3, align 4
+  store i32 %1, i32* %4, align 4
+  %5 = load i32, i32* %3, align 4
+  %6 = load i32, i32* %4, align 4
+  %7 = add nsw i32 %5, %6
+  %8 = load i32, i32* %4, align 4
+  %9 = load i32, i32* %3, align 4
+  %10 = add nsw i32 %8, %9
+  %11 = mul nsw i32 %7, %10
+  ret i32 %11
+}
+
+; return (a < b) + (b > a);
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @swapped(i32 %0, i32 %1) #0 {
+  %3 = alloca i32, align 4
+  %4 = alloca i32, align 4
+  store i32 %0, i32* %3, align 4
+  store i32 %1, i32* %4, align 4
+  %5 = load i32, i32* %3, align 4
+  %6 = load i32, i32* %4, align 4
+  %7 = icmp slt i32 %5, %6
+  %8 = zext i1 %7 to i32
+  %9 = load i32, i32* %4, align 4
+  %10 = load i32, i32* %3, align 4
+  %11 = icmp sgt i32 %9, %10
+  %12 = zext i1 %11 to i32
+  %13 = add nsw i32 %8, %12
+  ret i32 %13
+}
+
+; *p += 1;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local void @bump(i32* %0) #0 {
+  %2 = alloca i32*, align 8
+  store i32* %0, i32** %2, align 8
+  %3 = load i32*, i32** %2, align 8
+  %4 = load i32, i32* %3, align 4
+  %5 = add nsw i32 %4, 1
+  store i32 %5, i32* %3, align 4
+  ret void
+}
+
+; int x = *p; bump(p); return x + *p;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @across_call(i32* %0) #0 {
+  %2 = alloca i32*, align 8
+  %3 = alloca i32, align 4
+  store i32* %0, i32** %2, align 8
+  %4 = load i32*, i32** %2, align 8
+  %5 = load i32, i32* %4, align 4
+  store i32 %5, i32* %3, align 4
+  %6 = load i32*, i32** %2, align 8
+  call void @bump(i32* %6)
+  %7 = load i32, i32* %3, align 4
+  %8 = load i32*, i32** %2, align 8
+  %9 = load i32, i32* %8, align 4
+  %10 = add nsw i32 %7, %9
+  ret i32 %10
+}
+
+; int x = *p; *q = 7; return x + *p;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @through_pointer(i32* %0, i32* %1) #0 {
+  %3 = alloca i32*, align 8
+  %4 = alloca i32*, align 8
+  %5 = alloca i32, align 4
+  store i32* %0, i32** %3, align 8
+  store i32* %1, i32** %4, align 8
+  %6 = load i32*, i32** %3, align 8
+  %7 = load i32, i32* %6, align 4
+  store i32 %7, i32* %5, align 4
+  %8 = load i32*, i32** %4, align 8
+  store i32 7, i32* %8, align 4
+  %9 = load i32, i32* %5, align 4
+  %10 = load i32*, i32** %3, align 8
+  %11 = load i32, i32* %10, align 4
+  %12 = add nsw i32 %9, %11
+  ret i32 %12
+}
+
+; int r = a * b; if (c) r += b * a; return r;
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @dominated(i32 %0, i32 %1, i32 %2) #0 {
+  %4 = alloca i32, align 4
+  %5 = alloca i32, align 4
+  %6 = alloca i32, align 4
+  %7 = alloca i32, align 4
+  store i32 %0, i32* %4, align 4
+  store i32 %1, i32* %5, align 4
+  store i32 %2, i32* %6, align 4
+  %8 = load i32, i32* %4, align 4
+  %9 = load i32, i32* %5, align 4
+  %10 = mul nsw i32 %8, %9
+  store i32 %10, i32* %7, align 4
+  %11 = load i32, i32* %6, align 4
+  %12 = icmp ne i32 %11, 0
+  br i1 %12, label %13, label %19
+
+13:                                               ; preds = %3
+  %14 = load i32, i32* %5, align 4
+  %15 = load i32, i32* %4, align 4
+  %16 = mul nsw i32 %14, %15
+  %17 = load i32, i32* %7, align 4
+  %18 = add nsw i32 %17, %16
+  store i32 %18, i32* %7, align 4
+  br label %19
+
+19:                                               ; preds = %13, %3
+  %20 = load i32, i32* %7, align 4
+  ret i32 %20
+}
+
+; Function Attrs: noinline nounwind optnone uwtable
+define dso_local i32 @main() #0 {
+  %1 = alloca i32, align 4
+  store i32 5, i32* %1, align 4
+  %2 = call i32 @commute(i32 2, i32 3)
+  %3 = call i32 @swapped(i32 2, i32 3)
+  %4 = add nsw i32 %2, %3
+  %5 = call i32 @across_call(i32* %1)
+  %6 = add nsw i32 %4, %5
+  %7 = call i32 @through_pointer(i32* %1, i32* %1)
+  %8 = add nsw i32 %6, %7
+  %9 = call i32 @dominated(i32 2, i32 3, i32 1)
+  %10 = add nsw i32 %8, %9
+  ret i32 %10
+}
+
+attributes #0 = { noinline nounwind optnone uwtable "frame-pointer"="all" "min-legal-vector-width"="0" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 7, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 1}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"Ubuntu clang version 14.0.6"}
@@ -13,8 +13,10 @@
 #include <string>
 #include <tuple>
 #include <unordered_map>
+#include <vector>
 
 #include <llvm/IR/Instruction.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IRReader/IRReader.h>
 
 #pragma once
@@ -27,6 +29,7 @@ typedef enum {
     ebx,
     ecx,
     edx,
+    ebp,
     nullRegister,
 } PhysicalRegister;
 
@@ -39,6 +42,11 @@ typedef std::tuple<int, int> Interval;
 //! A mapping from an instruction to its byte offset
 typedef std::unordered_map<const llvm::Instruction *, int> OffsetTable;
 
+//! A mapping from an instruction to the value whose home slot it shares
+typedef std::unordered_map<const llvm::Instruction *,
+                           const llvm::Instruction *>
+    HomeTable;
+
 //! A mapping from an instruction to its index
 typedef std::unordered_map<const llvm::Instruction *, unsigned int> IndexTable;
 
@@ -69,6 +77,84 @@ typedef std::unordered_map<const llvm::Instruction *,
                            std::set<PhysicalRegister>>
     RegisterTable;
 
+//! The ways a value can be recomputed at its uses instead of being spilled
+typedef enum {
+    //! The value folds to a constant, and is used as an immediate
+    rematConstant,
+    //! The value was loaded from a stack slot that isn't written to again
+    //! before the value's last use, so it is read from that slot again
+    rematReload,
+} RematKind;
+
+//! Describes how to recompute a value that didn't get a register
+struct Remat {
+    //! How the value is recomputed
+    RematKind kind;
+
+    //! The folded value for `rematConstant`
+    int immediate;
+
+    //! The slot the value was loaded from for `rematReload`
+    const llvm::Value *slot;
+};
+
+/*!
+ * \brief A table of rematerializable values
+ *
+ * A mapping from an instruction to the way that its value can be recomputed
+ * at each use. Instructions that are not in the table must be spilled to
+ * memory if they don't get a register.
+ */
+typedef std::unordered_map<const llvm::Instruction *, Remat> RematTable;
+
+/*!
+ * \brief A table of folded loads
+ *
+ * A mapping from a load to the stack slot it reads. A folded load isn't
+ * given a register; its only user reads the slot as a memory operand
+ * instead.
+ */
+typedef std::unordered_map<const llvm::Instruction *, const llvm::AllocaInst *>
+    FoldTable;
+
+/*!
+ * \brief A table of coalescing hints
+ *
+ * A mapping from an arithmetic or division instruction to an operand whose
+ * last use is that instruction. The result may take over the operand's
+ * register, since the operand's value is no longer needed once the result is
+ * written.
+ */
+typedef std::unordered_map<const llvm::Instruction *, const llvm::Instruction *>
+    HintTable;
+
+//! The fixed registers that an instruction reads, writes and overwrites
+struct RegisterConstraint {
+    //! The register that the instruction leaves its result in, or
+    //! `nullRegister` if it isn't fixed
+    PhysicalRegister def = nullRegister;
+
+    //! The registers that operands are read from, by operand number
+    std::vector<std::pair<unsigned, PhysicalRegister>> uses;
+
+    //! Registers that are overwritten after the operands are read
+    RegisterSet clobbers;
+
+    //! Registers that are overwritten before every operand is read, so they
+    //! may only hold the operands that are read from them
+    RegisterSet earlyClobbers;
+};
+
+/*!
+ * \brief A table of fixed register constraints
+ *
+ * A mapping from an instruction to the registers that the machine
+ * instructions it's lowered to require or overwrite. Instructions that work
+ * with any register aren't in the table.
+ */
+typedef std::unordered_map<const llvm::Instruction *, RegisterConstraint>
+    ConstraintTable;
+
 /*** function prototypes ***/
 
 /*!
@@ -83,6 +169,10 @@ typedef std::unordered_map<const llvm::Instruction *,
  * formed), it is the responsibility of the user to verify that everything
  * is working.
  *
+ * Function bodies in bitcode are only read once they are materialized, so
+ * that code generation can start on the first function while the rest are
+ * still on disk. Textual IR is parsed all at once.
+ *
  * \param filename The relative path to the file
  * \param context The MT-safe LLVM context. There should only be one per
  * thread
@@ -91,6 +181,22 @@ typedef std::unordered_map<const llvm::Instruction *,
 std::unique_ptr<llvm::Module> loadModule(const std::string &filename,
                                          llvm::LLVMContext &context);
 
+/*!
+ * \brief Create an LLVM IR module from IR held in memory
+ *
+ * This behaves like `loadModule`, but parses the textual IR from a string
+ * rather than reading it from a file. It will throw an exception if the IR
+ * cannot be parsed.
+ *
+ * \param ir The textual LLVM IR
+ * \param context The LLVM context to create the module in
+ * \param name The name of the file that the IR came from
+ * \returns a pointer to an LLVM module
+ */
+std::unique_ptr<llvm::Module> parseModule(const std::string &ir,
+                                          llvm::LLVMContext &context,
+                                          const std::string &name);
+
 /*!
  * \brief Create the instruction offset table for an LLVM function
  *
@@ -101,10 +207,58 @@ std::unique_ptr<llvm::Module> loadModule(const std::string &filename,
  * These offsets represent the offset that needs to be added to `%ebp` when
  * generating the code.
  *
+ * Registers are only allocated within a basic block, so any value that is
+ * used outside of the block that defines it, or by a phi, is also given a
+ * slot here, which serves as its home in memory. So is every phi. Values
+ * that were coalesced share the slot of their class.
+ *
  * \param func[in] The LLVM function to inspect
+ * \param homes[in] The value whose slot each coalesced value shares
  * \returns An offset table
  */
-std::shared_ptr<OffsetTable> genOffsetTable(const llvm::Function &func);
+std::shared_ptr<OffsetTable> genOffsetTable(const llvm::Function &func,
+                                            const HomeTable &homes);
+
+/*!
+ * \brief Reserve a new stack slot for an instruction
+ *
+ * The slot is placed below every slot that is already in the table.
+ *
+ * \param[in,out] table The function's offset table
+ * \param[in] inst The instruction that needs a slot
+ * \returns The offset of the new slot from `%ebp`
+ */
+int allocateSlot(OffsetTable &table, const llvm::Instruction *inst);
+
+/*!
+ * \brief Compute the size of the stack frame described by an offset table
+ *
+ * \param[in] table The function's offset table
+ * \returns The number of bytes to reserve below `%ebp`
+ */
+int frameSize(const OffsetTable &table);
+
+/*!
+ * \brief Return whether a value is used outside of the block it's defined in
+ *
+ * A phi counts as such a user even in the same block, since it reads the
+ * value on the edge back into the block.
+ *
+ * \param[in] inst The instruction to inspect
+ * \returns Whether any user lives in another basic block or is a phi
+ */
+bool isLiveOut(const llvm::Instruction &inst);
+
+/*!
+ * \brief Return whether a comparison is folded into the instruction using it
+ *
+ * An `icmp` whose only user is a conditional branch or a `select` in the same
+ * block doesn't need a register. Its `cmpl` is emitted with the user instead.
+ *
+ * \param[in] inst The instruction to inspect
+ * \returns Whether the instruction is a fused comparison
+ */
+bool isFusedCompare(const llvm::Instruction &inst);
 
 /*!
  * \brief Create an index table with indices for each basic block
@@ -122,24 +276,30 @@ std::shared_ptr<IndexTable> genIndexTable(const llvm::BasicBlock &bb);
  *
  * Given some basic block, this method will generate the table to determine
  * how long each instruction is "alive" for, and will store that as a tuple.
- * It will also initialize the physical register table for each instruction
- * or op.
+ * An interval runs from the index of the instruction that defines the value
+ * to the index of its last use in the block. It will also initialize the
+ * physical register table for each instruction or op. Values that are live
+ * out of the block have a home in memory, so no registers are available to
+ * them.
  *
  * \param[in] bb The basic block to inspect
  * \param[in] indexTable The populated index table
  * \param[out] intervalTable An allocated shared pointer for the interval table
  * \param[out] registers An allocated shared pointer for the register table
+ * \param[in] allocatable The registers that values may be assigned to
  */
 void tableInit(const llvm::BasicBlock &bb,
                const std::shared_ptr<IndexTable> &indexTable,
                const std::shared_ptr<IntervalTable> &intervalTable,
-               const std::shared_ptr<RegisterTable> &registers);
+               const std::shared_ptr<RegisterTable> &registers,
+               const RegisterSet &allocatable);
 
 /*!
  * \brief Sort a given interval table by the length of its interval
  *
  * Given a hashmap of operands and liveness intervals, this method sorts the
- * hashmap from longest interval to smallest interval.
+ * hashmap from longest interval to smallest interval. Intervals of the same
+ * length are sorted by where they start.
  *
  * \param[in] table The table to sort
  * \returns An ordered map of operands to their intervals
@@ -147,34 +307,145 @@ void tableInit(const llvm::BasicBlock &bb,
 std::shared_ptr<SortedIntervalList>
 sortIntervalMap(const std::shared_ptr<IntervalTable> &table);
 
+/*!
+ * \brief Find the values in a basic block that can be rematerialized
+ *
+ * A value can be rematerialized if it folds to a constant, or if it was
+ * loaded from a stack slot that nothing may write to between the load and
+ * the value's last use in the block. Values that are live out of the block
+ * are never rematerialized.
+ *
+ * \param[in] bb The basic block to inspect
+ * \param[in] indexTable The populated index table
+ * \param[in] intervalTable The populated interval table
+ * \returns A table of the values that can be rematerialized
+ */
+std::shared_ptr<RematTable>
+genRematTable(const llvm::BasicBlock &bb,
+              const std::shared_ptr<IndexTable> &indexTable,
+              const std::shared_ptr<IntervalTable> &intervalTable);
+
+/*!
+ * \brief Find the loads that can be folded into the instruction using them
+ *
+ * x86 arithmetic and comparisons can read one operand straight from memory.
+ * A load from a stack slot with a single use by such an instruction doesn't
+ * need a register of its own, as long as nothing can write to the slot
+ * between the load and its use.
+ *
+ * \param[in] bb The basic block to inspect
+ * \param[in] indexTable The populated index table
+ * \param[in] intervalTable The populated interval table
+ * \returns A table of the loads that can be folded
+ */
+std::shared_ptr<FoldTable>
+genFoldTable(const llvm::BasicBlock &bb,
+             const std::shared_ptr<IndexTable> &indexTable,
+             const std::shared_ptr<IntervalTable> &intervalTable);
+
+/*!
+ * \brief Find the operands that die at each arithmetic instruction
+ *
+ * x86 arithmetic overwrites its destination, so the result is computed in
+ * place of the first operand. If the first operand dies at the instruction,
+ * the result can reuse its register and no copy is needed. For commutative
+ * operations the second operand is considered as well, since the operands
+ * can be swapped.
+ *
+ * Division reads its dividend from `%eax` and writes its result to `%eax` or
+ * `%edx`, so a dying dividend and the result can share a register too.
+ *
+ * \param[in] bb The basic block to inspect
+ * \param[in] indexTable The populated index table
+ * \param[in] intervalTable The populated interval table
+ * \returns A table of coalescing hints
+ */
+std::shared_ptr<HintTable>
+genHintTable(const llvm::BasicBlock &bb,
+             const std::shared_ptr<IndexTable> &indexTable,
+             const std::shared_ptr<IntervalTable> &intervalTable);
+
+/*!
+ * \brief Create the constraint table for a basic block
+ *
+ * Division takes its dividend in `%eax`, overwrites `%edx` with the sign
+ * extension, and leaves the quotient in `%eax` and the remainder in `%edx`.
+ * Calls follow cdecl: they overwrite `%eax`, `%ecx` and `%edx` and return in
+ * `%eax`. Returned values are passed back in `%eax`.
+ *
+ * \param[in] bb The basic block to inspect
+ * \returns A table of the constrained instructions
+ */
+std::shared_ptr<ConstraintTable>
+genConstraintTable(const llvm::BasicBlock &bb);
+
+/*!
+ * \brief Remove overwritten registers from the values live across them
+ *
+ * A value that is still needed after a constrained instruction can't be in a
+ * register that the instruction overwrites. An operand that dies at the
+ * instruction can't be in an early clobbered register either, unless the
+ * operand is the one read from it.
+ *
+ * \param[in] indexTable The populated index table
+ * \param[in] intervalTable The populated interval table
+ * \param[in] constraints The constraint table for the block
+ * \param[in,out] registers The populated register table
+ */
+void applyClobbers(const std::shared_ptr<IndexTable> &indexTable,
+                   const std::shared_ptr<IntervalTable> &intervalTable,
+                   const std::shared_ptr<ConstraintTable> &constraints,
+                   const std::shared_ptr<RegisterTable> &registers);
+
 /*!
  * \brief Create the result table for a basic block
  *
+ * Values that can be rematerialized are cheaper to evict than values that
+ * have to be spilled, so they are only given registers once every other
+ * value has been considered.
+ *
+ * A value and the hinted operand that dies where it is defined don't
+ * interfere, and each of them prefers the register of the other.
+ *
+ * Values with a fixed register in the constraint table are precolored: they
+ * are assigned first, if the register is still available to them. Otherwise
+ * they are allocated like any other value and moved to or from the fixed
+ * register where needed.
+ *
  * \param[in] bb The basic block to inspect
  * \param[in] registers The populated register table
  * \param[in] liveness A list of pairs of instructions and their liveness
  * intervals sorted by the length of the liveness interval
+ * \param[in] remats The values that can be rematerialized
+ * \param[in] hints The coalescing hints for the block
+ * \param[in] constraints The constraint table for the block
  * \returns A populated result table with the register for each instruction
  */
 std::shared_ptr<ResultTable>
 genResultTable(const llvm::BasicBlock &bb,
                std::shared_ptr<RegisterTable> &registers,
-               std::shared_ptr<SortedIntervalList> &liveness);
+               std::shared_ptr<SortedIntervalList> &liveness,
+               const std::shared_ptr<RematTable> &remats,
+               const std::shared_ptr<HintTable> &hints,
+               const std::shared_ptr<ConstraintTable> &constraints);
 
 /*!
  * \brief Find the operands that overlap with the given instruction
  *
  * Given the sorted interval list, find the instructions that overlap with the
  * given instruction that are not equal to it. We define overlap as the given
- * instruction has an interval [a, b] and either there exists some other
- * interval [x, y] such that $x \leq a \leq y$ or $x \leq b \leq y$.
+ * instruction has an interval [a, b] and there exists some other interval
+ * [x, y] such that $a \leq y$ and $x \leq b$. A value never overlaps the
+ * operand that it's hinted to share a register with.
  *
  * \param[in] inst The instruction to inspect
  * \param[in] intervals A sorted list of operands and intervals
+ * \param[in] hints The coalescing hints for the block
  */
 std::unique_ptr<std::vector<const llvm::Instruction *>>
 getOverlappingOps(const llvm::Instruction *inst,
-                  const std::shared_ptr<SortedIntervalList> &intervals);
+                  const std::shared_ptr<SortedIntervalList> &intervals,
+                  const std::shared_ptr<HintTable> &hints);
 
 /*!
  * \brief Print the contents of a hashmap
@@ -208,6 +479,17 @@ void printUMap(const std::unordered_map<K, V> &m) {
  */
 bool isArithmeticInst(const llvm::Instruction &inst);
 
+/*!
+ * \brief Check whether an instruction is a division or a remainder
+ *
+ * These are `sdiv`, `udiv`, `srem` and `urem`, which are lowered to `idivl`
+ * or `divl` rather than to two-address arithmetic.
+ *
+ * \param[in] inst The instruction to inspect
+ * \returns Whether the instruction divides
+ */
+bool isDivisionInst(const llvm::Instruction &inst);
+
 /*!
  * \brief convert a physical register enum to its string representation
  *
@@ -216,6 +498,17 @@ bool isArithmeticInst(const llvm::Instruction &inst);
  */
 std::string registerString(PhysicalRegister reg);
 
+/*!
+ * \brief Check whether a register has to be preserved across a call
+ *
+ * A function that writes to `%ebx` or `%ebp` has to restore them before
+ * returning, while `%eax`, `%ecx` and `%edx` are free to overwrite.
+ *
+ * \param[in] reg The register to inspect
+ * \returns Whether the callee saves the register
+ */
+bool isCalleeSaved(PhysicalRegister reg);
+
 /*!
  * \brief Remove redundant load ops from a basic block
  *
@@ -7,32 +7,212 @@
  * other helper/convenience utilities.
  */
 
+#include <iostream>
+#include <optional>
+#include <ostream>
+#include <set>
 #include <string>
 
+#include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/IR/Instruction.h>
 
 #include "LLVMUtils.h"
+#include "flags.h"
+#include "ifconvert.h"
 
 #pragma once
 
-typedef std::unordered_map<const llvm::BasicBlock *, std::string> LabelTable;
+//! A mapping from a basic block to its label, and from a function or global
+//! to its symbol, so that code generation never looks up IR names
+typedef std::unordered_map<const llvm::Value *, std::string> LabelTable;
+
+//! A mapping from a source file to its number in `.file` and `.loc`
+typedef std::unordered_map<const llvm::DIFile *, unsigned> FileTable;
+
+//! Options that control code generation
+struct CodeGenOptions {
+    //! Whether to report code generation statistics to `stderr`
+    bool stats = false;
+
+    //! Whether values without a register may be rematerialized instead of
+    //! spilled
+    bool remat = true;
+
+    //! Whether to count the executions of every basic block and write the
+    //! counts to a profile when the program exits
+    bool instrument = false;
+
+    //! A profile from an instrumented run to guide block layout, if not
+    //! empty
+    std::string profilePath;
+
+    //! Whether to reorder the instructions of each block to hide latency
+    bool schedule = true;
+
+    //! Whether to address the stack frame relative to `%esp`, which makes
+    //! `%ebp` available to values
+    bool omitFramePointer = false;
+
+    //! The largest number of instructions in the arms of a branch that is
+    //! replaced by conditional moves, or 0 to keep every branch
+    unsigned ifConvertThreshold = defaultIfConvertThreshold;
+
+    //! Whether to map the generated code back to the source lines in the
+    //! debug locations of the IR
+    bool debugLines = false;
+
+    //! Whether to prepare, allocate and emit functions on separate threads
+    bool pipeline = true;
+
+    //! Whether to report how long each stage of code generation was busy to
+    //! `stderr`
+    bool timeStages = false;
+};
+
+/*!
+ * \brief Turn the flags of a command line into code generation options
+ *
+ * \param[in] flags The flags, as from `parseFlag`
+ * \returns The options
+ */
+CodeGenOptions codeGenOptions(const CompileFlags &flags);
+
+//! The layout of a function's stack frame
+struct FrameInfo {
+    //! Whether the frame is addressed relative to `%esp` instead of `%ebp`
+    bool omitFramePointer = false;
+
+    //! The number of bytes reserved for stack slots
+    int size = 0;
+
+    //! The callee-saved registers that the prologue saves, in push order
+    RegisterSet savedRegisters;
+
+    //! The blocks that access a stack slot or write to a callee-saved
+    //! register, and so can only run once the prologue has
+    std::set<const llvm::BasicBlock *> usedBy;
+
+    //! The block that the prologue is placed at the top of, or `nullptr` if
+    //! no block needs the frame
+    const llvm::BasicBlock *prologueBlock = nullptr;
+
+    //! The blocks that run with the frame set up, which are the ones
+    //! dominated by the prologue block
+    std::set<const llvm::BasicBlock *> framed;
+};
+
+//! What the flags are known to hold after the last instruction that set them
+struct FlagState {
+    //! The value that was compared, or `nullptr` if nothing is known
+    const llvm::Value *lhs = nullptr;
+
+    //! The value it was compared against, or `nullptr` for zero
+    const llvm::Value *rhs = nullptr;
+
+    //! Whether only the zero flag is known, as after `addl` and `subl`,
+    //! whose carry and overflow describe the arithmetic instead
+    bool onlyZero = false;
+};
+
+//! Counters collected while generating code for a function
+struct CodeGenStats {
+    //! Values that were given a stack slot because they have no register
+    unsigned spills = 0;
+
+    //! Values without a register that are recomputed at their uses instead
+    //! of being spilled
+    unsigned remats = 0;
+
+    //! Stores of a value to its stack slot
+    unsigned spillStores = 0;
+
+    //! Reads of a value from its stack slot
+    unsigned spillReloads = 0;
+
+    //! Registers that were saved with `pushl` to be used as scratch space
+    unsigned scratchSaves = 0;
+
+    //! Jumps that were left out because their target is the next block
+    unsigned fallthroughs = 0;
+
+    //! Instructions that the scheduler moved from their original position
+    unsigned reordered = 0;
+
+    //! Copies to a result register that were left out because the result
+    //! reuses the register of an operand that dies
+    unsigned coalesced = 0;
+
+    //! Loads that were folded into the instruction using them
+    unsigned foldedLoads = 0;
+
+    //! Branches that were replaced by conditional moves
+    unsigned ifConverted = 0;
+
+    //! Copies between registers that were needed because a value wasn't in
+    //! the fixed register that an instruction reads or writes
+    unsigned shuffles = 0;
+
+    //! Copies into the home slots of phis that coalescing didn't remove
+    unsigned phiCopies = 0;
+
+    //! Comparisons that were left out because the flags already held them
+    unsigned flagReuses = 0;
+
+    //! Registers zeroed with `xorl` instead of a `movl` of zero
+    unsigned zeroIdioms = 0;
+
+    /*!
+     * \brief Add the counters of another function to these ones
+     *
+     * \param[in] other The counters to add
+     * \returns These counters
+     */
+    CodeGenStats &operator+=(const CodeGenStats &other);
+};
 
 /*!
  * \brief Run code generation on an LLVM module
  *
  * Given some LLVM module, run code generation on the module for each basic
  * block within the module.
+ *
+ * Functions pass through three stages, which run on separate threads unless
+ * `options.pipeline` is off: their IR is loaded and transformed, registers
+ * are allocated for them, and their assembly is written to `out`. The
+ * functions are emitted in module order either way.
+ *
+ * With a profile, nothing is written to `out` until the profile is known to
+ * match the module. This will throw an exception if it doesn't.
+ *
+ * \param[in] module The module to generate code for
+ * \param[out] out The stream to write the assembly to
+ * \param[in] options Options that control code generation
+ * \param[out] err The stream to write statistics and stage times to
+ */
+void codeGen(std::unique_ptr<llvm::Module> &module, std::ostream &out,
+             const CodeGenOptions &options = CodeGenOptions(),
+             std::ostream &err = std::cerr);
+
+/*!
+ * \brief Print the code generation statistics for a function
+ *
+ * \param[in] name The name of the function
+ * \param[in] stats The counters collected for the function
+ * \param[out] out The stream to write the statistics to
  */
-void codeGen(std::unique_ptr<llvm::Module> &module);
+void printStats(const std::string &name, const CodeGenStats &stats,
+                std::ostream &out);
 
 /*!
  * \brief Print headers for a function
  *
- * Given some function, print the assembly function directives to stdout
+ * Given the symbol of some function, print the assembly function directives
+ * to a stream
  *
- * \param[in] func The function to inspect
+ * \param[in] name The symbol of the function
+ * \param[out] out The stream to write the directives to
  */
-void printFnDirective(const llvm::Function &func);
+void printFnDirective(const std::string &name, std::ostream &out);
 
 /*!
  * \brief A register allocation class for a basic block
@@ -54,10 +234,21 @@ class RegisterAllocator {
      * \param[in] bb A pointer to the basic block
      * \param[in] offsets A pointer to the offset table
      * \param[in] labels The assembly labels for each basic block
+     * \param[in] files The numbers of the source files in debug locations
+     * \param[out] out The stream to write the generated assembly to
+     * \param[out] stats The counters for the function the block is in
+     * \param[in] options Options that control code generation
+     * \param[in] fallthrough The block that is emitted right after this one,
+     * or `nullptr` if this is the last block
+     * \param[in,out] frame The layout of the function's stack frame, which
+     * records the callee-saved registers that the block uses
      */
     RegisterAllocator(const llvm::BasicBlock *bb,
                       std::shared_ptr<OffsetTable> &offsets,
-                      std::shared_ptr<LabelTable> &labels);
+                      std::shared_ptr<LabelTable> &labels,
+                      std::shared_ptr<FileTable> &files, std::ostream &out,
+                      CodeGenStats &stats, const CodeGenOptions &options,
+                      const llvm::BasicBlock *fallthrough, FrameInfo &frame);
     ~RegisterAllocator();
 
     /*!
@@ -79,6 +270,13 @@ class RegisterAllocator {
      *     - the index table
      *     - the result table
      *     - the interval table
+     *     - the rematerialization table
+     *     - the fold table
+     *     - the hint table
+     *     - the constraint table
+     *
+     * Values that don't get a register and can't be rematerialized are
+     * given a stack slot in the offset table.
      *
      * The description of these tables can be found in the Doxygen
      * documentation of each member variable that corresponds to each table.
@@ -104,6 +302,84 @@ class RegisterAllocator {
     //! The basic block that's being operated on
     const llvm::BasicBlock *basicBlock;
 
+    //! The block that follows this one in the layout, which doesn't need a
+    //! jump to reach
+    const llvm::BasicBlock *fallthrough;
+
+    //! The stream that the generated assembly is written to
+    std::ostream &out;
+
+    //! The counters for the function being generated
+    CodeGenStats &stats;
+
+    //! Options that control code generation
+    const CodeGenOptions &options;
+
+    //! The layout of the function's stack frame
+    FrameInfo &frame;
+
+    //! The registers that values can be allocated to
+    RegisterSet allocatable;
+
+    //! The number of bytes pushed onto the stack by scratch register saves
+    //! that haven't been popped yet
+    int pushDepth = 0;
+
+    //! What the flags hold at the end of the code emitted so far
+    FlagState flags;
+
+    //! Whether the instruction being generated still has to read the flags,
+    //! which keeps them from being overwritten in the meantime
+    bool flagsLive = false;
+
+    /*!
+     * \brief Return the operand for a location in the stack frame
+     *
+     * \param[in] offset The offset of the location from where `%ebp` points
+     * when it is used as the frame pointer
+     * \returns The location relative to the frame pointer, or relative to
+     * `%esp` when the frame pointer is omitted
+     */
+    std::string frameAddress(int offset) const;
+
+    /*!
+     * \brief Return the operand for an argument of the function
+     *
+     * \param[in] argNo The position of the argument
+     * \returns The location that the caller pushed the argument to, relative
+     * to wherever the current block can reach it from
+     */
+    std::string argumentAddress(unsigned argNo) const;
+
+    /*!
+     * \brief Move `%esp` by some number of bytes pushed or popped
+     *
+     * While the call frame is found relative to `%esp`, the CFI directives
+     * are updated to follow it.
+     *
+     * \param[in] bytes The number of bytes pushed, or negative if popped
+     */
+    void adjustStack(int bytes);
+
+    /*!
+     * \brief Print the source location of an instruction
+     *
+     * A `.loc` directive is only printed when the line changes.
+     *
+     * \param[in] inst The instruction whose code follows
+     */
+    void emitLocation(const llvm::Instruction &inst);
+
+    /*!
+     * \brief Record that the function writes to a register
+     *
+     * Callee-saved registers are saved in the prologue and restored before
+     * returning, so a block that writes to one needs the frame.
+     *
+     * \param[in] reg The register
+     */
+    void useRegister(PhysicalRegister reg);
+
     /*!
      * \brief Return the memory location for an operand
      *
@@ -116,6 +392,172 @@ class RegisterAllocator {
      */
     std::string findOp(const llvm::Value &inst) const;
 
+    /*!
+     * \brief Return the location of an operand that is read by an instruction
+     *
+     * This is the same as `findOp`, but also counts reads of spilled values.
+     *
+     * \param[in] value The operand that is read
+     * \returns The operand in x86 GAS format
+     */
+    std::string useOp(const llvm::Value &value);
+
+    /*!
+     * \brief Return whether a value was spilled to a stack slot
+     *
+     * \param[in] inst The instruction that defines the value
+     * \returns Whether the value lives in memory
+     */
+    bool isSpilled(const llvm::Instruction *inst) const;
+
+    /*!
+     * \brief Find a register to use as scratch space for an instruction
+     *
+     * A register that doesn't hold a live value at the instruction is used if
+     * there is one. Otherwise a register is saved with `pushl` and must be
+     * given back with `releaseScratch`.
+     *
+     * \param[in] inst The instruction that needs scratch space
+     * \param[in] exclude Registers that the instruction reads
+     * \param[out] saved Whether the register was saved on the stack
+     * \returns The scratch register
+     */
+    PhysicalRegister pickScratch(const llvm::Instruction &inst,
+                                 const RegisterSet &exclude, bool &saved);
+
+    /*!
+     * \brief Give back a scratch register from `pickScratch`
+     *
+     * \param[in] reg The scratch register
+     * \param[in] saved Whether the register was saved on the stack
+     */
+    void releaseScratch(PhysicalRegister reg, bool saved);
+
+    /*!
+     * \brief Return the registers holding the operands of an instruction
+     *
+     * \param[in] inst The instruction to inspect
+     * \returns The set of registers that the instruction reads
+     */
+    RegisterSet operandRegisters(const llvm::Instruction &inst) const;
+
+    /*!
+     * \brief Move an operand into the fixed register an instruction reads
+     *
+     * \param[in] src The operand
+     * \param[in] reg The fixed register
+     */
+    void moveToFixed(const std::string &src, PhysicalRegister reg);
+
+    /*!
+     * \brief Move a result out of the fixed register an instruction writes
+     *
+     * Nothing is moved if the result was allocated the fixed register.
+     *
+     * \param[in] inst The instruction that defines the value
+     * \param[in] resultRegister The register allocated to the value, or
+     * `nullRegister` if it has none
+     * \param[in] reg The fixed register
+     */
+    void moveFromFixed(const llvm::Instruction &inst,
+                       PhysicalRegister resultRegister, PhysicalRegister reg);
+
+    /*!
+     * \brief Write a value to its destination
+     *
+     * Stores the value to its stack slot if it was spilled. Otherwise the
+     * value already sits in its register.
+     *
+     * \param[in] inst The instruction that defines the value
+     * \param[in] reg The register the value was computed in
+     */
+    void writeResult(const llvm::Instruction &inst, PhysicalRegister reg);
+
+    /*!
+     * \brief Emit an instruction
+     *
+     * Zero is moved to a register with `xorl` unless the flags are live, and
+     * the flags are forgotten after any instruction that may change them.
+     *
+     * \param[in] op The mnemonic
+     * \param[in] src The source operand, if any
+     * \param[in] dst The destination operand, if any
+     */
+    void emit(const std::string &op, const std::string &src = "",
+              const std::string &dst = "");
+
+    /*!
+     * \brief Emit the `cmpl` of a comparison fused into its user
+     *
+     * \param[in] compare The comparison
+     * \returns The condition that the flags hold, which is swapped if the
+     * operands were
+     */
+    llvm::CmpInst::Predicate emitCompare(const llvm::ICmpInst &compare);
+
+    /*!
+     * \brief Return the condition that answers a comparison from the flags
+     * as they are
+     *
+     * \param[in] lhs The compared value
+     * \param[in] rhs The value it is compared against
+     * \param[in] predicate The condition of the comparison
+     * \returns The condition to test the flags for, or nothing if the
+     * comparison has to be emitted
+     */
+    std::optional<llvm::CmpInst::Predicate>
+    reuseFlags(const llvm::Value *lhs, const llvm::Value *rhs,
+               llvm::CmpInst::Predicate predicate) const;
+
+    /*!
+     * \brief Emit the jumps at the end of the block
+     *
+     * Jumps to the block that comes next in the layout are left out. If the
+     * taken side of a conditional jump is the next block, the condition is
+     * inverted so that the other side is the one that jumps.
+     *
+     * \param[in] jump The conditional jump taken to reach `taken`, or empty
+     * if the branch is unconditional
+     * \param[in] inverse The jump with the opposite condition
+     * \param[in] taken The block reached when the condition holds
+     * \param[in] notTaken The block reached otherwise, or `nullptr`
+     */
+    void emitJumps(const std::string &jump, const std::string &inverse,
+                   const llvm::BasicBlock *taken,
+                   const llvm::BasicBlock *notTaken);
+
+    /*!
+     * \brief Return the copies needed on the edge into a block with phis
+     *
+     * \param[in] succ The block that this block jumps to
+     * \returns The slot of each phi and the value it receives, leaving out
+     * values that are already in the slot
+     */
+    std::vector<std::pair<std::string, std::string>>
+    phiCopies(const llvm::BasicBlock &succ) const;
+
+    /*!
+     * \brief Copy the incoming values of a block's phis into their slots
+     *
+     * The copies of all phis happen at once, so they are ordered by
+     * `sequentializeCopies`. A copy between two slots goes through a scratch
+     * register, and so does a value saved to break a cycle.
+     *
+     * \param[in] succ The block that this block jumps to
+     * \param[in] inst The branch that ends this block
+     */
+    void emitPhiCopies(const llvm::BasicBlock &succ,
+                       const llvm::Instruction &inst);
+
+    /*!
+     * \brief Return the assembly label of a basic block, or the symbol of a
+     * function or global
+     *
+     * \param[in] value The basic block, function or global
+     * \returns The label
+     */
+    std::string labelFor(const llvm::Value *value) const;
+
     //! The offset table containing a mapping of instructions to their
     //! memory offsets
     std::shared_ptr<OffsetTable> offsetTable;
@@ -135,6 +577,25 @@ class RegisterAllocator {
     //! A list of sorted intervals for each instruction
     std::shared_ptr<SortedIntervalList> sortedIntervals;
 
-    //! A map of basic blocks and their corresponding labels in assembly
+    //! A mapping of instructions to the way they can be rematerialized
+    std::shared_ptr<RematTable> rematTable;
+
+    //! A mapping of folded loads to the slot that their user reads
+    std::shared_ptr<FoldTable> foldTable;
+
+    //! A mapping of instructions to an operand whose register they can reuse
+    std::shared_ptr<HintTable> hintTable;
+
+    //! A mapping of instructions to the fixed registers they require
+    std::shared_ptr<ConstraintTable> constraintTable;
+
+    //! A map of basic blocks, functions and globals to their labels in
+    //! assembly
     std::shared_ptr<LabelTable> labelTable;
+
+    //! The numbers of the source files named in debug locations
+    std::shared_ptr<FileTable> fileTable;
+
+    //! The source file and line of the last `.loc` in the block
+    std::pair<unsigned, unsigned> lastLocation = {0, 0};
 };
@@ -0,0 +1,83 @@
+/*!
+ * \file flags.h
+ *
+ * \brief Command line flags that control code generation
+ *
+ * The program and the thin client parse the same flags. The client forwards
+ * them to the compile server with each request, which parses them again to
+ * compile the module the way the program would.
+ *
+ * This module intentionally has no dependency on LLVM so that the thin client
+ * starts as quickly as possible.
+ */
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#pragma once
+
+//! The code generation flags given on a command line
+struct CompileFlags {
+    //! `--stats`
+    bool stats = false;
+
+    //! Cleared by `--no-remat`
+    bool remat = true;
+
+    //! `--instrument`
+    bool instrument = false;
+
+    //! `--profile <file>`, or empty
+    std::string profilePath;
+
+    //! Cleared by `--no-schedule`
+    bool schedule = true;
+
+    //! `-fomit-frame-pointer`
+    bool omitFramePointer = false;
+
+    //! `--cmov-threshold <n>`, if it was given
+    std::optional<unsigned> ifConvertThreshold;
+
+    //! `-g`
+    bool debugLines = false;
+
+    //! Cleared by `--no-pipeline`
+    bool pipeline = true;
+
+    //! `--time-stages`
+    bool timeStages = false;
+};
+
+/*!
+ * \brief Parse an unsigned integer that must fit in an `unsigned`
+ *
+ * \param[in] text The decimal digits to parse
+ * \param[out] value The parsed value
+ * \returns Whether the whole text was a number in range
+ */
+bool parseUnsigned(const std::string &text, unsigned &value);
+
+/*!
+ * \brief Parse a code generation flag from a command line
+ *
+ * A flag that takes a value also consumes the argument after it. This will
+ * throw an exception if the value is invalid.
+ *
+ * \param[in] args The arguments of the command line
+ * \param[in,out] i The index of the argument to parse, which is left at the
+ * last argument that the flag consumed
+ * \param[in,out] flags The flags to update
+ * \returns Whether the argument was a code generation flag
+ */
+bool parseFlag(const std::vector<std::string> &args, size_t &i,
+               CompileFlags &flags);
+
+/*!
+ * \brief Write flags back out as the arguments that `parseFlag` reads
+ *
+ * \param[in] flags The flags to write
+ * \returns The arguments for every flag that isn't at its default
+ */
+std::vector<std::string> flagArguments(const CompileFlags &flags);
@@ -0,0 +1,107 @@
+/*!
+ * \file heap.h
+ *
+ * \brief Counting of heap allocations by phase of code generation
+ *
+ * When built with `COUNT_ALLOCATIONS`, the program replaces the global
+ * `operator new` and `operator delete` with versions that count every
+ * allocation against the phase that the allocating thread is in. Each block
+ * is prefixed with its size so that freeing it can be counted too. Without
+ * it, phases are still entered and left, but nothing is counted.
+ *
+ * Counts are kept per thread, so that the stages of the pipeline don't
+ * contend on them, and collected for a function by the thread that works on
+ * it.
+ */
+
+#include <array>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#pragma once
+
+//! The phases of code generation that allocations are counted against
+typedef enum {
+    //! Reading the module and preparing the IR of each function
+    heapLoad,
+    //! Building the tables that registers are allocated from
+    heapTables,
+    //! Allocating registers and selecting instructions
+    heapAllocation,
+    //! Assembling and writing out the generated code
+    heapEmission,
+    numHeapPhases,
+} HeapPhase;
+
+//! Whether this build counts allocations
+extern const bool countingAllocations;
+
+//! The allocations made in one phase
+struct HeapCounts {
+    //! The number of allocations
+    std::size_t allocations = 0;
+
+    //! The number of bytes allocated
+    std::size_t bytes = 0;
+
+    //! The most bytes that were allocated and not yet freed at once, since
+    //! the phase was entered
+    std::size_t peakBytes = 0;
+};
+
+//! The allocations made in each phase
+struct HeapProfile {
+    //! The counts, indexed by phase
+    std::array<HeapCounts, numHeapPhases> phases;
+
+    /*!
+     * \brief Add the counts of another function to these ones
+     *
+     * Allocations and bytes are summed, while the peak is the higher one.
+     *
+     * \param[in] other The counts to add
+     * \returns These counts
+     */
+    HeapProfile &operator+=(const HeapProfile &other);
+};
+
+//! Counts the allocations of the current thread against a phase while it is
+//! in scope
+class HeapPhaseScope {
+  public:
+    /*!
+     * \brief Enter a phase
+     *
+     * \param[in] phase The phase to count allocations against
+     */
+    explicit HeapPhaseScope(HeapPhase phase);
+
+    //! Go back to the phase that the thread was in before
+    ~HeapPhaseScope();
+
+  private:
+    //! The phase that the thread was in before
+    HeapPhase previous;
+
+    //! The live bytes that the previous phase measures its peak from
+    long long previousBase;
+};
+
+/*!
+ * \brief Return the allocations made by the current thread since the last
+ * call, and start counting from zero again
+ *
+ * \returns The counts
+ */
+HeapProfile takeHeapProfile();
+
+/*!
+ * \brief Print the allocations made in each phase
+ *
+ * \param[in] name The name of the function or module the counts are for
+ * \param[in] profile The counts
+ * \param[out] out The stream to write the counts to
+ */
+void printHeapProfile(const std::string &name, const HeapProfile &profile,
+                      std::ostream &out);
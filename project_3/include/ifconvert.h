@@ -0,0 +1,41 @@
+/*!
+ * \file ifconvert.h
+ *
+ * \brief If-conversion of small branches into conditional moves
+ *
+ * A block that branches on a comparison into one or two short arms, which
+ * then meet again, usually just picks one of two values for a stack
+ * variable. When the comparison depends on the data, the branch is hard to
+ * predict and each misprediction costs far more than the arms themselves.
+ *
+ * If-conversion runs both arms unconditionally and replaces the branch with
+ * one `select` per stack variable that the arms store to. The `select` is
+ * lowered to `cmpl` and a `cmov`, so the block no longer branches at all.
+ */
+
+#include <llvm/IR/Function.h>
+
+#pragma once
+
+//! The largest number of instructions that are if-converted by default
+extern const unsigned defaultIfConvertThreshold;
+
+/*!
+ * \brief Replace small branches in a function with selects
+ *
+ * Two shapes are converted: a diamond, where a block branches to two arms
+ * that both continue to the same block, and a triangle, where only one side
+ * of the branch has an arm. The arms may only do arithmetic that can't trap,
+ * load from stack variables and globals, and store to stack variables, and
+ * they may hold at most `threshold` instructions between them. The branch
+ * has to be on a comparison.
+ *
+ * After conversion the arms are removed and the block where they met is
+ * merged into the branching block. Nested shapes are converted from the
+ * inside out.
+ *
+ * \param[in,out] func The function to transform
+ * \param[in] threshold The largest number of instructions to speculate
+ * \returns The number of branches that were removed
+ */
+unsigned ifConvert(llvm::Function &func, unsigned threshold);
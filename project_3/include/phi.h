@@ -0,0 +1,83 @@
+/*!
+ * \file phi.h
+ *
+ * \brief Lowering phis out of SSA form
+ *
+ * Registers are only allocated within a block, so a value that flows between
+ * blocks lives in a home slot on the stack. A phi is given a home slot like
+ * any other such value, and each edge into its block copies the incoming
+ * value into that slot before jumping.
+ *
+ * The copies for the phis of a block happen at once, since a phi may read
+ * the old value of another phi of the same block. They are turned into a
+ * sequence of moves that only breaks a cycle with a temporary when it has to.
+ *
+ * Copies only work on edges whose source has no other successor, so edges
+ * from a conditional branch into a block with phis are split first. Most
+ * copies can be avoided altogether by giving a phi and its incoming values the
+ * same home slot, as long as they are never live at the same time.
+ */
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+
+#include "LLVMUtils.h"
+
+#pragma once
+
+/*!
+ * \brief Prepare the edges into blocks with phis for copies
+ *
+ * Phis of blocks with a single predecessor are replaced by their incoming
+ * value. Every other edge into a block with phis that starts at a block with
+ * more than one successor is split by a block that just jumps on.
+ *
+ * \param[in,out] func The function to transform
+ * \returns The number of edges that were split
+ */
+unsigned splitPhiEdges(llvm::Function &func);
+
+/*!
+ * \brief Give phis and their incoming values shared home slots
+ *
+ * A phi and an incoming value that is an instruction are merged into one
+ * class if no member of either class is live where a member of the other is
+ * defined. Phis of the same block are always live at the same time.
+ *
+ * \param[in] func The function to inspect
+ * \returns The value whose home slot each merged value shares
+ */
+std::shared_ptr<HomeTable> coalescePhis(const llvm::Function &func);
+
+/*!
+ * \brief Undo the splits of edges that turned out not to need copies
+ *
+ * A block that only jumps on is removed again when every incoming value that
+ * it passes on shares its home slot with the phi, so that the branch in
+ * front of it jumps straight to the phis.
+ *
+ * \param[in,out] func The function to transform
+ * \param[in] homes The home slots from `coalescePhis`
+ * \returns The number of blocks that were removed
+ */
+unsigned joinCoalescedEdges(llvm::Function &func, const HomeTable &homes);
+
+/*!
+ * \brief Order a parallel copy as a sequence of moves
+ *
+ * Every destination is written at most once. A move is only emitted once no
+ * other copy still needs the old value of its destination, and a cycle of
+ * copies is broken by saving one value in a temporary, so each copy costs one
+ * move and each cycle one more.
+ *
+ * \param[in] copies The destination and the source of each copy
+ * \param[in] temp A location that is neither a source nor a destination
+ * \returns The destination and the source of each move, in order
+ */
+std::vector<std::pair<std::string, std::string>> sequentializeCopies(
+    const std::vector<std::pair<std::string, std::string>> &copies,
+    const std::string &temp);
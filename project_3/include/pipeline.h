@@ -0,0 +1,145 @@
+/*!
+ * \file pipeline.h
+ *
+ * \brief Bounded queues and timing for the stages of code generation
+ *
+ * Functions go through three stages: their IR is materialized and
+ * transformed, their registers are allocated and their instructions
+ * selected, and the resulting assembly is written out. Each stage runs on a
+ * thread of its own and hands functions to the next one through a bounded
+ * queue, so that a slow stage holds back the ones before it instead of
+ * letting work pile up in memory.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#pragma once
+
+//! The number of functions that may wait between two stages
+extern const size_t pipelineDepth;
+
+/*!
+ * \brief A queue between two threads that holds a bounded number of items
+ *
+ * Either side may close the queue. Pushing to a closed queue fails, while the
+ * items that are already queued can still be popped.
+ */
+template <typename T> class BoundedQueue {
+  public:
+    /*!
+     * \brief Create an empty queue
+     *
+     * \param[in] capacity The number of items that fit in the queue
+     */
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    /*!
+     * \brief Add an item, blocking while the queue is full
+     *
+     * \param[in] item The item to add
+     * \returns Whether the item was added, which it isn't once the queue is
+     * closed
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard,
+                     [this] { return closed || items.size() < capacity; });
+
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        changed.notify_all();
+        return true;
+    }
+
+    /*!
+     * \brief Take the oldest item, blocking while the queue is empty
+     *
+     * \returns The item, or nothing once the queue is closed and empty
+     */
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return closed || !items.empty(); });
+
+        if (items.empty())
+            return std::nullopt;
+
+        auto item = std::move(items.front());
+        items.pop_front();
+        changed.notify_all();
+        return item;
+    }
+
+    //! Stop accepting items and wake up every thread waiting on the queue
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        changed.notify_all();
+    }
+
+  private:
+    //! The queued items, oldest first
+    std::deque<T> items;
+
+    //! The number of items that fit in the queue
+    size_t capacity;
+
+    //! Whether the queue accepts more items
+    bool closed = false;
+
+    //! Guards the items and whether the queue is closed
+    std::mutex lock;
+
+    //! Signalled when an item is added or removed, or the queue is closed
+    std::condition_variable changed;
+};
+
+//! The time that a stage spent working, as opposed to waiting on a queue
+struct StageTime {
+    //! The name of the stage
+    std::string name;
+
+    //! How long the stage was busy
+    std::chrono::steady_clock::duration busy{};
+};
+
+//! Adds the time until it goes out of scope to a stage's busy time
+class StageTimer {
+  public:
+    /*!
+     * \brief Start timing a piece of work
+     *
+     * \param[in,out] stage The stage that does the work
+     */
+    explicit StageTimer(StageTime &stage);
+
+    //! Stop timing and add the elapsed time to the stage
+    ~StageTimer();
+
+  private:
+    //! The stage that does the work
+    StageTime &stage;
+
+    //! When the work started
+    std::chrono::steady_clock::time_point start;
+};
+
+/*!
+ * \brief Print how busy each stage was over the run of the pipeline
+ *
+ * \param[in] stages The stages, in pipeline order
+ * \param[in] wall The time from the start of the first stage until the end
+ * of the last
+ * \param[out] out The stream to write the report to
+ */
+void printStageTimes(const std::vector<StageTime> &stages,
+                     std::chrono::steady_clock::duration wall,
+                     std::ostream &out);
@@ -0,0 +1,111 @@
+/*!
+ * \file profile.h
+ *
+ * \brief Block profiling and profile-guided block layout
+ *
+ * In instrumentation mode, every basic block increments its own counter when
+ * it runs, and the counters are written to a file when the program exits. A
+ * later run reads the file back and uses the block frequencies to lay out the
+ * blocks of each function, so that the hot path falls through.
+ *
+ * The profile file holds the magic bytes `RAPF`, the number of counters, and
+ * then one counter per block. All values are 32 bit little endian integers.
+ * Blocks are numbered in the order that they appear in the module, so a
+ * profile can only be used with the module that it was collected from.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+
+#pragma once
+
+//! A mapping from a basic block to its index in the profile
+typedef std::unordered_map<const llvm::BasicBlock *, unsigned> BlockIndexTable;
+
+//! A mapping from a basic block to the number of times it ran
+typedef std::unordered_map<const llvm::BasicBlock *, unsigned>
+    BlockFrequencyTable;
+
+//! The file that instrumented programs write their counters to
+extern const char *const defaultProfilePath;
+
+/*!
+ * \brief Number the basic blocks of a function
+ *
+ * Functions are numbered one after the other in module order, so the blocks
+ * of a function continue where the previous function's left off.
+ *
+ * \param[in] func The function to inspect
+ * \param[in] first The index of the function's first block
+ * \returns The index of each basic block in the profile
+ */
+std::shared_ptr<BlockIndexTable> numberBlocks(const llvm::Function &func,
+                                              unsigned first);
+
+/*!
+ * \brief Print the instruction that counts an execution of a block
+ *
+ * \param[in] index The block's index in the profile
+ * \param[out] out The stream to write the assembly to
+ */
+void printBlockCounter(unsigned index, std::ostream &out);
+
+/*!
+ * \brief Print the counters and the routine that writes them to a file
+ *
+ * The routine, `__regalloc_prof_dump`, is registered to run when the
+ * program exits. Programs that don't run the `.fini_array` handlers, such as
+ * ones that make the exit system call themselves, can call it directly.
+ *
+ * \param[in] numBlocks The number of counters
+ * \param[in] path The file to write the counters to
+ * \param[out] out The stream to write the assembly to
+ */
+void printProfileRuntime(unsigned numBlocks, const std::string &path,
+                         std::ostream &out);
+
+/*!
+ * \brief Read the counters collected by an instrumented program
+ *
+ * This will throw an exception if the file can't be read.
+ *
+ * \param[in] path The profile file
+ * \returns The number of times each block ran, by profile index
+ */
+std::vector<std::uint32_t> readProfile(const std::string &path);
+
+/*!
+ * \brief Look up the frequencies of a function's blocks in a profile
+ *
+ * This will throw an exception if the profile has fewer counters than the
+ * blocks need, in which case it wasn't collected from this module.
+ *
+ * \param[in] indices The profile index of each block
+ * \param[in] counters The counters from `readProfile`
+ * \returns The number of times each block ran
+ */
+std::shared_ptr<BlockFrequencyTable>
+blockFrequencies(const BlockIndexTable &indices,
+                 const std::vector<std::uint32_t> &counters);
+
+/*!
+ * \brief Order the basic blocks of a function for emission
+ *
+ * Without a profile the blocks keep their order in the IR. With a profile,
+ * blocks are chained greedily starting from the entry block: each block is
+ * followed by its hottest successor that hasn't been placed yet, so the hot
+ * path falls through. Blocks that never ran are placed last.
+ *
+ * \param[in] func The function to lay out
+ * \param[in] frequencies The block frequencies, or `nullptr`
+ * \returns The blocks in the order they should be emitted
+ */
+std::vector<const llvm::BasicBlock *>
+layoutBlocks(const llvm::Function &func,
+             const std::shared_ptr<BlockFrequencyTable> &frequencies);
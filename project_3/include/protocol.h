@@ -0,0 +1,123 @@
+/*!
+ * \file protocol.h
+ *
+ * \brief Wire protocol shared by the compile server and its client
+ *
+ * Requests and responses are sent over a Unix domain socket as length
+ * prefixed frames. A request frame holds the command line of the request,
+ * which is the code generation flags that `parseFlag` reads and the name of
+ * the input file, followed by the textual LLVM IR of the module. A response frame holds a one byte status,
+ * what code generation printed to `stderr`, such as `--stats`, and then
+ * either the generated assembly or an error message.
+ *
+ * The flags and the diagnostics are each prefixed by their length as a 32
+ * bit unsigned integer in network byte order, and the arguments are each
+ * terminated by a null byte.
+ *
+ * This module intentionally has no dependency on LLVM so that the thin client
+ * starts as quickly as possible.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma once
+
+//! The socket path used by the server and client if none is supplied
+extern const char *const defaultSocketPath;
+
+//! The status byte that prefixes each response payload
+typedef enum : std::uint8_t {
+    responseOk = 0,
+    responseError = 1,
+} ResponseStatus;
+
+/*!
+ * \brief Build the payload of a request frame
+ *
+ * \param[in] args The command line: the flags, as from `flagArguments`, and
+ * the name of the input file
+ * \param[in] ir The textual LLVM IR to compile
+ * \returns The payload
+ */
+std::string encodeRequest(const std::vector<std::string> &args,
+                          const std::string &ir);
+
+/*!
+ * \brief Split the payload of a request frame
+ *
+ * \param[in] payload The payload, as from `encodeRequest`
+ * \param[out] args The command line
+ * \param[out] ir The textual LLVM IR to compile
+ * \returns Whether the payload was well formed
+ */
+bool decodeRequest(const std::string &payload, std::vector<std::string> &args,
+                   std::string &ir);
+
+/*!
+ * \brief Build the payload of a response frame
+ *
+ * \param[in] status Whether the module was compiled
+ * \param[in] diagnostics What code generation printed to `stderr`
+ * \param[in] body The assembly, or the error message
+ * \returns The payload
+ */
+std::string encodeResponse(ResponseStatus status,
+                           const std::string &diagnostics,
+                           const std::string &body);
+
+/*!
+ * \brief Split the payload of a response frame
+ *
+ * \param[in] payload The payload, as from `encodeResponse`
+ * \param[out] status Whether the module was compiled
+ * \param[out] diagnostics What code generation printed to `stderr`
+ * \param[out] body The assembly, or the error message
+ * \returns Whether the payload was well formed
+ */
+bool decodeResponse(const std::string &payload, ResponseStatus &status,
+                    std::string &diagnostics, std::string &body);
+
+/*!
+ * \brief Write a length prefixed frame to a socket
+ *
+ * The length is sent as a 32 bit unsigned integer in network byte order,
+ * followed by the payload.
+ *
+ * \param[in] fd The socket to write to
+ * \param[in] payload The bytes to send
+ * \returns Whether the whole frame was written
+ */
+bool sendFrame(int fd, const std::string &payload);
+
+/*!
+ * \brief Read a length prefixed frame from a socket
+ *
+ * \param[in] fd The socket to read from
+ * \param[out] payload The bytes that were received
+ * \returns Whether a whole frame was read. This is false if the peer closed
+ * the connection or the frame is malformed.
+ */
+bool recvFrame(int fd, std::string &payload);
+
+/*!
+ * \brief Open a socket and bind it to a path to listen for connections
+ *
+ * Any stale socket file at the path is removed first. This will throw an
+ * exception if the socket cannot be created.
+ *
+ * \param[in] path The filesystem path for the socket
+ * \returns The listening socket's file descriptor
+ */
+int listenSocket(const std::string &path);
+
+/*!
+ * \brief Connect to a listening Unix domain socket
+ *
+ * This will throw an exception if the connection fails.
+ *
+ * \param[in] path The filesystem path of the socket
+ * \returns The connected socket's file descriptor
+ */
+int connectSocket(const std::string &path);
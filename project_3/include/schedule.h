@@ -0,0 +1,50 @@
+/*!
+ * \file schedule.h
+ *
+ * \brief Instruction scheduling within a basic block
+ *
+ * Code is generated in IR order, so the result of a multiplication or a load
+ * is usually consumed by the very next instruction. The list scheduler
+ * reorders the instructions of a block before registers are allocated, so
+ * that independent work fills the time until a slow result is ready.
+ *
+ * Moving a definition away from its uses lengthens its live range, and with
+ * only four registers that quickly leads to spills. The scheduler therefore
+ * tracks how many values are live as it goes, and keeps the original order
+ * of a block if its schedule would need more registers than the original.
+ */
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instruction.h>
+
+#pragma once
+
+/*!
+ * \brief Return the estimated latency of an instruction
+ *
+ * Register arithmetic takes 1 cycle, multiplication 3 cycles and a load
+ * from memory 4 cycles.
+ *
+ * \param[in] inst The instruction
+ * \returns The number of cycles until its result can be used
+ */
+unsigned latency(const llvm::Instruction &inst);
+
+/*!
+ * \brief Reorder the instructions of a basic block to hide latency
+ *
+ * A dependence graph is built from the operands of each instruction and from
+ * the stack slots and globals that loads and stores access. Instructions
+ * other than arithmetic, comparisons, selects, loads and stores keep their
+ * place relative to everything else. The terminator, and a comparison fused
+ * into it, stay at the end of the block.
+ *
+ * Instructions are issued one per cycle, preferring the ready instruction
+ * with the longest path to the end of the block. Once every register is
+ * occupied, instructions that free registers are preferred instead.
+ *
+ * \param[in,out] bb The basic block to reorder
+ * \param[in] numRegisters The number of registers available to values
+ * \returns The number of instructions that changed position
+ */
+unsigned scheduleBlock(llvm::BasicBlock &bb, unsigned numRegisters);
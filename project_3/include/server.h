@@ -0,0 +1,102 @@
+/*!
+ * \file server.h
+ *
+ * \brief A persistent compile server for the register allocator
+ *
+ * Starting the program and initializing LLVM dominates the run time for small
+ * modules. The server keeps a single warm process alive and compiles modules
+ * sent to it over a Unix domain socket, using the framing described in
+ * `protocol.h`.
+ */
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+
+#pragma once
+
+//! An LLVM context along with the number of requests it has served
+struct PooledContext {
+    //! The context that modules are parsed into
+    std::unique_ptr<llvm::LLVMContext> context;
+
+    //! How many modules have been compiled in the context
+    unsigned uses;
+};
+
+/*!
+ * \brief A pool of reusable LLVM contexts
+ *
+ * An LLVM context may only be used by one thread at a time, and creating one
+ * is not free, so each request borrows a context from the pool for the
+ * duration of the compilation and returns it afterwards. Contexts keep
+ * uniqued types and constants alive after a module is destroyed, so a context
+ * is replaced with a fresh one after it has served a number of requests.
+ */
+class ContextPool {
+  public:
+    /*!
+     * \brief Create a pool with a fixed number of contexts
+     *
+     * \param[in] size The number of contexts, which bounds the number of
+     * modules that are compiled concurrently
+     */
+    explicit ContextPool(unsigned size);
+
+    /*!
+     * \brief Borrow a context, blocking until one is available
+     *
+     * \returns A context that must be handed back with `release`
+     */
+    PooledContext acquire();
+
+    /*!
+     * \brief Return a borrowed context to the pool
+     *
+     * \param[in] pooled The context that was returned from `acquire`
+     */
+    void release(PooledContext pooled);
+
+  private:
+    //! Contexts that are not currently borrowed
+    std::vector<PooledContext> available;
+
+    //! Guards the available contexts
+    std::mutex lock;
+
+    //! Signalled when a context is released
+    std::condition_variable released;
+};
+
+/*!
+ * \brief Compile a module held in memory
+ *
+ * This is the unit of work performed by the server for each request. The
+ * module is compiled as the program would with the same command line, except
+ * that functions are never pipelined. This will throw an exception if an
+ * argument is invalid or the module can't be compiled.
+ *
+ * \param[in] ir The textual LLVM IR of the module
+ * \param[in] args The command line of the request: the code generation
+ * flags and the name of the input file
+ * \param[in] context The context to parse the module into
+ * \param[out] err The stream to write statistics and stage times to
+ * \returns The generated assembly
+ */
+std::string compileModule(const std::string &ir,
+                          const std::vector<std::string> &args,
+                          llvm::LLVMContext &context, std::ostream &err);
+
+/*!
+ * \brief Run the compile server until the process is killed
+ *
+ * \param[in] socketPath The filesystem path to listen on
+ * \param[in] poolSize The number of LLVM contexts to keep warm
+ * \returns The exit code for the program
+ */
+int runServer(const std::string &socketPath, unsigned poolSize);
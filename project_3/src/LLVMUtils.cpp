@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <unordered_map>
+#include <vector>
 
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IRReader/IRReader.h>
@@ -15,10 +20,71 @@
 
 #include "LLVMUtils.h"
 
+/*!
+ * \brief Return the constant a value folds to, if any
+ *
+ * \param[in] value The value to inspect
+ * \param[in] remats The rematerializable values found so far
+ * \returns The folded constant, or nothing if the value isn't constant
+ */
+static std::optional<int> foldedConstant(const llvm::Value *value,
+                                         const RematTable &remats) {
+    if (const auto constant = llvm::dyn_cast<llvm::ConstantInt>(value))
+        return static_cast<int>(constant->getSExtValue());
+
+    if (const auto inst = llvm::dyn_cast<llvm::Instruction>(value)) {
+        auto remat = remats.find(inst);
+
+        if (remat != remats.end() && remat->second.kind == rematConstant)
+            return remat->second.immediate;
+    }
+    return std::nullopt;
+}
+
+/*!
+ * \brief Return whether an instruction may write to a stack slot
+ *
+ * Stores to a different `alloca` can't alias the slot. Any other write to
+ * memory is assumed to clobber it.
+ */
+static bool mayWriteSlot(const llvm::Instruction &inst,
+                         const llvm::AllocaInst *slot) {
+    if (!inst.mayWriteToMemory())
+        return false;
+
+    if (const auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        auto ptr = store->getPointerOperand();
+        return ptr == slot || !llvm::isa<llvm::AllocaInst>(ptr);
+    }
+    return true;
+}
+
+/*!
+ * \brief Return whether a stack slot may change while a loaded value is live
+ *
+ * \param[in] load The instruction that loaded the value from the slot
+ * \param[in] slot The stack slot
+ * \param[in] lastUse The index of the value's last use
+ * \param[in] indexTable The populated index table of the block
+ * \returns Whether anything up to the last use may write to the slot
+ */
+static bool isSlotClobbered(const llvm::LoadInst &load,
+                            const llvm::AllocaInst *slot, int lastUse,
+                            const IndexTable &indexTable) {
+    auto end = load.getParent()->end();
+
+    for (auto it = std::next(load.getIterator());
+         it != end && static_cast<int>(indexTable.at(&*it)) <= lastUse; it++) {
+        if (mayWriteSlot(*it, slot))
+            return true;
+    }
+    return false;
+}
+
 std::unique_ptr<llvm::Module> loadModule(const std::string &filename,
                                          llvm::LLVMContext &context) {
     llvm::SMDiagnostic diag;
-    auto module = llvm::parseIRFile(filename, diag, context);
+    auto module = llvm::getLazyIRFileModule(filename, diag, context);
 
     if (module == nullptr) {
         throw std::runtime_error("Could not parse IR file!");
@@ -26,7 +92,22 @@ std::unique_ptr<llvm::Module> loadModule(const std::string &filename,
     return module;
 }
 
-std::shared_ptr<OffsetTable> genOffsetTable(const llvm::Function &func) {
+std::unique_ptr<llvm::Module> parseModule(const std::string &ir,
+                                          llvm::LLVMContext &context,
+                                          const std::string &name) {
+    llvm::SMDiagnostic diag;
+    auto buffer = llvm::MemoryBufferRef(ir, name);
+    auto module = llvm::parseIR(buffer, diag, context);
+
+    if (module == nullptr) {
+        throw std::runtime_error("Could not parse IR: " +
+                                 diag.getMessage().str());
+    }
+    return module;
+}
+
+std::shared_ptr<OffsetTable> genOffsetTable(const llvm::Function &func,
+                                            const HomeTable &homes) {
     auto table = std::make_shared<OffsetTable>();
     int offset = -4;
 
@@ -39,9 +120,71 @@ std::shared_ptr<OffsetTable> genOffsetTable(const llvm::Function &func) {
             offset -= 4;
         }
     }
+
+    // values that cross basic blocks live in memory between blocks
+    for (const auto &bb : func) {
+        for (const auto &inst : bb) {
+            if (llvm::isa<llvm::AllocaInst>(inst) ||
+                (!isLiveOut(inst) && !llvm::isa<llvm::PHINode>(inst)))
+                continue;
+
+            auto home = homes.find(&inst);
+            auto leader = home != homes.end() ? home->second : &inst;
+            auto slot = table->find(leader);
+
+            if (slot == table->end())
+                table->insert(
+                    std::make_pair(&inst, allocateSlot(*table, leader)));
+            else
+                table->insert(std::make_pair(&inst, slot->second));
+        }
+    }
     return table;
 }
 
+int allocateSlot(OffsetTable &table, const llvm::Instruction *inst) {
+    int offset = -frameSize(table) - 4;
+    table.insert(std::make_pair(inst, offset));
+    return offset;
+}
+
+int frameSize(const OffsetTable &table) {
+    int lowest = 0;
+
+    for (const auto &entry : table) {
+        lowest = std::min(lowest, entry.second);
+    }
+    return -lowest;
+}
+
+bool isLiveOut(const llvm::Instruction &inst) {
+    for (const auto user : inst.users()) {
+        const auto userInst = llvm::dyn_cast<llvm::Instruction>(user);
+
+        // a phi reads its incoming value on the edge, after the block ends
+        if (userInst != nullptr &&
+            (userInst->getParent() != inst.getParent() ||
+             llvm::isa<llvm::PHINode>(userInst)))
+            return true;
+    }
+    return false;
+}
+
+bool isFusedCompare(const llvm::Instruction &inst) {
+    if (!llvm::isa<llvm::ICmpInst>(inst) || !inst.hasOneUse())
+        return false;
+
+    const auto user = inst.user_back();
+
+    if (const auto select = llvm::dyn_cast<llvm::SelectInst>(user)) {
+        return select->getCondition() == &inst &&
+               select->getParent() == inst.getParent();
+    }
+
+    const auto branch = llvm::dyn_cast<llvm::BranchInst>(user);
+    return branch != nullptr && branch->getParent() == inst.getParent();
+}
+
 std::shared_ptr<IndexTable> genIndexTable(const llvm::BasicBlock &bb) {
     auto table = std::make_shared<IndexTable>();
 
@@ -63,51 +206,45 @@ std::shared_ptr<IndexTable> genIndexTable(const llvm::BasicBlock &bb) {
 void tableInit(const llvm::BasicBlock &bb,
                const std::shared_ptr<IndexTable> &indexTable,
                const std::shared_ptr<IntervalTable> &intervalTable,
-               const std::shared_ptr<RegisterTable> &registers) {
-    const auto &instList = bb.getInstList();
+               const std::shared_ptr<RegisterTable> &registers,
+               const RegisterSet &allocatable) {
+    for (const auto &inst : bb) {
+        // allocas and phis live in memory, void instructions don't produce a
+        // value, and fused comparisons are emitted along with their user
+        if (inst.getType()->isVoidTy() || llvm::isa<llvm::AllocaInst>(inst) ||
+            llvm::isa<llvm::PHINode>(inst) || isFusedCompare(inst))
+            continue;
 
-    // iterate backwards through each instruction in the basic block
-    for (auto it = instList.rbegin(); it != instList.rend(); it++) {
-        auto &inst = *it;
+        // This will throw an error if the instructions aren't in the index
+        // table, but that would be a logic error so that means the
+        // indexTable isn't being constructed properly
+        int start = indexTable->at(&inst);
+        int end = start;
+
+        // the value is live until its last user in this basic block
+        for (const auto user : inst.users()) {
+            auto userInst = llvm::dyn_cast<llvm::Instruction>(user);
 
-        // check each operand:
-        // if the operand is non-memory and non-constant, check if it already
-        // exists in the interval table
-        for (auto user : inst.users()) {
-            // ignore constant or memory (alloca instruction)
-            if (llvm::isa<llvm::Constant>(user) ||
-                llvm::isa<llvm::AllocaInst>(user))
+            if (userInst == nullptr || userInst->getParent() != &bb)
                 continue;
-            if (const auto opInst = llvm::dyn_cast<llvm::Instruction>(user)) {
-                // check if the operand already exists in the liveliness table
-                auto searchIt = intervalTable->find(opInst);
 
-                // if it already exists, move on to the next operand
-                if (searchIt != intervalTable->end()) {
-                    continue;
-                }
+            // the operands of a fused comparison are read by its branch or
+            // select
+            if (isFusedCompare(*userInst))
+                userInst = llvm::cast<llvm::Instruction>(userInst->user_back());
 
-                // insert the interval into the interval table
-                // This will throw an error if the instructions aren't in the
-                // index table, but that would be a logic error so that means
-                // the indexTable isn't being constructed properly
-                // auto interval =
-                // std::make_pair(indexTable->find(opInst)->second,
-                // indexTable->find(&inst)->second);
-                auto interval =
-                    std::make_pair(indexTable->find(&inst)->second,
-                                   indexTable->find(opInst)->second);
-                intervalTable->insert(std::make_pair(opInst, interval));
-
-                // insert all of the physical registers for this operand
-                auto s = RegisterSet();
-                s.insert(eax);
-                s.insert(ebx);
-                s.insert(ecx);
-                s.insert(edx);
-                registers->insert(std::make_pair(opInst, s));
-            }
+            end = std::max(end, static_cast<int>(indexTable->at(userInst)));
         }
+        intervalTable->insert(
+            std::make_pair(&inst, std::make_tuple(start, end)));
+
+        // insert all of the physical registers for this operand, unless the
+        // value lives in memory because it's used in other blocks
+        auto s = RegisterSet();
+
+        if (!isLiveOut(inst))
+            s = allocatable;
+        registers->insert(std::make_pair(&inst, s));
     }
 }
 
@@ -120,7 +257,9 @@ sortIntervalMap(const std::shared_ptr<IntervalTable> &table) {
         sortedMap->push_back(std::make_pair(it.first, it.second));
     }
 
-    // sort the vector, using the length of the interval
+    // sort the vector, using the length of the interval. Intervals of the
+    // same length are kept in block order, which their starts give since each
+    // starts at its own instruction, rather than in the order of the table.
     std::sort(sortedMap->begin(), sortedMap->end(),
               [=](const auto &a, const auto &b) -> bool {
                   auto aTuple = a.second;
@@ -130,40 +269,297 @@ sortIntervalMap(const std::shared_ptr<IntervalTable> &table) {
 
                   // returning a > b will sort the vector in descending order
                   // since the default is a < b
-                  return std::abs(aLength) > std::abs(bLength);
+                  if (std::abs(aLength) != std::abs(bLength))
+                      return std::abs(aLength) > std::abs(bLength);
+                  return std::get<0>(aTuple) < std::get<0>(bTuple);
               });
     return sortedMap;
 }
 
+std::shared_ptr<RematTable>
+genRematTable(const llvm::BasicBlock &bb,
+              const std::shared_ptr<IndexTable> &indexTable,
+              const std::shared_ptr<IntervalTable> &intervalTable) {
+    auto table = std::make_shared<RematTable>();
+
+    for (const auto &inst : bb) {
+        auto interval = intervalTable->find(&inst);
+
+        // only values that live entirely within this block are candidates
+        if (interval == intervalTable->end() || isLiveOut(inst))
+            continue;
+
+        if (isArithmeticInst(inst)) {
+            auto a = foldedConstant(inst.getOperand(0), *table);
+            auto b = foldedConstant(inst.getOperand(1), *table);
+
+            if (!a.has_value() || !b.has_value())
+                continue;
+
+            // fold with 32 bit wrapping arithmetic
+            auto x = static_cast<std::uint32_t>(a.value());
+            auto y = static_cast<std::uint32_t>(b.value());
+            std::uint32_t folded = 0;
+
+            switch (inst.getOpcode()) {
+            case llvm::Instruction::Add:
+                folded = x + y;
+                break;
+            case llvm::Instruction::Sub:
+                folded = x - y;
+                break;
+            default:
+                folded = x * y;
+                break;
+            }
+            table->insert(std::make_pair(
+                &inst,
+                Remat{rematConstant, static_cast<int>(folded), nullptr}));
+        } else if (const auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+            auto slot =
+                llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand());
+
+            if (slot == nullptr)
+                continue;
+
+            // the slot can't be written to before the value's last use,
+            // otherwise reading it again would produce a different value
+            int lastUse = std::get<1>(interval->second);
+
+            if (!isSlotClobbered(*load, slot, lastUse, *indexTable))
+                table->insert(
+                    std::make_pair(&inst, Remat{rematReload, 0, slot}));
+        }
+    }
+    return table;
+}
+
+std::shared_ptr<FoldTable>
+genFoldTable(const llvm::BasicBlock &bb,
+             const std::shared_ptr<IndexTable> &indexTable,
+             const std::shared_ptr<IntervalTable> &intervalTable) {
+    auto table = std::make_shared<FoldTable>();
+
+    for (const auto &inst : bb) {
+        const auto load = llvm::dyn_cast<llvm::LoadInst>(&inst);
+
+        if (load == nullptr || !load->hasOneUse() || isLiveOut(inst))
+            continue;
+
+        auto slot = llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand());
+        auto user = llvm::cast<llvm::Instruction>(load->user_back());
+
+        // only arithmetic, comparisons and the divisor of a division can be
+        // a memory operand in place of a register
+        bool isDivisor =
+            isDivisionInst(*user) && user->getOperand(1) == &inst;
+
+        if (slot == nullptr ||
+            !(isArithmeticInst(*user) || isFusedCompare(*user) || isDivisor))
+            continue;
+
+        // the use of a fused comparison is at its branch or select, which is
+        // already accounted for by the interval
+        int lastUse = std::get<1>(intervalTable->at(&inst));
+
+        if (!isSlotClobbered(*load, slot, lastUse, *indexTable))
+            table->insert(std::make_pair(&inst, slot));
+    }
+    return table;
+}
+
+std::shared_ptr<HintTable>
+genHintTable(const llvm::BasicBlock &bb,
+             const std::shared_ptr<IndexTable> &indexTable,
+             const std::shared_ptr<IntervalTable> &intervalTable) {
+    auto table = std::make_shared<HintTable>();
+
+    for (const auto &inst : bb) {
+        if (!(isArithmeticInst(inst) || isDivisionInst(inst)) ||
+            intervalTable->count(&inst) == 0)
+            continue;
+
+        int index = indexTable->at(&inst);
+
+        // an operand dies here if its interval ends at this instruction
+        auto dyingOperand =
+            [&](const llvm::Value *operand) -> const llvm::Instruction * {
+            auto opInst = llvm::dyn_cast<llvm::Instruction>(operand);
+
+            if (opInst == nullptr)
+                return nullptr;
+
+            auto interval = intervalTable->find(opInst);
+
+            if (interval == intervalTable->end() ||
+                std::get<1>(interval->second) != index)
+                return nullptr;
+            return opInst;
+        };
+
+        auto hint = dyingOperand(inst.getOperand(0));
+
+        if (hint == nullptr && inst.isCommutative())
+            hint = dyingOperand(inst.getOperand(1));
+
+        if (hint != nullptr)
+            table->insert(std::make_pair(&inst, hint));
+    }
+    return table;
+}
+
+/*!
+ * \brief Return whether two values are hinted to share a register
+ *
+ * \param[in] a The first value
+ * \param[in] b The second value
+ * \param[in] hints The coalescing hints for the block
+ * \returns Whether either value is the hinted operand of the other
+ */
+static bool isHintPair(const llvm::Instruction *a, const llvm::Instruction *b,
+                       const HintTable &hints) {
+    auto hint = hints.find(a);
+
+    if (hint != hints.end() && hint->second == b)
+        return true;
+
+    hint = hints.find(b);
+    return hint != hints.end() && hint->second == a;
+}
+
+std::shared_ptr<ConstraintTable>
+genConstraintTable(const llvm::BasicBlock &bb) {
+    auto table = std::make_shared<ConstraintTable>();
+
+    for (const auto &inst : bb) {
+        RegisterConstraint constraint;
+
+        if (isDivisionInst(inst)) {
+            // the dividend is moved to `%eax` and extended into `%edx` before
+            // the divisor is read
+            auto op = inst.getOpcode();
+            bool remainder =
+                op == llvm::Instruction::SRem || op == llvm::Instruction::URem;
+
+            constraint.def = remainder ? edx : eax;
+            constraint.uses.push_back(std::make_pair(0, eax));
+            constraint.earlyClobbers = {eax, edx};
+        } else if (llvm::isa<llvm::CallInst>(inst) &&
+                   !llvm::isa<llvm::IntrinsicInst>(inst)) {
+            // arguments are passed on the stack, and the caller-saved
+            // registers are lost
+            constraint.def = eax;
+            constraint.clobbers = {eax, ecx, edx};
+        } else if (llvm::isa<llvm::ReturnInst>(inst) &&
+                   inst.getNumOperands() > 0) {
+            constraint.uses.push_back(std::make_pair(0, eax));
+        } else {
+            continue;
+        }
+        table->insert(std::make_pair(&inst, constraint));
+    }
+    return table;
+}
+
+void applyClobbers(const std::shared_ptr<IndexTable> &indexTable,
+                   const std::shared_ptr<IntervalTable> &intervalTable,
+                   const std::shared_ptr<ConstraintTable> &constraints,
+                   const std::shared_ptr<RegisterTable> &registers) {
+    for (const auto &entry : *constraints) {
+        const auto inst = entry.first;
+        const auto &constraint = entry.second;
+        int index = indexTable->at(inst);
+
+        // whether an operand is read from a given register
+        auto isFixedUse = [&](const llvm::Instruction *value,
+                              PhysicalRegister reg) {
+            for (const auto &use : constraint.uses) {
+                if (use.second == reg && inst->getOperand(use.first) == value)
+                    return true;
+            }
+            return false;
+        };
+
+        for (const auto &interval : *intervalTable) {
+            int start = std::get<0>(interval.second);
+            int end = std::get<1>(interval.second);
+
+            // only values that are live going into the instruction matter;
+            // the result is written after everything else
+            if (start >= index || end < index)
+                continue;
+
+            auto &available = registers->at(interval.first);
+
+            for (auto reg : constraint.clobbers) {
+                if (end > index)
+                    available.erase(reg);
+            }
+            for (auto reg : constraint.earlyClobbers) {
+                if (end > index || !isFixedUse(interval.first, reg))
+                    available.erase(reg);
+            }
+        }
+    }
+}
+
 std::shared_ptr<ResultTable>
 genResultTable(const llvm::BasicBlock &bb,
                std::shared_ptr<RegisterTable> &registers,
-               std::shared_ptr<SortedIntervalList> &liveness) {
+               std::shared_ptr<SortedIntervalList> &liveness,
+               const std::shared_ptr<RematTable> &remats,
+               const std::shared_ptr<HintTable> &hints,
+               const std::shared_ptr<ConstraintTable> &constraints) {
     // initialize the empty result table
     auto results = std::make_shared<ResultTable>();
 
-    // If the terminator instruction is a return instruction, take `%eax`
-    if (const auto &returnInst =
-            llvm::dyn_cast<llvm::ReturnInst>(bb.getTerminator())) {
-        const auto &operand = returnInst->getOperand(0);
-        auto operandInst = static_cast<llvm::Instruction *>(operand);
+    // Precolor the values that are read from or written to a fixed register,
+    // in block order. A value only gets its fixed register if no value that
+    // overlaps it has taken the register already, otherwise it's moved there
+    // when the instruction is generated.
+    std::vector<std::pair<const llvm::Instruction *, PhysicalRegister>> fixed;
 
-        if (operandInst != nullptr) {
-            results->insert(std::make_pair(operandInst, eax));
+    for (const auto &inst : bb) {
+        auto constraint = constraints->find(&inst);
+
+        if (constraint == constraints->end())
+            continue;
 
-            // find every operand that overlaps with the current interval
-            // table and remove `eax` from their list of available registers
-            auto overlappingOps = getOverlappingOps(operandInst, liveness);
+        if (constraint->second.def != nullRegister)
+            fixed.push_back(std::make_pair(&inst, constraint->second.def));
 
-            for (const auto overlappingInst : *overlappingOps) {
-                auto foundInst = registers->find(overlappingInst);
+        for (const auto &use : constraint->second.uses) {
+            auto operandInst =
+                llvm::dyn_cast<llvm::Instruction>(inst.getOperand(use.first));
 
-                // skip if we can't find the instruction in the register table
-                if (foundInst == registers->end()) {
-                    continue;
-                }
-                foundInst->second.erase(eax);
+            if (operandInst != nullptr)
+                fixed.push_back(std::make_pair(operandInst, use.second));
+        }
+    }
+
+    for (const auto &request : fixed) {
+        auto registerEntry = registers->find(request.first);
+
+        // the value has to be computed in this block for it to be assigned
+        // a register here
+        if (registerEntry == registers->end() ||
+            registerEntry->second.count(request.second) == 0 ||
+            results->find(request.first) != results->end())
+            continue;
+
+        results->insert(request);
+
+        // remove the register from every value that overlaps this one
+        auto overlappingOps = getOverlappingOps(request.first, liveness, hints);
+
+        for (const auto overlappingInst : *overlappingOps) {
+            auto foundInst = registers->find(overlappingInst);
+
+            // skip if we can't find the instruction in the register table
+            if (foundInst == registers->end()) {
+                continue;
             }
+            foundInst->second.erase(request.second);
         }
     }
 
@@ -183,10 +579,19 @@ genResultTable(const llvm::BasicBlock &bb,
     // Because the liveness entries are sorted in descending order from longest
     // to shortest, this ends up giving precedence to the longer intervals,
     // which also maintains the invariant stated in the instructions.
-    for (auto &entry : *liveness) {
+    //
+    // Rematerializable values are cheap to evict, so the values that would
+    // have to be spilled get the first pick of the registers, and the
+    // rematerializable values are assigned in a second pass.
+    auto order = *liveness;
+    std::stable_partition(order.begin(), order.end(), [&](const auto &entry) {
+        return remats->find(entry.first) == remats->end();
+    });
+
+    for (auto &entry : order) {
         // Check to see if the instruction is already in the results table. If
         // so, move on to the next one.
-        if (results->find(entry.first) == results->end())
+        if (results->find(entry.first) != results->end())
             continue;
 
         auto registerEntry = registers->find(entry.first);
@@ -203,12 +608,53 @@ genResultTable(const llvm::BasicBlock &bb,
             continue;
         }
 
-        // pick some register to use
+        // pick some register to use, preferring the register of a value that
+        // this one is hinted to share a register with, and otherwise one
+        // that doesn't have to be saved in the prologue
         auto selectedRegister = *registerSet.begin();
+
+        for (auto reg : registerSet) {
+            if (!isCalleeSaved(reg)) {
+                selectedRegister = reg;
+                break;
+            }
+        }
+
+        // the register of a value that was already assigned one that this
+        // value can take, or `nullRegister`
+        auto partnerRegister = [&](const llvm::Instruction *partner) {
+            auto result = results->find(partner);
+
+            if (result == results->end() || result->second == nullRegister ||
+                registerSet.count(result->second) == 0)
+                return nullRegister;
+            return result->second;
+        };
+
+        // The operand whose register this value would take over comes first,
+        // then the users that would take over this value's register, in
+        // block order, so that the choice doesn't depend on the order of the
+        // result table.
+        auto hint = hints->find(entry.first);
+        auto hinted = hint != hints->end() ? partnerRegister(hint->second)
+                                           : nullRegister;
+
+        for (const auto &inst : bb) {
+            if (hinted != nullRegister)
+                break;
+
+            auto userHint = hints->find(&inst);
+
+            if (userHint != hints->end() && userHint->second == entry.first)
+                hinted = partnerRegister(&inst);
+        }
+
+        if (hinted != nullRegister)
+            selectedRegister = hinted;
         results->insert(std::make_pair(entry.first, selectedRegister));
 
         // get overlapping instructions
-        auto overlaps = getOverlappingOps(entry.first, liveness);
+        auto overlaps = getOverlappingOps(entry.first, liveness, hints);
 
         // remove the selected register from the available registers for
         // each overlapping instruction
@@ -228,7 +674,8 @@ genResultTable(const llvm::BasicBlock &bb,
 
 std::unique_ptr<std::vector<const llvm::Instruction *>>
 getOverlappingOps(const llvm::Instruction *inst,
-                  const std::shared_ptr<SortedIntervalList> &intervals) {
+                  const std::shared_ptr<SortedIntervalList> &intervals,
+                  const std::shared_ptr<HintTable> &hints) {
     // find interval for given instruction
     std::tuple<int, int> targetInterval;
     auto overlapping =
@@ -244,15 +691,14 @@ getOverlappingOps(const llvm::Instruction *inst,
     // iterate through the intervals, checking to see if the targetInterval
     // is overlapped by the intervals
     for (const auto &intervalEntry : *intervals) {
-        if (intervalEntry.first == inst)
+        if (intervalEntry.first == inst ||
+            isHintPair(inst, intervalEntry.first, *hints))
             continue;
 
         const auto otherInterval = intervalEntry.second;
 
-        if ((std::get<0>(targetInterval) <= std::get<0>(otherInterval) &&
-             std::get<0>(otherInterval) <= std::get<1>(targetInterval)) ||
-            (std::get<0>(targetInterval) <= std::get<1>(otherInterval) &&
-             std::get<1>(otherInterval) <= std::get<1>(targetInterval))) {
+        if (std::get<0>(targetInterval) <= std::get<1>(otherInterval) &&
+            std::get<0>(otherInterval) <= std::get<1>(targetInterval)) {
             overlapping->push_back(intervalEntry.first);
         }
     }
@@ -268,6 +714,12 @@ bool isArithmeticInst(const llvm::Instruction &inst) {
            op == llvm::Instruction::Mul;
 }
 
+bool isDivisionInst(const llvm::Instruction &inst) {
+    auto op = inst.getOpcode();
+    return op == llvm::Instruction::SDiv || op == llvm::Instruction::UDiv ||
+           op == llvm::Instruction::SRem || op == llvm::Instruction::URem;
+}
+
 std::string registerString(PhysicalRegister reg) {
     switch (reg) {
     case eax:
@@ -278,11 +730,15 @@ std::string registerString(PhysicalRegister reg) {
         return "ecx";
     case edx:
         return "edx";
+    case ebp:
+        return "ebp";
     default:
         return "";
     }
 }
 
+bool isCalleeSaved(PhysicalRegister reg) { return reg == ebx || reg == ebp; }
+
 void loadDedup(llvm::BasicBlock &bb) {
     std::vector<llvm::Value *> toDelete;
 
@@ -0,0 +1,210 @@
+/*
+ * A thin client for the RegAlloc compile server. It does not link against
+ * LLVM, so it starts quickly, and it behaves like the regular command line
+ * program: given an IR file and the same flags, it prints the generated
+ * assembly to stdout, and the statistics that the flags ask for to stderr.
+ *
+ * It can also act as a load generator to measure the server's throughput and
+ * latency.
+ */
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "flags.h"
+#include "protocol.h"
+
+/*!
+ * \brief Send one request and wait for its response
+ *
+ * \param[in] fd A socket connected to the server
+ * \param[in] request The request, as from `encodeRequest`
+ * \param[out] diagnostics What code generation printed to `stderr`
+ * \param[out] payload The assembly or error message from the server
+ * \returns Whether the server compiled the module successfully
+ */
+static bool request(int fd, const std::string &request,
+                    std::string &diagnostics, std::string &payload) {
+    std::string response;
+    ResponseStatus status;
+
+    if (!sendFrame(fd, request) || !recvFrame(fd, response) ||
+        !decodeResponse(response, status, diagnostics, payload))
+        throw std::runtime_error("Lost connection to the server");
+    return status == responseOk;
+}
+
+/*!
+ * \brief Drive the server with concurrent requests and report statistics
+ *
+ * Every client thread keeps its own connection open and sends its share of
+ * the requests back to back, recording the latency of each one.
+ *
+ * \param[in] socketPath The server's socket
+ * \param[in] message The request to send, as from `encodeRequest`
+ * \param[in] requests The total number of requests to send
+ * \param[in] concurrency The number of client threads
+ */
+static void loadGen(const std::string &socketPath, const std::string &message,
+                    unsigned requests, unsigned concurrency) {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::vector<double>> latencies(concurrency);
+    std::vector<std::thread> clients;
+
+    auto start = Clock::now();
+
+    for (unsigned i = 0; i < concurrency; i++) {
+        unsigned share = requests / concurrency + (i < requests % concurrency);
+
+        clients.emplace_back([&, i, share] {
+            try {
+                int fd = connectSocket(socketPath);
+                std::string diagnostics;
+                std::string payload;
+
+                for (unsigned j = 0; j < share; j++) {
+                    auto before = Clock::now();
+                    request(fd, message, diagnostics, payload);
+                    std::chrono::duration<double, std::micro> elapsed =
+                        Clock::now() - before;
+                    latencies[i].push_back(elapsed.count());
+                }
+                close(fd);
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << "\n";
+            }
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    std::chrono::duration<double> wall = Clock::now() - start;
+
+    std::vector<double> all;
+    for (const auto &l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    if (all.empty())
+        throw std::runtime_error("No requests completed");
+
+    // nearest-rank percentile
+    auto percentile = [&](double p) {
+        size_t rank = static_cast<size_t>(p / 100.0 * all.size() + 0.5);
+        return all[std::min(all.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+
+    std::cout << "requests:     " << all.size() << "\n"
+              << "concurrency:  " << concurrency << "\n"
+              << "wall time:    " << wall.count() << " s\n"
+              << "requests/sec: " << all.size() / wall.count() << "\n"
+              << "p50 latency:  " << percentile(50) << " us\n"
+              << "p99 latency:  " << percentile(99) << " us\n"
+              << "max latency:  " << all.back() << " us\n";
+}
+
+static void usage() {
+    std::cerr << "usage: RegAllocClient [-s socket] [--bench requests] "
+                 "[--concurrency n] [options] [input file]\n";
+}
+
+int main(int argc, char *argv[]) {
+    std::string socketPath = defaultSocketPath;
+    std::string filename;
+    CompileFlags flags;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    unsigned requests = 0;
+    unsigned concurrency = 1;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+
+        if (arg == "-s" && hasValue) {
+            socketPath = args[++i];
+        } else if (arg == "--bench" && hasValue) {
+            if (!parseUnsigned(args[++i], requests)) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--concurrency" && hasValue) {
+            if (!parseUnsigned(args[++i], concurrency)) {
+                usage();
+                return 1;
+            }
+            concurrency = std::max(1u, concurrency);
+        } else {
+            try {
+                if (parseFlag(args, i, flags))
+                    continue;
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << "\n";
+                return 1;
+            }
+
+            if (!filename.empty()) {
+                usage();
+                return 1;
+            }
+            filename = arg;
+        }
+    }
+
+    if (filename.empty()) {
+        std::cerr << "Need to supply LLVM IR file!\n";
+        usage();
+        return 1;
+    }
+
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Could not open " << filename << "\n";
+        return 1;
+    }
+    std::stringstream ir;
+    ir << file.rdbuf();
+
+    try {
+        // the server reads the profile, so it can't be relative to this
+        // process's working directory
+        if (!flags.profilePath.empty())
+            flags.profilePath = std::filesystem::absolute(flags.profilePath);
+
+        // the server names the module after the input file, like the
+        // program does
+        auto command = flagArguments(flags);
+        command.push_back(filename);
+        auto message = encodeRequest(command, ir.str());
+
+        if (requests > 0) {
+            loadGen(socketPath, message, requests, concurrency);
+            return 0;
+        }
+
+        int fd = connectSocket(socketPath);
+        std::string diagnostics;
+        std::string payload;
+        bool ok = request(fd, message, diagnostics, payload);
+        close(fd);
+
+        std::cerr << diagnostics;
+        if (!ok) {
+            std::cerr << payload << "\n";
+            return 1;
+        }
+        std::cout << payload;
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -1,60 +1,748 @@
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <exception>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
+#include <llvm/IR/CFG.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
 
 #include "LLVMUtils.h"
 #include "codegen.h"
+#include "heap.h"
+#include "ifconvert.h"
+#include "phi.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "schedule.h"
 
-void codeGen(std::unique_ptr<llvm::Module> &module) {
-    auto labels = std::make_shared<LabelTable>();
+/*!
+ * \brief Return the registers that values can be allocated to
+ *
+ * \param[in] options Options that control code generation
+ * \returns The allocatable registers
+ */
+static RegisterSet allocatableRegisters(const CodeGenOptions &options) {
+    RegisterSet registers = {eax, ebx, ecx, edx};
 
-    for (auto &func : *module) {
-        int bbCounter = 0;
-        for (auto &bb : func) {
-            if (&bb == &func.getEntryBlock()) {
-                // the entry basic block's name is the function name followed
-                // by a colon
-                labels->insert(std::make_pair(&bb, func.getName().str()));
+    // without a frame pointer, `%ebp` is an ordinary callee-saved register
+    if (options.omitFramePointer)
+        registers.insert(ebp);
+    return registers;
+}
+
+/*!
+ * \brief Decide which blocks of a function run with the stack frame set up
+ *
+ * The prologue is placed at the top of a block that dominates every block
+ * needing the frame, so that paths which never touch it, such as an early
+ * return, skip the prologue and the epilogue altogether. Every block that can
+ * be reached once the prologue has run must be dominated by its block, so
+ * that whether the frame is there never depends on the path taken, and the
+ * block can't be the target of a loop back edge or the prologue would run
+ * again. The entry block always qualifies.
+ *
+ * \param[in] func The function
+ * \param[in,out] frame The frame, whose `usedBy` blocks are read and whose
+ * `prologueBlock` and `framed` blocks are set
+ */
+static void placePrologue(llvm::Function &func, FrameInfo &frame) {
+    llvm::DominatorTree dominators(func);
+    const llvm::BasicBlock *candidate = nullptr;
+
+    for (auto bb : frame.usedBy) {
+        if (!dominators.isReachableFromEntry(bb))
+            continue;
+
+        candidate = candidate == nullptr
+                        ? bb
+                        : dominators.findNearestCommonDominator(candidate, bb);
+    }
+
+    // leaf code that stays in the scratch registers needs no frame at all
+    if (candidate == nullptr)
+        return;
+
+    auto canHoldPrologue = [&](const llvm::BasicBlock *bb) {
+        for (const auto pred : llvm::predecessors(bb)) {
+            if (dominators.dominates(bb, pred))
+                return false;
+        }
+
+        std::vector<const llvm::BasicBlock *> worklist = {bb};
+        std::set<const llvm::BasicBlock *> seen = {bb};
+
+        while (!worklist.empty()) {
+            auto next = worklist.back();
+            worklist.pop_back();
+
+            for (const auto succ : llvm::successors(next)) {
+                if (!dominators.dominates(bb, succ))
+                    return false;
+                if (seen.insert(succ).second)
+                    worklist.push_back(succ);
             }
-            // create bb label
-            std::stringstream ss;
-            ss << ".L" << bbCounter++;
-            labels->insert(std::make_pair(&bb, ss.str()));
         }
+        return true;
+    };
+
+    while (!canHoldPrologue(candidate))
+        candidate = dominators.getNode(candidate)->getIDom()->getBlock();
+
+    frame.prologueBlock = candidate;
+
+    for (const auto &bb : func) {
+        if (dominators.dominates(candidate, &bb))
+            frame.framed.insert(&bb);
     }
+}
 
-    for (auto &func : *module) {
-        auto offsets = genOffsetTable(func);
-        printFnDirective(func);
+/*!
+ * \brief Print the prologue that sets up a stack frame
+ *
+ * The callee-saved registers are pushed before the frame pointer, so that
+ * the stack slots start right below where `%ebp` points. Each step is
+ * described to the unwinder with CFI directives. The call frame address
+ * starts out 4 bytes above `%esp`, just past the return address.
+ *
+ * \param[in] frame The layout of the frame
+ * \param[out] out The stream to write the assembly to
+ */
+static void printPrologue(const FrameInfo &frame, std::ostream &out) {
+    int cfaOffset = 4;
+
+    auto push = [&](PhysicalRegister reg) {
+        cfaOffset += 4;
+        out << "\tpushl %" << registerString(reg) << "\n"
+            << "\t.cfi_def_cfa_offset " << cfaOffset << "\n"
+            << "\t.cfi_offset %" << registerString(reg) << ", " << -cfaOffset
+            << "\n";
+    };
+
+    for (auto reg : frame.savedRegisters) {
+        push(reg);
+    }
+
+    if (!frame.omitFramePointer) {
+        push(ebp);
+        out << "\tmovl %esp, %ebp\n"
+            << "\t.cfi_def_cfa_register %ebp\n";
+    }
+
+    if (frame.size > 0) {
+        out << "\tsubl $" << frame.size << ", %esp\n";
+
+        if (frame.omitFramePointer)
+            out << "\t.cfi_def_cfa_offset " << cfaOffset + frame.size << "\n";
+    }
+}
+
+/*!
+ * \brief Describe the state of the stack frame at the top of a block
+ *
+ * The unwinder reads the CFI directives in address order, so a block that
+ * follows one with a different frame state has to restate it in full.
+ *
+ * \param[in] frame The layout of the frame
+ * \param[in] framed Whether the block runs with the frame set up
+ * \param[out] out The stream to write the directives to
+ */
+static void printFrameState(const FrameInfo &frame, bool framed,
+                            std::ostream &out) {
+    RegisterSet saved = frame.savedRegisters;
+
+    if (!frame.omitFramePointer)
+        saved.insert(ebp);
+
+    if (!framed) {
+        out << "\t.cfi_def_cfa %esp, 4\n";
+
+        for (auto reg : saved) {
+            out << "\t.cfi_restore %" << registerString(reg) << "\n";
+        }
+        return;
+    }
+
+    // the registers are found where the prologue pushed them
+    int cfaOffset = 4;
+
+    for (auto reg : frame.savedRegisters) {
+        cfaOffset += 4;
+        out << "\t.cfi_offset %" << registerString(reg) << ", " << -cfaOffset
+            << "\n";
+    }
+
+    if (frame.omitFramePointer) {
+        out << "\t.cfi_def_cfa %esp, " << cfaOffset + frame.size << "\n";
+    } else {
+        cfaOffset += 4;
+        out << "\t.cfi_offset %ebp, " << -cfaOffset << "\n"
+            << "\t.cfi_def_cfa %ebp, " << cfaOffset << "\n";
+    }
+}
+
+/*!
+ * \brief Return the path of a source file named in debug information
+ *
+ * \param[in] file The file
+ * \returns The file name, prefixed with its directory if it is relative
+ */
+static std::string sourcePath(const llvm::DIFile &file) {
+    auto name = file.getFilename().str();
+    auto directory = file.getDirectory().str();
+
+    if (directory.empty() || (!name.empty() && name[0] == '/'))
+        return name;
+    return directory + "/" + name;
+}
+
+/*!
+ * \brief Return whether an operand in GAS format refers to memory
+ *
+ * \param[in] op The operand
+ * \returns Whether the operand is neither a register nor an immediate
+ */
+static bool isMemoryOp(const std::string &op) {
+    return !op.empty() && op[0] != '%' && op[0] != '$';
+}
+
+/*!
+ * \brief Return whether an instruction leaves the flags as they were
+ *
+ * \param[in] op The mnemonic of the instruction
+ * \returns Whether the flags are the same after the instruction
+ */
+static bool preservesFlags(const std::string &op) {
+    static const std::set<std::string> preserving = {
+        "movl", "pushl", "popl", "leal", "cltd", "leave", "ret"};
 
-        // print the function directives
+    // jumps and conditional moves only read the flags
+    return preserving.count(op) > 0 || op[0] == 'j' || op.rfind("cmov", 0) == 0;
+}
+
+/*!
+ * \brief Return the conditional jump for an integer comparison
+ *
+ * \param[in] predicate The comparison that the jump depends on
+ * \returns The mnemonic of the jump that is taken if the comparison holds
+ */
+static std::string jumpMnemonic(llvm::CmpInst::Predicate predicate) {
+    switch (predicate) {
+    case llvm::CmpInst::ICMP_EQ:
+        return "je";
+    case llvm::CmpInst::ICMP_NE:
+        return "jne";
+    case llvm::CmpInst::ICMP_SLE:
+        return "jle";
+    case llvm::CmpInst::ICMP_SLT:
+        return "jl";
+    case llvm::CmpInst::ICMP_SGE:
+        return "jge";
+    case llvm::CmpInst::ICMP_SGT:
+        return "jg";
+    case llvm::CmpInst::ICMP_ULE:
+        return "jbe";
+    case llvm::CmpInst::ICMP_ULT:
+        return "jb";
+    case llvm::CmpInst::ICMP_UGE:
+        return "jae";
+    case llvm::CmpInst::ICMP_UGT:
+        return "ja";
+    default:
+        throw std::runtime_error("Unsupported comparison");
+    }
+}
+
+//! A function whose IR has been transformed and that is ready for allocation
+struct PreparedFunction {
+    //! The function
+    llvm::Function *func = nullptr;
+
+    //! The counters of the passes that transformed the IR
+    CodeGenStats stats;
+
+    //! The value whose home slot each coalesced value shares
+    std::shared_ptr<HomeTable> homes;
+
+    //! The assembly labels of the function's blocks, and the symbols of the
+    //! function and the globals it refers to
+    std::shared_ptr<LabelTable> labels;
+
+    //! The numbers of the source files seen up to and including this function
+    std::shared_ptr<FileTable> files;
+
+    //! The `.file` directives for the source files first seen here
+    std::string directives;
+
+    //! The profile index of each block
+    std::shared_ptr<BlockIndexTable> blockIndices;
+
+    //! The block frequencies from an earlier instrumented run, or `nullptr`
+    std::shared_ptr<BlockFrequencyTable> frequencies;
+
+    //! The allocations made while preparing the function
+    HeapProfile heap;
+};
+
+//! The assembly generated for a function
+struct GeneratedFunction {
+    //! The name of the function
+    std::string name;
+
+    //! The assembly, including the directives around the function
+    std::string assembly;
+
+    //! The counters collected for the function
+    CodeGenStats stats;
+
+    //! The allocations made for the function so far
+    HeapProfile heap;
+};
+
+//! What preparing one function carries over to the next
+struct ModuleState {
+    //! The number of local labels handed out so far, since they are numbered
+    //! across the whole module to be unique within the assembly file
+    int bbCounter = 0;
+
+    //! The number of blocks numbered for the profile so far
+    unsigned numBlocks = 0;
+
+    //! The numbers of the source files seen so far
+    FileTable files;
+
+    //! The counters of the profile that guides block layout, if there is one
+    std::vector<std::uint32_t> counters;
+};
+
+/*!
+ * \brief Load a function and transform its IR for code generation
+ *
+ * If-conversion removes blocks and lowering phis adds and removes them, so
+ * the IR is transformed before blocks are labeled and numbered for the
+ * profile.
+ *
+ * \param[in,out] func The function to prepare
+ * \param[in,out] state What the functions before this one left behind
+ * \param[in] options Options that control code generation
+ * \returns Everything that allocating the function needs
+ */
+static PreparedFunction prepareFunction(llvm::Function &func,
+                                        ModuleState &state,
+                                        const CodeGenOptions &options) {
+    // bitcode is read lazily, so the body may not have been loaded yet
+    if (auto error = func.materialize()) {
+        throw std::runtime_error("Could not load " + func.getName().str() +
+                                 ": " + llvm::toString(std::move(error)));
+    }
+
+    PreparedFunction prepared;
+    prepared.func = &func;
+    auto &stats = prepared.stats;
+
+    if (options.ifConvertThreshold > 0)
+        stats.ifConverted = ifConvert(func, options.ifConvertThreshold);
+    splitPhiEdges(func);
+
+    // reorder the instructions of each block before they're allocated
+    if (options.schedule) {
         for (auto &bb : func) {
-            // print the basic block label
-            std::cout << labels->find(&bb)->second << ":\n";
+            stats.reordered +=
+                scheduleBlock(bb, allocatableRegisters(options).size());
+        }
+    }
+
+    // coalescing depends on the order within blocks, so it comes last
+    prepared.homes = coalescePhis(func);
+    joinCoalescedEdges(func, *prepared.homes);
+
+    prepared.labels = std::make_shared<LabelTable>();
+
+    for (auto &bb : func) {
+        if (&bb == &func.getEntryBlock()) {
+            // the entry basic block's name is the function name followed
+            // by a colon
+            prepared.labels->insert(
+                std::make_pair(&bb, func.getName().str()));
+        }
+        // create bb label
+        std::stringstream ss;
+        ss << ".L" << state.bbCounter++;
+        prepared.labels->insert(std::make_pair(&bb, ss.str()));
+    }
+
+    // names live in a table shared by the whole context, which the next
+    // function's preparation changes while this one is allocated, so every
+    // symbol is looked up here instead
+    prepared.labels->insert(std::make_pair(&func, func.getName().str()));
+
+    for (const auto &bb : func) {
+        for (const auto &inst : bb) {
+            for (const auto &op : inst.operands()) {
+                if (auto global = llvm::dyn_cast<llvm::GlobalValue>(op.get())) {
+                    prepared.labels->insert(
+                        std::make_pair(global, global->getName().str()));
+                }
+            }
+        }
+    }
+
+    // each source file named in debug locations is numbered and declared
+    // before the first function that refers to it
+    if (options.debugLines) {
+        std::stringstream directives;
+
+        for (const auto &bb : func) {
+            for (const auto &inst : bb) {
+                auto loc = inst.getDebugLoc().get();
+
+                if (loc == nullptr || state.files.count(loc->getFile()) > 0)
+                    continue;
+
+                unsigned number = state.files.size() + 1;
+                state.files.insert(std::make_pair(loc->getFile(), number));
+                directives << "\t.file " << number << " \""
+                           << sourcePath(*loc->getFile()) << "\"\n";
+            }
+        }
+        prepared.directives = directives.str();
+    }
+    prepared.files = std::make_shared<FileTable>(state.files);
+
+    // the profile indices of each block, and the frequencies from an earlier
+    // instrumented run if there is one
+    prepared.blockIndices = numberBlocks(func, state.numBlocks);
+    state.numBlocks += prepared.blockIndices->size();
+
+    if (!options.profilePath.empty())
+        prepared.frequencies =
+            blockFrequencies(*prepared.blockIndices, state.counters);
+    return prepared;
+}
+
+/*!
+ * \brief Allocate registers and select instructions for a function
+ *
+ * \param[in] prepared The function, as left by `prepareFunction`
+ * \param[in] options Options that control code generation
+ * \returns The assembly for the function
+ */
+static GeneratedFunction generateFunction(const PreparedFunction &prepared,
+                                          const CodeGenOptions &options) {
+    auto &func = *prepared.func;
+    auto labels = prepared.labels;
+    auto files = prepared.files;
+
+    GeneratedFunction generated;
+    generated.name = labels->at(&func);
+    generated.stats = prepared.stats;
+
+    FrameInfo frame;
+    frame.omitFramePointer = options.omitFramePointer;
+
+    std::shared_ptr<OffsetTable> offsets;
+    std::vector<const llvm::BasicBlock *> layout;
+    {
+        HeapPhaseScope phase(heapTables);
+        offsets = genOffsetTable(func, *prepared.homes);
+        layout = layoutBlocks(func, prepared.frequencies);
+    }
+
+    // generate the code for every block of the function in layout order
+    auto genBody = [&](std::ostream &body, CodeGenStats &counters) {
+        // whether the code right above a block has the frame set up, which
+        // the function is entered without
+        bool framedAbove = false;
+
+        for (size_t i = 0; i < layout.size(); i++) {
+            auto bb = layout[i];
+            auto next = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+
+            body << labels->find(bb)->second << ":\n";
+
+            if (bb == &func.getEntryBlock())
+                body << "\t.cfi_startproc\n";
+
+            // the prologue block starts out without the frame, like the
+            // paths that lead to it
+            bool framedAtTop =
+                frame.framed.count(bb) > 0 && bb != frame.prologueBlock;
+
+            if (framedAtTop != framedAbove)
+                printFrameState(frame, framedAtTop, body);
+            framedAbove = frame.framed.count(bb) > 0;
+
+            if (bb == frame.prologueBlock)
+                printPrologue(frame, body);
+
+            if (options.instrument)
+                printBlockCounter(prepared.blockIndices->at(bb), body);
 
             // deduplicate the load instructions in the basic block
             // loadDedup(bb);
 
             // generate assembly for the basic block
-            auto regAlloc = RegisterAllocator(&bb, offsets, labels);
+            auto regAlloc = RegisterAllocator(bb, offsets, labels, files, body,
+                                              counters, options, next, frame);
             regAlloc.gen();
         }
+    };
+
+    // The frame can't be laid out until every block has been allocated:
+    // spill slots are added to the offset table along the way, and the
+    // blocks that touch the frame or a callee-saved register decide where
+    // the prologue goes. A first pass allocates the whole function to settle
+    // the frame, and its code is thrown away.
+    std::stringstream discarded;
+    CodeGenStats unused;
+    genBody(discarded, unused);
+    frame.size = frameSize(*offsets);
+    placePrologue(func, frame);
+
+    std::stringstream body;
+    genBody(body, generated.stats);
+
+    HeapPhaseScope phase(heapEmission);
+    std::stringstream out;
+    out << prepared.directives;
+    printFnDirective(generated.name, out);
+    out << body.str() << "\t.cfi_endproc\n"
+        << "\t.size " << generated.name << ", .-" << generated.name << "\n";
+
+    generated.assembly = out.str();
+    return generated;
+}
+
+CodeGenOptions codeGenOptions(const CompileFlags &flags) {
+    CodeGenOptions options;
+    options.stats = flags.stats;
+    options.remat = flags.remat;
+    options.instrument = flags.instrument;
+    options.profilePath = flags.profilePath;
+    options.schedule = flags.schedule;
+    options.omitFramePointer = flags.omitFramePointer;
+    options.ifConvertThreshold =
+        flags.ifConvertThreshold.value_or(defaultIfConvertThreshold);
+    options.debugLines = flags.debugLines;
+    options.pipeline = flags.pipeline;
+    options.timeStages = flags.timeStages;
+    return options;
+}
+
+void codeGen(std::unique_ptr<llvm::Module> &module, std::ostream &out,
+             const CodeGenOptions &options, std::ostream &err) {
+    ModuleState state;
+
+    if (!options.profilePath.empty())
+        state.counters = readProfile(options.profilePath);
+
+    // Whether the profile matches the module is only known once every block
+    // has been numbered, so the assembly is held back until then. Otherwise
+    // a mismatch would leave complete-looking output behind.
+    std::stringstream held;
+    std::ostream &sink = options.profilePath.empty() ? out : held;
+
+    // there is nothing to generate for external declarations
+    std::vector<llvm::Function *> functions;
+
+    for (auto &func : *module) {
+        if (!func.isDeclaration())
+            functions.push_back(&func);
     }
+
+    // the counters summed over every function in the module, and the
+    // allocations made since the last module, which include loading this one
+    CodeGenStats totals;
+    HeapProfile heapTotals = takeHeapProfile();
+    std::vector<StageTime> stages = {{"prepare"}, {"allocate"}, {"emit"}};
+    auto start = std::chrono::steady_clock::now();
+
+    // Each stage times its own work and counts its own allocations. Those
+    // made between functions, such as by the queues, are left out.
+    auto prepare = [&](llvm::Function &func) {
+        StageTimer timer(stages[0]);
+        HeapPhaseScope phase(heapLoad);
+        takeHeapProfile();
+
+        auto prepared = prepareFunction(func, state, options);
+        prepared.heap = takeHeapProfile();
+        return prepared;
+    };
+    auto generate = [&](const PreparedFunction &prepared) {
+        StageTimer timer(stages[1]);
+        HeapPhaseScope phase(heapAllocation);
+        takeHeapProfile();
+
+        auto generated = generateFunction(prepared, options);
+        generated.heap = prepared.heap;
+        generated.heap += takeHeapProfile();
+        return generated;
+    };
+    auto emit = [&](const GeneratedFunction &generated) {
+        StageTimer timer(stages[2]);
+        HeapPhaseScope phase(heapEmission);
+        takeHeapProfile();
+        sink << generated.assembly;
+
+        auto heap = generated.heap;
+        heap += takeHeapProfile();
+
+        if (options.stats)
+            printStats(generated.name, generated.stats, err);
+        if (options.stats && countingAllocations)
+            printHeapProfile(generated.name, heap, err);
+        totals += generated.stats;
+        heapTotals += heap;
+    };
+
+    if (!options.pipeline) {
+        for (auto func : functions) {
+            emit(generate(prepare(*func)));
+        }
+    } else {
+        // A function's IR is only touched by one stage at a time. Preparing
+        // a function only creates instructions and blocks within it, so the
+        // other stages can read the functions that were handed to them.
+        BoundedQueue<PreparedFunction> preparedQueue(pipelineDepth);
+        BoundedQueue<GeneratedFunction> generatedQueue(pipelineDepth);
+
+        // the first error in any stage, which stops the others
+        std::exception_ptr error;
+        std::mutex errorLock;
+
+        auto fail = [&] {
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+
+                if (error == nullptr)
+                    error = std::current_exception();
+            }
+            preparedQueue.close();
+            generatedQueue.close();
+        };
+
+        std::thread preparer([&] {
+            try {
+                for (auto func : functions) {
+                    if (!preparedQueue.push(prepare(*func)))
+                        break;
+                }
+            } catch (...) {
+                fail();
+            }
+            preparedQueue.close();
+        });
+
+        std::thread allocator([&] {
+            try {
+                while (auto prepared = preparedQueue.pop()) {
+                    if (!generatedQueue.push(generate(*prepared)))
+                        break;
+                }
+            } catch (...) {
+                fail();
+            }
+            generatedQueue.close();
+        });
+
+        // the calling thread writes the output, as the last stage
+        try {
+            while (auto generated = generatedQueue.pop()) {
+                emit(*generated);
+            }
+        } catch (...) {
+            fail();
+        }
+        preparer.join();
+        allocator.join();
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+    }
+
+    if (options.timeStages)
+        printStageTimes(stages, std::chrono::steady_clock::now() - start,
+                        err);
+
+    if (!options.profilePath.empty() &&
+        state.counters.size() != state.numBlocks)
+        throw std::runtime_error("Profile " + options.profilePath +
+                                 " was not collected from this module");
+    if (!options.profilePath.empty())
+        out << held.str();
+
+    if (options.stats)
+        printStats(module->getSourceFileName(), totals, err);
+    if (options.stats && countingAllocations)
+        printHeapProfile(module->getSourceFileName(), heapTotals, err);
+
+    if (options.instrument)
+        printProfileRuntime(state.numBlocks, defaultProfilePath, out);
+}
+
+void printStats(const std::string &name, const CodeGenStats &stats,
+                std::ostream &out) {
+    out << name << ": spills=" << stats.spills << " remats=" << stats.remats
+        << " spill-stores=" << stats.spillStores
+        << " spill-reloads=" << stats.spillReloads
+        << " scratch-saves=" << stats.scratchSaves
+        << " fallthroughs=" << stats.fallthroughs
+        << " reordered=" << stats.reordered
+        << " coalesced=" << stats.coalesced
+        << " folded-loads=" << stats.foldedLoads
+        << " if-converted=" << stats.ifConverted
+        << " shuffles=" << stats.shuffles
+        << " phi-copies=" << stats.phiCopies
+        << " flags-reused=" << stats.flagReuses
+        << " zero-idioms=" << stats.zeroIdioms << "\n";
+}
+
+CodeGenStats &CodeGenStats::operator+=(const CodeGenStats &other) {
+    spills += other.spills;
+    remats += other.remats;
+    spillStores += other.spillStores;
+    spillReloads += other.spillReloads;
+    scratchSaves += other.scratchSaves;
+    fallthroughs += other.fallthroughs;
+    reordered += other.reordered;
+    coalesced += other.coalesced;
+    foldedLoads += other.foldedLoads;
+    ifConverted += other.ifConverted;
+    shuffles += other.shuffles;
+    phiCopies += other.phiCopies;
+    flagReuses += other.flagReuses;
+    zeroIdioms += other.zeroIdioms;
+    return *this;
 }
 
 RegisterAllocator::RegisterAllocator(const llvm::BasicBlock *bb,
                                      std::shared_ptr<OffsetTable> &offsets,
-                                     std::shared_ptr<LabelTable> &labels) {
+                                     std::shared_ptr<LabelTable> &labels,
+                                     std::shared_ptr<FileTable> &files,
+                                     std::ostream &out, CodeGenStats &stats,
+                                     const CodeGenOptions &options,
+                                     const llvm::BasicBlock *fallthrough,
+                                     FrameInfo &frame)
+    : out(out), stats(stats), options(options), frame(frame) {
     basicBlock = bb;
+    this->fallthrough = fallthrough;
+    allocatable = allocatableRegisters(options);
     offsetTable = offsets;
     labelTable = labels;
+    fileTable = files;
     initializeMembers();
 }
 
@@ -62,42 +750,48 @@ RegisterAllocator::~RegisterAllocator() {}
 
 void RegisterAllocator::gen() {
     // generate the metadata necessary to perform code generation
-    generateTables();
-
-    // so we can iterate over all of the registers easily
-    std::vector<PhysicalRegister> allRegisters = {eax, ebx, ecx, edx};
+    {
+        HeapPhaseScope phase(heapTables);
+        generateTables();
+    }
 
     for (const auto &inst : *basicBlock) {
         // if an instruction is an alloc instruction, skip it
         if (llvm::isa<llvm::AllocaInst>(inst))
             continue;
 
-        PhysicalRegister resultRegister = nullRegister;
+        // phis are written by the copies on the edges into their block
+        if (llvm::isa<llvm::PHINode>(inst))
+            continue;
 
-        // check to see if the current instruction has a result register
-        auto x = resultTable->find(&inst);
+        // fused comparisons are generated along with their branch or select
+        if (isFusedCompare(inst))
+            continue;
 
-        // if so, store that result register
-        if (x != resultTable->end())
-            resultRegister = x->second;
+        // only a branch or select reads the flags, right after its compare
+        flagsLive = false;
 
-        // In these code examples, there are at most two operands, so set them
-        // here for convenience. We use std optional because it's available in
-        // C++17 and offers more safety than directly dealing with nullptr. It
-        // also has much more graceful error saving options.
-        std::optional<const llvm::Value *> operand0 = std::nullopt;
-        std::optional<const llvm::Value *> operand1 = std::nullopt;
+        // folded loads are read by their user directly
+        if (foldTable->find(&inst) != foldTable->end())
+            continue;
 
-        // a list of register that we spilled that will have to be popped later
-        std::vector<PhysicalRegister> spilledRegisters;
+        // Values that don't have a register and can be rematerialized are
+        // recomputed at each use, so there is nothing to generate for them
+        // here. Loads and arithmetic have no side effects to preserve.
+        auto result = resultTable->find(&inst);
 
-        // the registers in use
-        RegisterSet usedRegisters;
+        if (result != resultTable->end() && result->second == nullRegister &&
+            rematTable->find(&inst) != rematTable->end())
+            continue;
+
+        // the register that the result of the instruction is written to
+        PhysicalRegister resultRegister = nullRegister;
 
-        if (inst.getNumOperands() > 0)
-            operand0 = inst.getOperand(0);
-        if (inst.getNumOperands() > 1)
-            operand1 = inst.getOperand(1);
+        if (result != resultTable->end())
+            resultRegister = result->second;
+
+        if (options.debugLines)
+            emitLocation(inst);
 
         // Based on the instruction, determine what kind of assembly
         // instruction to generate, and perform the necessary register
@@ -107,161 +801,437 @@ void RegisterAllocator::gen() {
         // The two main conditions we run into are whether the instruction is
         // an arithmetic operation or if it is a branch instruction
         if (isArithmeticInst(inst)) {
-            // if there is no register assigned for this instruction, then
-            // there is no result for this particular instruction
-            auto result = resultTable->find(&inst);
-
-            // check which registers the operands are using
-            auto regA = resultTable->find(
-                static_cast<const llvm::Instruction *>(operand0.value()));
-            auto regB = resultTable->find(
-                static_cast<const llvm::Instruction *>(operand1.value()));
-
-            if (regA != resultTable->end())
-                usedRegisters.insert(regA->second);
-
-            if (regB != resultTable->end())
-                usedRegisters.insert(regB->second);
-
-            // If there is no result, then we need to find some register to
-            // use for the instruction destination. Pick a register that isn't
-            // being used by an operand and spill it.
-            if (result == resultTable->end()) {
-                for (auto reg : allRegisters) {
-                    if (usedRegisters.find(reg) != usedRegisters.end()) {
-                        resultRegister = reg;
-                        usedRegisters.insert(reg);
-                        spilledRegisters.push_back(reg);
-
-                        // generate instruction to spill the register so it can
-                        // be set
-                        std::cout << "pushl " << registerString(reg) << "\n";
-                        break;
-                    }
-                }
-            }
+            // If the result was spilled, compute it in a scratch register
+            // and store it to its slot afterwards. The operands are found
+            // after the scratch register, since saving it moves `%esp`.
+            bool saved = false;
+            auto destRegister = resultRegister;
+
+            if (destRegister == nullRegister)
+                destRegister = pickScratch(inst, operandRegisters(inst), saved);
+            auto dest = "%" + registerString(destRegister);
+            auto srcA = useOp(*inst.getOperand(0));
+            auto srcB = useOp(*inst.getOperand(1));
 
-            // copy the second operand to the result register
-            auto secondOpStr = findOp(*operand1.value());
-            std::cout << "movl " << registerString(resultRegister) << ", "
-                      << secondOpStr << "\n";
+            // x86 arithmetic is two-address, so copy the first operand to the
+            // destination and apply the operation with the second operand.
+            // The copy isn't needed if the result took over the register of
+            // a dying operand, which is moved to the front if the operation
+            // is commutative.
+            if (dest == srcB && dest != srcA && inst.isCommutative())
+                std::swap(srcA, srcB);
+
+            if (dest == srcA)
+                stats.coalesced++;
+            else
+                emit("movl", srcA, dest);
 
-            // do the add op
             switch (inst.getOpcode()) {
             case llvm::Instruction::Add:
-                std::cout << "addl";
+                emit("addl", srcB, dest);
+                flags = FlagState{&inst, nullptr, true};
                 break;
             case llvm::Instruction::Sub:
-                std::cout << "subl";
+                emit("subl", srcB, dest);
+                flags = FlagState{&inst, nullptr, true};
                 break;
             case llvm::Instruction::Mul:
-                std::cout << "imull";
+                emit("imull", srcB, dest);
                 break;
             default:
-                std::cout << "unknown_arithmetic_op";
+                emit("unknown_arithmetic_op", srcB, dest);
                 break;
             }
-            std::cout << " " << findOp(*operand0.value()) << ", " << secondOpStr
-                      << "\n";
-
-            // pop the stack back into each register
-            for (auto reg : usedRegisters) {
-                std::cout << "popl " << registerString(reg) << "\n";
-            }
+            writeResult(inst, destRegister);
+            releaseScratch(destRegister, saved);
         } else if (llvm::isa<llvm::BranchInst>(inst)) {
             // if the instruction is a branch instruction, check whether it's
             // conditional
             auto branchInst = static_cast<const llvm::BranchInst *>(&inst);
 
-            if (!operand0.has_value())
-                throw std::runtime_error(
-                    "Could not get operand for branch instruction");
-
-            // The destination basic block for the jump
-            auto destBB =
-                static_cast<const llvm::BasicBlock *>(operand0.value());
-
-            // the label for the section referred to by the basic block
-            auto destLabel = labelTable->find(destBB);
-
-            if (destLabel == labelTable->end())
-                throw std::runtime_error(
-                    "Could not find basic block in label table");
-            auto destLabelStr = destLabel->second;
-
             // If the branch is conditional, then perform whichever compare/jump
             // instruction is necessary for that condition.
             // Otherwise, just dump the jmp instruction.
-            if (branchInst->isConditional()) {
-                if (!operand0.has_value() || !operand1.has_value())
-                    throw std::runtime_error("Could not find both operands for "
-                                             "conditional instruction");
-
-                // First, generate the cmp instruction to set up the conditional
-                // jump. If the first operand is not a constant, move it to a
-                // register.
-                std::cout << "cmpl " << findOp(*operand0.value()) << ", "
-                          << findOp(*operand1.value()) << "\n";
-
-                auto condition =
-                    static_cast<llvm::CmpInst *>(branchInst->getCondition());
-
-                // Generate the proper jump instruction for the comparison.
-                // We are only generating cases that correspond to the jump
-                // variants listed in the instructions. We are also only
-                // dealing with signed integers, according to the
-                // instructions.
-                switch (condition->getPredicate()) {
-                case llvm::CmpInst::ICMP_EQ:
-                    std::cout << "je " << destLabelStr << "\n";
-                    break;
-                case llvm::CmpInst::ICMP_NE:
-                    std::cout << "jne " << destLabelStr << "\n";
-                    break;
-                case llvm::CmpInst::ICMP_SLE:
-                    std::cout << "jle " << destLabelStr << "\n";
-                    break;
-                case llvm::CmpInst::ICMP_SLT:
-                    std::cout << "jl " << destLabelStr << "\n";
-                    break;
-                case llvm::CmpInst::ICMP_SGE:
-                    std::cout << "jge " << destLabelStr << "\n";
-                    break;
-                case llvm::CmpInst::ICMP_SGT:
-                    std::cout << "jg " << destLabelStr << "\n";
-                    break;
-                default:
-                    // silently ignore unsupported comparisons
-                    break;
+            if (!branchInst->isConditional()) {
+                emitPhiCopies(*branchInst->getSuccessor(0), inst);
+                emitJumps("", "", branchInst->getSuccessor(0), nullptr);
+                continue;
+            }
+            auto trueBB = branchInst->getSuccessor(0);
+            auto falseBB = branchInst->getSuccessor(1);
+            auto condition = branchInst->getCondition();
+
+            // edges that need copies were split so that only a jump copies
+            if (!phiCopies(*trueBB).empty() || !phiCopies(*falseBB).empty())
+                throw std::runtime_error("Phi copies on a conditional edge");
+
+            // A condition that isn't a comparison in this block is a boolean
+            // value that lives somewhere else, so test it against zero
+            if (!llvm::isa<llvm::Instruction>(condition) ||
+                !isFusedCompare(*llvm::cast<llvm::Instruction>(condition))) {
+                auto src = useOp(*condition);
+
+                if (auto constant =
+                        llvm::dyn_cast<llvm::ConstantInt>(condition)) {
+                    emitJumps("", "", constant->isZero() ? falseBB : trueBB,
+                              nullptr);
+                    continue;
                 }
-            } else {
-                std::cout << "jmp " << destLabelStr << "\n";
+                if (reuseFlags(condition, nullptr, llvm::CmpInst::ICMP_NE)) {
+                    stats.flagReuses++;
+                } else {
+                    // `testl` of a register with itself is the shorter
+                    // compare against zero
+                    if (isMemoryOp(src))
+                        emit("cmpl", "$0", src);
+                    else
+                        emit("testl", src, src);
+                    flags = FlagState{condition, nullptr, false};
+                }
+                emitJumps("jne", "je", trueBB, falseBB);
+                continue;
+            }
+
+            auto predicate =
+                emitCompare(*llvm::cast<llvm::ICmpInst>(condition));
+
+            // Generate the proper jump instruction for the comparison.
+            auto inverse = llvm::CmpInst::getInversePredicate(predicate);
+            emitJumps(jumpMnemonic(predicate), jumpMnemonic(inverse), trueBB,
+                      falseBB);
+        } else if (auto select = llvm::dyn_cast<llvm::SelectInst>(&inst)) {
+            // Copy the false value to the result and overwrite it with the
+            // true value if the condition holds. Neither `movl` nor saving a
+            // scratch register touches the flags, so the comparison goes
+            // first.
+            auto predicate = emitCompare(
+                *llvm::cast<llvm::ICmpInst>(select->getCondition()));
+
+            bool saved = false;
+            auto destRegister = resultRegister;
+
+            if (destRegister == nullRegister)
+                destRegister = pickScratch(inst, operandRegisters(inst), saved);
+            auto dest = "%" + registerString(destRegister);
+            auto srcTrue = useOp(*select->getTrueValue());
+            auto srcFalse = useOp(*select->getFalseValue());
+
+            // `cmov` can't take an immediate, so swap the values and invert
+            // the condition, or move a second immediate to a register
+            bool savedTrue = false;
+            auto trueRegister = nullRegister;
+
+            if (srcTrue[0] == '$' && srcFalse[0] != '$') {
+                std::swap(srcTrue, srcFalse);
+                predicate = llvm::CmpInst::getInversePredicate(predicate);
+            } else if (srcTrue[0] == '$') {
+                auto exclude = operandRegisters(inst);
+                exclude.insert(destRegister);
+                trueRegister = pickScratch(inst, exclude, savedTrue);
+                emit("movl", srcTrue, "%" + registerString(trueRegister));
+                srcTrue = "%" + registerString(trueRegister);
+            }
+
+            if (dest != srcFalse)
+                emit("movl", srcFalse, dest);
+            emit("cmov" + jumpMnemonic(predicate).substr(1), srcTrue, dest);
+
+            if (trueRegister != nullRegister)
+                releaseScratch(trueRegister, savedTrue);
+            writeResult(inst, destRegister);
+            releaseScratch(destRegister, saved);
+        } else if (isDivisionInst(inst)) {
+            // `idivl` divides `%edx:%eax` by its operand, and leaves the
+            // quotient in `%eax` and the remainder in `%edx`. The constraint
+            // table keeps every other live value out of both registers.
+            auto op = inst.getOpcode();
+            bool isSigned =
+                op == llvm::Instruction::SDiv || op == llvm::Instruction::SRem;
+            bool remainder =
+                op == llvm::Instruction::SRem || op == llvm::Instruction::URem;
+
+            auto dividend = useOp(*inst.getOperand(0));
+            auto divisor = useOp(*inst.getOperand(1));
+
+            if (dividend != "%eax")
+                moveToFixed(dividend, eax);
+
+            if (isSigned)
+                emit("cltd");
+            else
+                emit("xorl", "%edx", "%edx");
+
+            // the divisor can't be an immediate
+            bool saved = false;
+            auto scratch = nullRegister;
+
+            if (divisor[0] == '$') {
+                auto exclude = operandRegisters(inst);
+                exclude.insert(eax);
+                exclude.insert(edx);
+                scratch = pickScratch(inst, exclude, saved);
+                emit("movl", divisor, "%" + registerString(scratch));
+                divisor = "%" + registerString(scratch);
+            }
+            emit(isSigned ? "idivl" : "divl", divisor);
+
+            if (scratch != nullRegister)
+                releaseScratch(scratch, saved);
+            moveFromFixed(inst, resultRegister, remainder ? edx : eax);
+        } else if (llvm::isa<llvm::CallInst>(inst) &&
+                   !llvm::isa<llvm::IntrinsicInst>(inst)) {
+            auto call = llvm::cast<llvm::CallInst>(&inst);
+
+            // cdecl arguments are pushed from right to left, and popped by
+            // the caller
+            int argBytes = 0;
+
+            for (unsigned i = call->arg_size(); i-- > 0;) {
+                auto arg = call->getArgOperand(i);
+
+                if (!arg->getType()->isIntegerTy(32))
+                    throw std::runtime_error(
+                        "Only 32 bit integer arguments are supported");
+
+                emit("pushl", useOp(*arg));
+                adjustStack(4);
+                argBytes += 4;
+            }
+
+            if (auto callee = call->getCalledFunction())
+                emit("call", labelFor(callee));
+            else
+                emit("call", "*" + useOp(*call->getCalledOperand()));
+
+            if (argBytes > 0) {
+                emit("addl", "$" + std::to_string(argBytes), "%esp");
+                adjustStack(-argBytes);
             }
+
+            if (!inst.getType()->isVoidTy())
+                moveFromFixed(inst, resultRegister, eax);
         } else if (llvm::isa<llvm::LoadInst>(inst)) {
             auto load = static_cast<const llvm::LoadInst *>(&inst);
-            const llvm::Value *valOp = nullptr;
-            auto ptrOp = load->getPointerOperand();
 
-            if (operand0.has_value()) {
-                valOp = operand0.value();
-                std::cout << "movl " << findOp(*ptrOp) << ", " << findOp(*valOp)
-                          << "\n";
-            }
+            // a spilled load can't move directly from memory to memory
+            bool saved = false;
+            auto destRegister = resultRegister;
+
+            if (destRegister == nullRegister)
+                destRegister = pickScratch(inst, RegisterSet(), saved);
+            auto src = findOp(*load->getPointerOperand());
+
+            emit("movl", src, "%" + registerString(destRegister));
+            writeResult(inst, destRegister);
+            releaseScratch(destRegister, saved);
         } else if (llvm::isa<llvm::StoreInst>(inst)) {
             auto store = static_cast<const llvm::StoreInst *>(&inst);
-            auto ptrOp = store->getPointerOperand();
-            auto valOp = store->getValueOperand();
-            std::cout << "movl " << findOp(*ptrOp) << ", " << findOp(*valOp)
-                      << "\n";
+            auto dest = findOp(*store->getPointerOperand());
+            auto src = useOp(*store->getValueOperand());
+
+            if (!isMemoryOp(src)) {
+                emit("movl", src, dest);
+                continue;
+            }
+
+            // copy memory to memory through a scratch register
+            bool saved = false;
+            auto scratch = pickScratch(inst, operandRegisters(inst), saved);
+
+            // saving the scratch register may have moved `%esp`
+            src = findOp(*store->getValueOperand());
+            dest = findOp(*store->getPointerOperand());
+            emit("movl", src, "%" + registerString(scratch));
+            emit("movl", "%" + registerString(scratch), dest);
+            releaseScratch(scratch, saved);
+        } else if (llvm::isa<llvm::ReturnInst>(inst)) {
+            // the return value is passed back in `%eax`
+            if (inst.getNumOperands() > 0) {
+                auto src = useOp(*inst.getOperand(0));
+
+                if (src != "%eax")
+                    moveToFixed(src, eax);
+            }
+
+            // Tear down the stack frame, if this path set one up. Any code
+            // after the return still has the frame, so the unwinder is told
+            // to go back to the state from before the epilogue.
+            bool framed = frame.framed.count(basicBlock) > 0;
+
+            if (framed) {
+                int cfaOffset = 4 + 4 * frame.savedRegisters.size();
+                out << "\t.cfi_remember_state\n";
+
+                if (frame.omitFramePointer) {
+                    if (frame.size > 0) {
+                        emit("addl", "$" + std::to_string(frame.size), "%esp");
+                        out << "\t.cfi_def_cfa_offset " << cfaOffset << "\n";
+                    }
+                } else {
+                    emit("leave");
+                    out << "\t.cfi_restore %ebp\n"
+                        << "\t.cfi_def_cfa %esp, " << cfaOffset << "\n";
+                }
+                for (auto reg = frame.savedRegisters.rbegin();
+                     reg != frame.savedRegisters.rend(); reg++) {
+                    emit("popl", "%" + registerString(*reg));
+                    cfaOffset -= 4;
+                    out << "\t.cfi_restore %" << registerString(*reg) << "\n"
+                        << "\t.cfi_def_cfa_offset " << cfaOffset << "\n";
+                }
+            }
+            emit("ret");
+
+            if (framed)
+                out << "\t.cfi_restore_state\n";
+        } else if (!llvm::isa<llvm::DbgInfoIntrinsic>(inst)) {
+            throw std::runtime_error(std::string("Unsupported instruction: ") +
+                                     inst.getOpcodeName());
         }
     }
 }
 
+llvm::CmpInst::Predicate
+RegisterAllocator::emitCompare(const llvm::ICmpInst &compare) {
+    // the comparison is emitted at its user, so scratch space is looked for
+    // there
+    auto user = llvm::cast<llvm::Instruction>(compare.user_back());
+    auto predicate = compare.getPredicate();
+    auto opA = compare.getOperand(0);
+    auto opB = compare.getOperand(1);
+
+    // the flags may still hold the comparison, from an earlier one of the
+    // same values or from the arithmetic that computed the compared value
+    if (auto reused = reuseFlags(opA, opB, predicate)) {
+        stats.flagReuses++;
+        flagsLive = true;
+        return *reused;
+    }
+    auto srcA = useOp(*opA);
+    auto srcB = useOp(*opB);
+
+    // `cmpl` can't take an immediate as its second operand, so swap the
+    // operands and the predicate if the first one is a constant
+    if (srcA[0] == '$' && srcB[0] != '$') {
+        std::swap(opA, opB);
+        std::swap(srcA, srcB);
+        predicate = llvm::CmpInst::getSwappedPredicate(predicate);
+    }
+
+    // Only one operand can be in memory, and the compared operand can't be
+    // an immediate, so move it to a scratch register if needed. Popping the
+    // register afterwards doesn't touch the flags.
+    if (srcA[0] == '$' || (isMemoryOp(srcA) && isMemoryOp(srcB))) {
+        bool saved = false;
+        auto scratch = pickScratch(*user, operandRegisters(compare), saved);
+
+        // saving the scratch register may have moved `%esp`
+        srcA = findOp(*opA);
+        srcB = findOp(*opB);
+        emit("movl", srcA, "%" + registerString(scratch));
+        emit("cmpl", srcB, "%" + registerString(scratch));
+        releaseScratch(scratch, saved);
+    } else {
+        // AT&T syntax compares the second operand against the first
+        emit("cmpl", srcB, srcA);
+    }
+    flags = FlagState{opA, opB, false};
+    flagsLive = true;
+    return predicate;
+}
+
+std::optional<llvm::CmpInst::Predicate>
+RegisterAllocator::reuseFlags(const llvm::Value *lhs, const llvm::Value *rhs,
+                              llvm::CmpInst::Predicate predicate) const {
+    auto matches = [this](const llvm::Value *a, const llvm::Value *b) {
+        if (a != flags.lhs)
+            return false;
+        if (flags.rhs != nullptr)
+            return b == flags.rhs;
+
+        auto constant = llvm::dyn_cast_or_null<llvm::ConstantInt>(b);
+        return b == nullptr || (constant != nullptr && constant->isZero());
+    };
+
+    if (flags.lhs == nullptr)
+        return std::nullopt;
+
+    // the same comparison the other way around tests the swapped condition
+    if (!matches(lhs, rhs)) {
+        if (!matches(rhs, lhs))
+            return std::nullopt;
+        predicate = llvm::CmpInst::getSwappedPredicate(predicate);
+    }
+
+    if (!flags.onlyZero)
+        return predicate;
+
+    // Only whether the value is zero is known, which also answers the
+    // unsigned comparisons that amount to the same thing
+    switch (predicate) {
+    case llvm::CmpInst::ICMP_EQ:
+    case llvm::CmpInst::ICMP_ULE:
+        return llvm::CmpInst::ICMP_EQ;
+    case llvm::CmpInst::ICMP_NE:
+    case llvm::CmpInst::ICMP_UGT:
+        return llvm::CmpInst::ICMP_NE;
+    default:
+        return std::nullopt;
+    }
+}
+
 void RegisterAllocator::generateTables() {
     indexTable = genIndexTable(*basicBlock);
-    tableInit(*basicBlock, indexTable, intervalTable, registerTable);
+    tableInit(*basicBlock, indexTable, intervalTable, registerTable,
+              allocatable);
     sortedIntervals = sortIntervalMap(intervalTable);
-    resultTable = genResultTable(*basicBlock, registerTable, sortedIntervals);
+
+    // keep values that are still needed out of the registers that division
+    // and calls overwrite
+    constraintTable = genConstraintTable(*basicBlock);
+    applyClobbers(indexTable, intervalTable, constraintTable, registerTable);
+
+    // folded loads never compete for a register
+    foldTable = genFoldTable(*basicBlock, indexTable, intervalTable);
+
+    for (const auto &fold : *foldTable) {
+        registerTable->at(fold.first).clear();
+    }
+
+    rematTable = options.remat
+                     ? genRematTable(*basicBlock, indexTable, intervalTable)
+                     : std::make_shared<RematTable>();
+    hintTable = genHintTable(*basicBlock, indexTable, intervalTable);
+    resultTable = genResultTable(*basicBlock, registerTable, sortedIntervals,
+                                 rematTable, hintTable, constraintTable);
+
+    for (const auto &result : *resultTable) {
+        useRegister(result.second);
+    }
+
+    // Values without a register are either rematerialized at their uses or
+    // spilled to a stack slot. Values that are live out of the block already
+    // have their slot in memory.
+    for (const auto &inst : *basicBlock) {
+        auto result = resultTable->find(&inst);
+
+        if (result == resultTable->end() || result->second != nullRegister)
+            continue;
+
+        if (foldTable->find(&inst) != foldTable->end()) {
+            stats.foldedLoads++;
+            continue;
+        }
+
+        if (rematTable->find(&inst) != rematTable->end()) {
+            stats.remats++;
+            continue;
+        }
+
+        if (offsetTable->find(&inst) == offsetTable->end())
+            allocateSlot(*offsetTable, &inst);
+        stats.spills++;
+    }
 
     // for debugging purposes
     // printTables();
@@ -310,47 +1280,352 @@ void RegisterAllocator::initializeMembers() {
 std::string RegisterAllocator::findOp(const llvm::Value &inst) const {
     std::stringstream ss;
     // first, check if the instruction is a constant
-    if (llvm::isa<llvm::Constant>(inst)) {
+    if (llvm::isa<llvm::ConstantInt>(inst)) {
         // making the assumption that the value is a signed 32 bit integer
-        if (auto val = llvm::dyn_cast<llvm::ConstantInt>(&inst)) {
-            ss << "$";
-            ss << val->getSExtValue();
-        }
+        auto val = llvm::cast<llvm::ConstantInt>(&inst);
+        ss << "$";
+        ss << val->getSExtValue();
+    } else if (llvm::isa<llvm::UndefValue>(inst)) {
+        // an undefined value may be anything, such as zero
+        ss << "$0";
+    } else if (auto global = llvm::dyn_cast<llvm::GlobalVariable>(&inst)) {
+        // globals are addressed by their symbol
+        ss << labelFor(global);
+    } else if (auto arg = llvm::dyn_cast<llvm::Argument>(&inst)) {
+        ss << argumentAddress(arg->getArgNo());
     } else if (llvm::isa<llvm::Instruction>(inst)) {
         auto instPtr = static_cast<const llvm::Instruction *>(&inst);
 
         // first, check to see if the operand has a register
         auto regCandidate = resultTable->find(instPtr);
 
-        if (regCandidate != resultTable->end()) {
+        if (regCandidate != resultTable->end() &&
+            regCandidate->second != nullRegister) {
             // we have a register!
-            switch (regCandidate->second) {
-            case eax:
-                ss << "%eax";
-            case ebx:
-                ss << "%ebx";
-            case ecx:
-                ss << "%ecx";
-            case edx:
-                ss << "%edx";
-            default:
-                break;
-            }
-        } else {
-            // otherwise, look in the memory table for the pointer location
-            auto offsetCandidate = offsetTable->find(instPtr);
+            ss << "%" << registerString(regCandidate->second);
+            return ss.str();
+        }
 
-            if (offsetCandidate != offsetTable->end()) {
-                ss << "%ebp" << offsetCandidate->second;
-            }
+        // a folded load is read straight from its slot
+        auto fold = foldTable->find(instPtr);
+
+        if (fold != foldTable->end())
+            return findOp(*fold->second);
+
+        // then check whether the value is recomputed instead of spilled
+        auto remat = rematTable->find(instPtr);
+
+        if (regCandidate != resultTable->end() && remat != rematTable->end()) {
+            if (remat->second.kind == rematConstant)
+                ss << "$" << remat->second.immediate;
+            else
+                ss << findOp(*remat->second.slot);
+            return ss.str();
+        }
+
+        // otherwise, look in the memory table for the pointer location
+        auto offsetCandidate = offsetTable->find(instPtr);
+
+        if (offsetCandidate != offsetTable->end()) {
+            ss << frameAddress(offsetCandidate->second);
         }
     }
     return ss.str();
 }
 
-void printFnDirective(const llvm::Function &func) {
-    auto name = func.getName();
+std::string RegisterAllocator::frameAddress(int offset) const {
+    // the frame is recorded as needed by the block, even though this only
+    // computes an address, because every access to a slot goes through here
+    frame.usedBy.insert(basicBlock);
+
+    if (!frame.omitFramePointer)
+        return std::to_string(offset) + "(%ebp)";
+
+    // `%esp` sits below the slots, and any scratch registers pushed since
+    return std::to_string(offset + frame.size + pushDepth) + "(%esp)";
+}
+
+std::string RegisterAllocator::argumentAddress(unsigned argNo) const {
+    // arguments are pushed by the caller, right above the return address
+    int offset = 4 + 4 * argNo;
+
+    // before the prologue, only scratch saves have moved `%esp`
+    if (frame.framed.count(basicBlock) == 0)
+        return std::to_string(offset + pushDepth) + "(%esp)";
+
+    // the prologue pushes the saved registers and then the frame pointer
+    offset += 4 * frame.savedRegisters.size();
+
+    if (!frame.omitFramePointer)
+        return std::to_string(offset + 4) + "(%ebp)";
+    return std::to_string(offset + frame.size + pushDepth) + "(%esp)";
+}
+
+void RegisterAllocator::adjustStack(int bytes) {
+    pushDepth += bytes;
+
+    // the call frame is found relative to `%esp` unless `%ebp` holds it
+    if (frame.omitFramePointer || frame.framed.count(basicBlock) == 0)
+        out << "\t.cfi_adjust_cfa_offset " << bytes << "\n";
+}
+
+void RegisterAllocator::emitLocation(const llvm::Instruction &inst) {
+    auto loc = inst.getDebugLoc().get();
+
+    if (loc == nullptr || loc->getLine() == 0 ||
+        llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+        return;
+
+    auto location = std::make_pair(fileTable->at(loc->getFile()),
+                                   loc->getLine());
+
+    if (location == lastLocation)
+        return;
+
+    lastLocation = location;
+    out << "\t.loc " << location.first << " " << location.second << " "
+        << loc->getColumn() << "\n";
+}
+
+std::string RegisterAllocator::useOp(const llvm::Value &value) {
+    auto inst = llvm::dyn_cast<llvm::Instruction>(&value);
+
+    if (inst != nullptr && isSpilled(inst))
+        stats.spillReloads++;
+    return findOp(value);
+}
+
+bool RegisterAllocator::isSpilled(const llvm::Instruction *inst) const {
+    if (llvm::isa<llvm::AllocaInst>(inst) ||
+        foldTable->find(inst) != foldTable->end())
+        return false;
+
+    // values from other blocks live in their home slot
+    auto result = resultTable->find(inst);
+    if (result == resultTable->end())
+        return offsetTable->find(inst) != offsetTable->end();
+
+    return result->second == nullRegister &&
+           rematTable->find(inst) == rematTable->end();
+}
+
+PhysicalRegister RegisterAllocator::pickScratch(const llvm::Instruction &inst,
+                                                const RegisterSet &exclude,
+                                                bool &saved) {
+    int index = indexTable->at(&inst);
+    RegisterSet busy = exclude;
+
+    // registers holding values that are live across the instruction
+    for (const auto &entry : *intervalTable) {
+        auto reg = resultTable->find(entry.first);
+
+        if (reg != resultTable->end() && reg->second != nullRegister &&
+            std::get<0>(entry.second) <= index &&
+            index <= std::get<1>(entry.second))
+            busy.insert(reg->second);
+    }
+
+    // a free register that the caller saves costs nothing, while a free
+    // callee-saved one still has to be saved in the prologue
+    for (bool calleeSaved : {false, true}) {
+        for (auto reg : allocatable) {
+            if (busy.find(reg) == busy.end() &&
+                isCalleeSaved(reg) == calleeSaved) {
+                saved = false;
+                useRegister(reg);
+                return reg;
+            }
+        }
+    }
+
+    // every register is in use, so borrow one that the instruction doesn't
+    // read and restore it afterwards
+    for (auto reg : allocatable) {
+        if (exclude.find(reg) == exclude.end()) {
+            saved = true;
+            stats.scratchSaves++;
+            emit("pushl", "%" + registerString(reg));
+            adjustStack(4);
+            return reg;
+        }
+    }
+    throw std::runtime_error("No register available for scratch space");
+}
+
+void RegisterAllocator::useRegister(PhysicalRegister reg) {
+    // `%ebp` is only allocatable when it isn't used as the frame pointer
+    if (isCalleeSaved(reg)) {
+        frame.savedRegisters.insert(reg);
+        frame.usedBy.insert(basicBlock);
+    }
+}
+
+void RegisterAllocator::releaseScratch(PhysicalRegister reg, bool saved) {
+    if (saved) {
+        emit("popl", "%" + registerString(reg));
+        adjustStack(-4);
+    }
+}
+
+RegisterSet
+RegisterAllocator::operandRegisters(const llvm::Instruction &inst) const {
+    RegisterSet registers;
+
+    for (const auto &operand : inst.operands()) {
+        auto opInst = llvm::dyn_cast<llvm::Instruction>(operand.get());
+
+        if (opInst == nullptr)
+            continue;
+
+        auto reg = resultTable->find(opInst);
+
+        if (reg != resultTable->end() && reg->second != nullRegister)
+            registers.insert(reg->second);
+    }
+    return registers;
+}
+
+void RegisterAllocator::moveToFixed(const std::string &src,
+                                    PhysicalRegister reg) {
+    emit("movl", src, "%" + registerString(reg));
+
+    if (src[0] == '%')
+        stats.shuffles++;
+}
+
+void RegisterAllocator::moveFromFixed(const llvm::Instruction &inst,
+                                      PhysicalRegister resultRegister,
+                                      PhysicalRegister reg) {
+    // a spilled result is stored straight from the fixed register
+    if (resultRegister == nullRegister) {
+        writeResult(inst, reg);
+        return;
+    }
+
+    if (resultRegister != reg) {
+        emit("movl", "%" + registerString(reg),
+             "%" + registerString(resultRegister));
+        stats.shuffles++;
+    }
+}
+
+void RegisterAllocator::writeResult(const llvm::Instruction &inst,
+                                    PhysicalRegister reg) {
+    if (!isSpilled(&inst))
+        return;
+
+    emit("movl", "%" + registerString(reg), findOp(inst));
+    stats.spillStores++;
+}
+
+std::vector<std::pair<std::string, std::string>>
+RegisterAllocator::phiCopies(const llvm::BasicBlock &succ) const {
+    std::vector<std::pair<std::string, std::string>> copies;
+
+    for (const auto &phi : succ.phis()) {
+        auto value = phi.getIncomingValueForBlock(basicBlock);
+
+        // an undefined value can be whatever the slot already holds
+        if (llvm::isa<llvm::UndefValue>(value))
+            continue;
+
+        auto dst = findOp(phi);
+        auto src = findOp(*value);
+
+        if (src != dst)
+            copies.push_back(std::make_pair(dst, src));
+    }
+    return copies;
+}
+
+void RegisterAllocator::emitPhiCopies(const llvm::BasicBlock &succ,
+                                      const llvm::Instruction &inst) {
+    if (phiCopies(succ).empty())
+        return;
+
+    // Nothing is live across the jump, so the scratch registers are free.
+    // One carries values between two slots and the other breaks cycles.
+    bool savedMove = false;
+    bool savedTemp = false;
+    auto move = pickScratch(inst, RegisterSet(), savedMove);
+    auto temp = pickScratch(inst, RegisterSet{move}, savedTemp);
+
+    auto copies = phiCopies(succ);
+    stats.phiCopies += copies.size();
+
+    for (const auto &m : sequentializeCopies(copies, "%" + registerString(temp))) {
+        if (m.first[0] != '%' && m.second[0] != '%' && m.second[0] != '$') {
+            emit("movl", m.second, "%" + registerString(move));
+            emit("movl", "%" + registerString(move), m.first);
+        } else {
+            emit("movl", m.second, m.first);
+        }
+    }
+    releaseScratch(temp, savedTemp);
+    releaseScratch(move, savedMove);
+}
+
+void RegisterAllocator::emitJumps(const std::string &jump,
+                                  const std::string &inverse,
+                                  const llvm::BasicBlock *taken,
+                                  const llvm::BasicBlock *notTaken) {
+    if (jump.empty()) {
+        if (taken == fallthrough)
+            stats.fallthroughs++;
+        else
+            emit("jmp", labelFor(taken));
+        return;
+    }
+
+    // jump to whichever side doesn't follow this block
+    if (taken == fallthrough) {
+        emit(inverse, labelFor(notTaken));
+        stats.fallthroughs++;
+        return;
+    }
+    emit(jump, labelFor(taken));
+
+    if (notTaken == fallthrough)
+        stats.fallthroughs++;
+    else
+        emit("jmp", labelFor(notTaken));
+}
+
+std::string RegisterAllocator::labelFor(const llvm::Value *value) const {
+    auto label = labelTable->find(value);
+
+    if (label == labelTable->end())
+        throw std::runtime_error("Could not find " +
+                                 std::string(llvm::isa<llvm::BasicBlock>(value)
+                                                 ? "basic block"
+                                                 : "symbol") +
+                                 " in label table");
+    return label->second;
+}
+
+void RegisterAllocator::emit(const std::string &op, const std::string &src,
+                             const std::string &dst) {
+    // `xorl` is shorter and breaks the dependency on the old value, but it
+    // overwrites the flags
+    if (op == "movl" && src == "$0" && !dst.empty() && dst[0] == '%' &&
+        !flagsLive) {
+        stats.zeroIdioms++;
+        emit("xorl", dst, dst);
+        return;
+    }
+    out << "\t" << op;
+
+    if (!src.empty())
+        out << " " << src;
+    if (!dst.empty())
+        out << ", " << dst;
+    out << "\n";
+
+    if (!preservesFlags(op))
+        flags = FlagState();
+}
 
-    std::cout << "\t.globl " << name.str() << "\n"
-              << "\t.type " << name.str() << ", @function\n";
+void printFnDirective(const std::string &name, std::ostream &out) {
+    out << "\t.globl " << name << "\n"
+        << "\t.type " << name << ", @function\n";
 }
@@ -0,0 +1,86 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "flags.h"
+
+bool parseUnsigned(const std::string &text, unsigned &value) {
+    // strtoul accepts a sign and leading whitespace, which aren't numbers here
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+        return false;
+
+    char *end = nullptr;
+    errno = 0;
+    unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+
+    if (*end != '\0' || errno == ERANGE || parsed > UINT_MAX)
+        return false;
+    value = parsed;
+    return true;
+}
+
+bool parseFlag(const std::vector<std::string> &args, size_t &i,
+               CompileFlags &flags) {
+    const auto &arg = args[i];
+    bool hasValue = i + 1 < args.size();
+
+    if (arg == "--stats") {
+        flags.stats = true;
+    } else if (arg == "--no-remat") {
+        flags.remat = false;
+    } else if (arg == "--no-schedule") {
+        flags.schedule = false;
+    } else if (arg == "-fomit-frame-pointer") {
+        flags.omitFramePointer = true;
+    } else if (arg == "--cmov-threshold" && hasValue) {
+        unsigned threshold = 0;
+
+        if (!parseUnsigned(args[++i], threshold))
+            throw std::invalid_argument("Invalid threshold: " + args[i]);
+        flags.ifConvertThreshold = threshold;
+    } else if (arg == "--no-pipeline") {
+        flags.pipeline = false;
+    } else if (arg == "--time-stages") {
+        flags.timeStages = true;
+    } else if (arg == "-g") {
+        flags.debugLines = true;
+    } else if (arg == "--instrument") {
+        flags.instrument = true;
+    } else if (arg == "--profile" && hasValue) {
+        flags.profilePath = args[++i];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> flagArguments(const CompileFlags &flags) {
+    std::vector<std::string> args;
+
+    if (flags.stats)
+        args.push_back("--stats");
+    if (!flags.remat)
+        args.push_back("--no-remat");
+    if (flags.instrument)
+        args.push_back("--instrument");
+    if (!flags.profilePath.empty()) {
+        args.push_back("--profile");
+        args.push_back(flags.profilePath);
+    }
+    if (!flags.schedule)
+        args.push_back("--no-schedule");
+    if (flags.omitFramePointer)
+        args.push_back("-fomit-frame-pointer");
+    if (flags.ifConvertThreshold) {
+        args.push_back("--cmov-threshold");
+        args.push_back(std::to_string(*flags.ifConvertThreshold));
+    }
+    if (flags.debugLines)
+        args.push_back("-g");
+    if (!flags.pipeline)
+        args.push_back("--no-pipeline");
+    if (flags.timeStages)
+        args.push_back("--time-stages");
+    return args;
+}
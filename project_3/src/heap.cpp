@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "heap.h"
+
+#ifdef COUNT_ALLOCATIONS
+const bool countingAllocations = true;
+#else
+const bool countingAllocations = false;
+#endif
+
+//! The counts of one thread, which only that thread touches
+struct ThreadHeap {
+    //! The phase that allocations are counted against
+    HeapPhase phase = heapLoad;
+
+    //! The bytes allocated by the thread, less the bytes it freed
+    long long live = 0;
+
+    //! The live bytes when the current phase was entered
+    long long base = 0;
+
+    //! The counts since they were last taken
+    HeapProfile profile;
+};
+
+// constant initialized, so it can be used by allocations made while the
+// thread is still starting up
+static thread_local ThreadHeap threadHeap;
+
+//! The names of the phases in reports
+static const char *const phaseNames[numHeapPhases] = {"load", "tables",
+                                                      "allocation", "emission"};
+
+HeapProfile &HeapProfile::operator+=(const HeapProfile &other) {
+    for (size_t i = 0; i < phases.size(); i++) {
+        phases[i].allocations += other.phases[i].allocations;
+        phases[i].bytes += other.phases[i].bytes;
+        phases[i].peakBytes =
+            std::max(phases[i].peakBytes, other.phases[i].peakBytes);
+    }
+    return *this;
+}
+
+HeapPhaseScope::HeapPhaseScope(HeapPhase phase)
+    : previous(threadHeap.phase), previousBase(threadHeap.base) {
+    threadHeap.phase = phase;
+    threadHeap.base = threadHeap.live;
+}
+
+HeapPhaseScope::~HeapPhaseScope() {
+    threadHeap.phase = previous;
+    threadHeap.base = previousBase;
+}
+
+HeapProfile takeHeapProfile() {
+    auto profile = threadHeap.profile;
+    threadHeap.profile = HeapProfile();
+    threadHeap.base = threadHeap.live;
+    return profile;
+}
+
+void printHeapProfile(const std::string &name, const HeapProfile &profile,
+                      std::ostream &out) {
+    out << name << ":";
+
+    for (size_t i = 0; i < profile.phases.size(); i++) {
+        const auto &counts = profile.phases[i];
+        out << " " << phaseNames[i] << "-allocs=" << counts.allocations << " "
+            << phaseNames[i] << "-bytes=" << counts.bytes << " "
+            << phaseNames[i] << "-peak=" << counts.peakBytes;
+    }
+    out << "\n";
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+//! The space before each block that holds its size, which keeps the block
+//! as aligned as `malloc` would
+static constexpr size_t headerSize = alignof(std::max_align_t);
+
+void *operator new(size_t size) {
+    auto block = static_cast<char *>(std::malloc(headerSize + size));
+
+    if (block == nullptr)
+        throw std::bad_alloc();
+    *reinterpret_cast<size_t *>(block) = size;
+
+    auto &heap = threadHeap;
+    auto &counts = heap.profile.phases[heap.phase];
+    counts.allocations++;
+    counts.bytes += size;
+    heap.live += size;
+
+    if (heap.live - heap.base > static_cast<long long>(counts.peakBytes))
+        counts.peakBytes = heap.live - heap.base;
+    return block + headerSize;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr == nullptr)
+        return;
+
+    auto block = static_cast<char *>(ptr) - headerSize;
+    threadHeap.live -= *reinterpret_cast<size_t *>(block);
+    std::free(block);
+}
+
+// The other forms only need to agree with the two above. Over-aligned
+// allocations are left to the standard library, which doesn't route them
+// through these.
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+
+#endif
@@ -0,0 +1,278 @@
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include "LLVMUtils.h"
+#include "ifconvert.h"
+
+const unsigned defaultIfConvertThreshold = 6;
+
+//! A conditional branch whose arms can be replaced by selects
+struct Hammock {
+    //! The block that ends with the branch
+    llvm::BasicBlock *head = nullptr;
+
+    //! The arms taken when the condition holds and when it doesn't, either
+    //! of which is `nullptr` if that side goes straight to the merge block
+    llvm::BasicBlock *arms[2] = {nullptr, nullptr};
+
+    //! The block where both sides meet again
+    llvm::BasicBlock *merge = nullptr;
+};
+
+/*!
+ * \brief Return whether an instruction may run even if its arm isn't taken
+ *
+ * \param[in] inst The instruction
+ * \returns Whether running it unconditionally is safe once its stores are
+ * turned into selects
+ */
+static bool canSpeculate(const llvm::Instruction &inst) {
+    if (llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+        return true;
+
+    // division can trap
+    if (isArithmeticInst(inst))
+        return !inst.isIntDivRem();
+
+    // stack variables and globals can always be read
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        auto pointer = load->getPointerOperand();
+        return !load->isVolatile() &&
+               (llvm::isa<llvm::AllocaInst>(pointer) ||
+                llvm::isa<llvm::GlobalVariable>(pointer));
+    }
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        return !store->isVolatile() &&
+               llvm::isa<llvm::AllocaInst>(store->getPointerOperand());
+    }
+    return false;
+}
+
+/*!
+ * \brief Return the block that a block always continues to
+ *
+ * \param[in] bb The block
+ * \returns The target of its unconditional branch, or `nullptr`
+ */
+static llvm::BasicBlock *continuation(llvm::BasicBlock *bb) {
+    auto branch = llvm::dyn_cast<llvm::BranchInst>(bb->getTerminator());
+
+    if (branch == nullptr || branch->isConditional())
+        return nullptr;
+    return branch->getSuccessor(0);
+}
+
+/*!
+ * \brief Find a diamond or a triangle that starts at a block
+ *
+ * \param[in] bb The block that would end with the branch
+ * \param[in] threshold The largest number of instructions in the arms
+ * \param[out] hammock The shape that was found
+ * \returns Whether the branch of the block can be converted
+ */
+static bool findHammock(llvm::BasicBlock &bb, unsigned threshold,
+                        Hammock &hammock) {
+    auto branch = llvm::dyn_cast<llvm::BranchInst>(bb.getTerminator());
+
+    if (branch == nullptr || !branch->isConditional())
+        return false;
+
+    // the comparison is repeated for every select, which only works if
+    // nothing else uses it
+    auto compare = llvm::dyn_cast<llvm::ICmpInst>(branch->getCondition());
+
+    if (compare == nullptr || !isFusedCompare(*compare))
+        return false;
+
+    auto taken = branch->getSuccessor(0);
+    auto notTaken = branch->getSuccessor(1);
+
+    if (taken == notTaken)
+        return false;
+
+    hammock.head = &bb;
+
+    if (continuation(taken) != nullptr &&
+        continuation(taken) == continuation(notTaken)) {
+        hammock.arms[0] = taken;
+        hammock.arms[1] = notTaken;
+        hammock.merge = continuation(taken);
+    } else if (continuation(taken) == notTaken) {
+        hammock.arms[0] = taken;
+        hammock.arms[1] = nullptr;
+        hammock.merge = notTaken;
+    } else if (continuation(notTaken) == taken) {
+        hammock.arms[0] = nullptr;
+        hammock.arms[1] = notTaken;
+        hammock.merge = taken;
+    } else {
+        return false;
+    }
+
+    // the arms and the merge block may only be entered through the shape,
+    // and values can't flow into the merge block through phis
+    if (hammock.merge == &bb ||
+        llvm::isa<llvm::PHINode>(hammock.merge->front()))
+        return false;
+
+    for (const auto pred : llvm::predecessors(hammock.merge)) {
+        if (pred != &bb && pred != hammock.arms[0] && pred != hammock.arms[1])
+            return false;
+    }
+
+    unsigned cost = 0;
+
+    for (const auto arm : hammock.arms) {
+        if (arm == nullptr)
+            continue;
+        if (arm == &bb || arm->getSinglePredecessor() != &bb)
+            return false;
+
+        for (const auto &inst : *arm) {
+            if (inst.isTerminator())
+                continue;
+            if (!canSpeculate(inst))
+                return false;
+            if (!llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+                cost++;
+        }
+    }
+    return cost <= threshold;
+}
+
+/*!
+ * \brief Replace the branch of a diamond or triangle with selects
+ *
+ * \param[in] hammock The shape to convert
+ */
+static void convert(const Hammock &hammock) {
+    auto branch = llvm::cast<llvm::BranchInst>(hammock.head->getTerminator());
+    auto compare = llvm::cast<llvm::ICmpInst>(branch->getCondition());
+
+    // The value that each arm leaves in the stack variables it stores to,
+    // and the variables in the order they're first stored to. The stores
+    // themselves are removed, so loads that come before a store in the same
+    // arm still read the value from before the branch.
+    std::vector<llvm::AllocaInst *> slots;
+    std::unordered_map<const llvm::AllocaInst *, llvm::Value *> stored[2];
+
+    for (int side = 0; side < 2; side++) {
+        auto arm = hammock.arms[side];
+
+        if (arm == nullptr)
+            continue;
+
+        std::vector<llvm::Instruction *> insts;
+
+        for (auto &inst : *arm) {
+            if (!inst.isTerminator())
+                insts.push_back(&inst);
+        }
+
+        for (auto inst : insts) {
+            if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+                auto slot =
+                    llvm::cast<llvm::AllocaInst>(store->getPointerOperand());
+
+                if (stored[0].count(slot) == 0 && stored[1].count(slot) == 0)
+                    slots.push_back(slot);
+                stored[side][slot] = store->getValueOperand();
+                store->eraseFromParent();
+                continue;
+            }
+
+            // a load after a store in the same arm reads the stored value
+            if (auto load = llvm::dyn_cast<llvm::LoadInst>(inst)) {
+                auto slot =
+                    llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand());
+
+                if (slot != nullptr && stored[side].count(slot) > 0) {
+                    load->replaceAllUsesWith(stored[side][slot]);
+                    load->eraseFromParent();
+                    continue;
+                }
+            }
+
+            if (llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+                inst->eraseFromParent();
+            else
+                inst->moveBefore(branch);
+        }
+    }
+
+    // a side that doesn't store to a variable leaves its old value, which is
+    // read before any of the new values are stored
+    for (auto slot : slots) {
+        for (auto &values : stored) {
+            if (values.count(slot) == 0) {
+                auto load = new llvm::LoadInst(slot->getAllocatedType(), slot,
+                                               "", branch);
+                load->setDebugLoc(branch->getDebugLoc());
+                values[slot] = load;
+            }
+        }
+    }
+
+    // every select gets its own copy of the comparison, so that each one can
+    // be fused into its select
+    for (auto slot : slots) {
+        auto condition = compare->clone();
+        condition->insertBefore(branch);
+
+        auto select = llvm::SelectInst::Create(condition, stored[0][slot],
+                                               stored[1][slot], "", branch);
+        auto store = new llvm::StoreInst(select, slot, branch);
+
+        // the conditional moves stand in for the branch in the debug lines
+        select->setDebugLoc(branch->getDebugLoc());
+        store->setDebugLoc(branch->getDebugLoc());
+    }
+
+    branch->eraseFromParent();
+    compare->eraseFromParent();
+
+    for (const auto arm : hammock.arms) {
+        if (arm != nullptr)
+            arm->eraseFromParent();
+    }
+
+    // the merge block is now only reached from the head, so the two become
+    // one block
+    auto head = hammock.head;
+    auto merge = hammock.merge;
+
+    // phis after the merge block name their incoming block outside of its
+    // uses, so they are updated separately
+    head->getInstList().splice(head->end(), merge->getInstList());
+    head->replaceSuccessorsPhiUsesWith(merge, head);
+    merge->replaceAllUsesWith(head);
+    merge->eraseFromParent();
+}
+
+unsigned ifConvert(llvm::Function &func, unsigned threshold) {
+    unsigned converted = 0;
+    bool changed = true;
+
+    // converting a shape can turn the shape around it into a candidate, so
+    // keep going until nothing changes
+    while (changed) {
+        changed = false;
+
+        for (auto &bb : func) {
+            Hammock hammock;
+
+            if (findHammock(bb, threshold, hammock)) {
+                convert(hammock);
+                converted++;
+                changed = true;
+                break;
+            }
+        }
+    }
+    return converted;
+}
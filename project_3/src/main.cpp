@@ -1,10 +1,18 @@
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IRReader/IRReader.h>
 
 #include "LLVMUtils.h"
 #include "codegen.h"
+#include "flags.h"
+#include "protocol.h"
+#include "server.h"
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
@@ -12,11 +20,48 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // parse module file
-    auto context = llvm::LLVMContext();
-    auto module = loadModule(argv[1], context);
+    // run as a persistent compile server, optionally on a given socket
+    if (std::string(argv[1]) == "--server") {
+        std::string socketPath = argc > 2 ? argv[2] : defaultSocketPath;
+        return runServer(socketPath, std::thread::hardware_concurrency());
+    }
+
+    CompileFlags flags;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string filename;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        try {
+            if (parseFlag(args, i, flags))
+                continue;
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
 
-    // run generation method
-    codeGen(module); 
+        if (filename.empty()) {
+            filename = args[i];
+        } else {
+            std::cerr << "Unexpected argument: " << args[i] << "\n";
+            return 1;
+        }
+    }
+
+    if (filename.empty()) {
+        std::cerr << "Need to supply LLVM IR file!\n";
+        return 1;
+    }
+
+    try {
+        // parse module file
+        auto context = llvm::LLVMContext();
+        auto module = loadModule(filename, context);
+
+        // run generation method
+        codeGen(module, std::cout, codeGenOptions(flags));
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
     return 0;
 }
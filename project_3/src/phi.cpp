@@ -0,0 +1,346 @@
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+#include "phi.h"
+
+//! The values that are live at some point, by block
+typedef std::unordered_map<const llvm::BasicBlock *,
+                           std::set<const llvm::Instruction *>>
+    LiveTable;
+
+unsigned splitPhiEdges(llvm::Function &func) {
+    // a phi with a single incoming value is just that value
+    for (auto &bb : func) {
+        if (bb.getSinglePredecessor() != nullptr)
+            llvm::FoldSingleEntryPHINodes(&bb);
+    }
+
+    std::vector<std::pair<llvm::Instruction *, unsigned>> edges;
+
+    for (auto &bb : func) {
+        auto terminator = bb.getTerminator();
+
+        if (terminator == nullptr || terminator->getNumSuccessors() < 2)
+            continue;
+
+        for (unsigned i = 0; i < terminator->getNumSuccessors(); i++) {
+            if (llvm::isa<llvm::PHINode>(terminator->getSuccessor(i)->front()))
+                edges.push_back(std::make_pair(terminator, i));
+        }
+    }
+
+    unsigned split = 0;
+
+    for (const auto &edge : edges) {
+        if (llvm::SplitCriticalEdge(edge.first, edge.second) != nullptr)
+            split++;
+    }
+    return split;
+}
+
+/*!
+ * \brief Compute the values live at the end of every block
+ *
+ * A phi reads its incoming value at the end of the predecessor, so the value
+ * is live there but not at the top of the phi's block.
+ *
+ * \param[in] func The function to inspect
+ * \returns The values live at the end of each block
+ */
+static LiveTable liveOutSets(const llvm::Function &func) {
+    LiveTable used;
+    LiveTable liveIn;
+    LiveTable liveOut;
+
+    for (const auto &bb : func) {
+        for (const auto &inst : bb) {
+            for (const auto &operand : inst.operands()) {
+                auto def = llvm::dyn_cast<llvm::Instruction>(operand.get());
+
+                if (def == nullptr || llvm::isa<llvm::AllocaInst>(def))
+                    continue;
+
+                if (auto phi = llvm::dyn_cast<llvm::PHINode>(&inst)) {
+                    auto pred = phi->getIncomingBlock(operand);
+                    liveOut[pred].insert(def);
+                } else if (def->getParent() != &bb) {
+                    used[&bb].insert(def);
+                }
+            }
+        }
+    }
+
+    // Liveness flows backwards, so visiting the blocks in reverse converges
+    // quickly. The uses by phis are where the sets start out.
+    std::vector<const llvm::BasicBlock *> blocks;
+
+    for (const auto &bb : func) {
+        blocks.push_back(&bb);
+    }
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (auto bb = blocks.rbegin(); bb != blocks.rend(); bb++) {
+            auto &out = liveOut[*bb];
+            auto &in = liveIn[*bb];
+            auto size = out.size() + in.size();
+
+            for (const auto succ : llvm::successors(*bb)) {
+                const auto &succIn = liveIn[succ];
+                out.insert(succIn.begin(), succIn.end());
+            }
+
+            in.insert(used[*bb].begin(), used[*bb].end());
+
+            for (const auto value : out) {
+                if (value->getParent() != *bb)
+                    in.insert(value);
+            }
+            changed |= out.size() + in.size() != size;
+        }
+    }
+    return liveOut;
+}
+
+/*!
+ * \brief Return the position in its block where a value is written
+ *
+ * Every phi of a block is written at once, right before the first
+ * instruction that isn't a phi. Positions are doubled to leave room for the
+ * phis in between.
+ *
+ * \param[in] inst The instruction that defines the value
+ * \param[in] positions The position of every instruction in its block
+ * \returns The position of the definition
+ */
+static unsigned
+defPosition(const llvm::Instruction *inst,
+            const std::unordered_map<const llvm::Instruction *, unsigned>
+                &positions) {
+    if (llvm::isa<llvm::PHINode>(inst))
+        return 2 * positions.at(inst->getParent()->getFirstNonPHI()) - 1;
+    return 2 * positions.at(inst);
+}
+
+std::shared_ptr<HomeTable> coalescePhis(const llvm::Function &func) {
+    auto homes = std::make_shared<HomeTable>();
+    auto liveOut = liveOutSets(func);
+
+    std::unordered_map<const llvm::Instruction *, unsigned> positions;
+
+    for (const auto &bb : func) {
+        unsigned i = 0;
+
+        for (const auto &inst : bb) {
+            positions.insert(std::make_pair(&inst, i++));
+        }
+    }
+
+    // whether a value is still needed right after another is written
+    auto isLiveAt = [&](const llvm::Instruction *value,
+                        const llvm::Instruction *def) {
+        auto bb = def->getParent();
+        unsigned point = defPosition(def, positions);
+
+        // in SSA form, a value defined later in the block can't be live
+        if (value->getParent() == bb && defPosition(value, positions) > point)
+            return false;
+        if (liveOut[bb].count(value) > 0)
+            return true;
+
+        // an instruction reads its operands before it writes its result, so
+        // its own operands don't interfere with it
+        for (const auto user : value->users()) {
+            auto userInst = llvm::cast<llvm::Instruction>(user);
+
+            if (userInst->getParent() == bb && userInst != def &&
+                !llvm::isa<llvm::PHINode>(userInst) &&
+                2 * positions.at(userInst) > point)
+                return true;
+        }
+        return false;
+    };
+
+    auto interferes = [&](const llvm::Instruction *a,
+                          const llvm::Instruction *b) {
+        // the phis of a block are all copied to on the same edges
+        if (llvm::isa<llvm::PHINode>(a) && llvm::isa<llvm::PHINode>(b) &&
+            a->getParent() == b->getParent())
+            return true;
+        return isLiveAt(a, b) || isLiveAt(b, a);
+    };
+
+    // the members of each class, by the value whose slot they share
+    std::unordered_map<const llvm::Instruction *,
+                       std::vector<const llvm::Instruction *>>
+        classes;
+
+    auto leader = [&](const llvm::Instruction *inst) {
+        auto home = homes->find(inst);
+        return home != homes->end() ? home->second : inst;
+    };
+    auto members = [&](const llvm::Instruction *inst) {
+        auto found = classes.find(inst);
+
+        if (found == classes.end())
+            return std::vector<const llvm::Instruction *>{inst};
+        return found->second;
+    };
+
+    for (const auto &bb : func) {
+        for (const auto &phi : bb.phis()) {
+            for (const auto &incoming : phi.incoming_values()) {
+                auto value = llvm::dyn_cast<llvm::Instruction>(incoming.get());
+
+                if (value == nullptr || llvm::isa<llvm::AllocaInst>(value))
+                    continue;
+
+                auto a = leader(&phi);
+                auto b = leader(value);
+
+                if (a == b)
+                    continue;
+
+                auto classA = members(a);
+                auto classB = members(b);
+                bool disjoint = true;
+
+                for (const auto x : classA) {
+                    for (const auto y : classB) {
+                        disjoint = disjoint && !interferes(x, y);
+                    }
+                }
+
+                if (!disjoint)
+                    continue;
+
+                for (const auto y : classB) {
+                    (*homes)[y] = a;
+                    classA.push_back(y);
+                }
+                (*homes)[a] = a;
+                classes[a] = classA;
+                classes.erase(b);
+            }
+        }
+    }
+    return homes;
+}
+
+unsigned joinCoalescedEdges(llvm::Function &func, const HomeTable &homes) {
+    auto home = [&](const llvm::Value *value) -> const llvm::Value * {
+        auto inst = llvm::dyn_cast<llvm::Instruction>(value);
+        auto found = inst != nullptr ? homes.find(inst) : homes.end();
+        return found != homes.end() ? found->second : value;
+    };
+
+    std::vector<llvm::BasicBlock *> joinable;
+
+    for (auto &bb : func) {
+        auto pred = bb.getSinglePredecessor();
+        auto succ = bb.getSingleSuccessor();
+
+        if (pred == nullptr || succ == nullptr || bb.size() != 1 ||
+            succ->phis().empty())
+            continue;
+
+        bool copies = false;
+
+        for (const auto &phi : succ->phis()) {
+            auto value = phi.getIncomingValueForBlock(&bb);
+            copies |= !llvm::isa<llvm::UndefValue>(value) &&
+                      home(value) != home(&phi);
+        }
+
+        if (!copies)
+            joinable.push_back(&bb);
+    }
+
+    unsigned joined = 0;
+
+    for (auto bb : joinable) {
+        auto pred = bb->getSinglePredecessor();
+        auto succ = bb->getSingleSuccessor();
+
+        // the phis can't tell two edges from the same block apart
+        if (llvm::is_contained(llvm::successors(pred), succ))
+            continue;
+
+        pred->getTerminator()->replaceSuccessorWith(bb, succ);
+        succ->replacePhiUsesWith(bb, pred);
+        bb->eraseFromParent();
+        joined++;
+    }
+    return joined;
+}
+
+std::vector<std::pair<std::string, std::string>> sequentializeCopies(
+    const std::vector<std::pair<std::string, std::string>> &copies,
+    const std::string &temp) {
+    std::vector<std::pair<std::string, std::string>> moves;
+
+    // the source of each destination, and where the value that was in each
+    // source can be read from now
+    std::unordered_map<std::string, std::string> pred;
+    std::unordered_map<std::string, std::string> loc;
+
+    for (const auto &copy : copies) {
+        loc[copy.second] = copy.second;
+        pred[copy.first] = copy.second;
+    }
+
+    // a destination that no copy reads from can be written right away
+    std::vector<std::string> ready;
+    std::vector<std::string> todo;
+    std::set<std::string> written;
+
+    for (const auto &copy : copies) {
+        if (loc.count(copy.first) == 0)
+            ready.push_back(copy.first);
+        todo.push_back(copy.first);
+    }
+
+    while (!todo.empty()) {
+        while (!ready.empty()) {
+            auto dst = ready.back();
+            ready.pop_back();
+
+            auto src = pred[dst];
+            auto from = loc[src];
+            moves.push_back(std::make_pair(dst, from));
+            written.insert(dst);
+
+            // a source that is never written keeps its value, so the other
+            // copies from it read it there instead of from a copy
+            if (pred.count(src) > 0)
+                loc[src] = dst;
+
+            // once the last value waiting in the source has been copied out
+            // of it, the source can be overwritten
+            if (src == from && pred.count(src) > 0)
+                ready.push_back(src);
+        }
+
+        auto dst = todo.back();
+        todo.pop_back();
+
+        // Everything that is left is a cycle. Its destinations still hold
+        // values that other copies read, so one of them is moved out of the
+        // way, which lets the rest of the cycle go through.
+        if (written.count(dst) == 0) {
+            moves.push_back(std::make_pair(temp, dst));
+            loc[dst] = temp;
+            ready.push_back(dst);
+        }
+    }
+    return moves;
+}
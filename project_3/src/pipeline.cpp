@@ -0,0 +1,35 @@
+#include <iomanip>
+
+#include "pipeline.h"
+
+const size_t pipelineDepth = 8;
+
+StageTimer::StageTimer(StageTime &stage)
+    : stage(stage), start(std::chrono::steady_clock::now()) {}
+
+StageTimer::~StageTimer() {
+    stage.busy += std::chrono::steady_clock::now() - start;
+}
+
+void printStageTimes(const std::vector<StageTime> &stages,
+                     std::chrono::steady_clock::duration wall,
+                     std::ostream &out) {
+    auto ms = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(1) << "stages:";
+
+    for (const auto &stage : stages) {
+        // the share of the wall time that the stage was working
+        double utilization =
+            ms(wall) > 0 ? 100 * ms(stage.busy) / ms(wall) : 0;
+        out << " " << stage.name << "=" << ms(stage.busy) << "ms ("
+            << utilization << "%)";
+    }
+    out << " wall=" << ms(wall) << "ms\n";
+    out.flags(flags);
+    out.precision(precision);
+}
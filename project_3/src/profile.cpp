@@ -0,0 +1,166 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#include <llvm/IR/CFG.h>
+
+#include "profile.h"
+
+const char *const defaultProfilePath = "regalloc.prof";
+
+//! The magic bytes at the start of a profile file
+static const char profileMagic[] = "RAPF";
+
+std::shared_ptr<BlockIndexTable> numberBlocks(const llvm::Function &func,
+                                              unsigned first) {
+    auto table = std::make_shared<BlockIndexTable>();
+    unsigned index = first;
+
+    for (const auto &bb : func) {
+        table->insert(std::make_pair(&bb, index++));
+    }
+    return table;
+}
+
+void printBlockCounter(unsigned index, std::ostream &out) {
+    out << "\tincl .Lprof_counters+" << 4 * index << "\n";
+}
+
+void printProfileRuntime(unsigned numBlocks, const std::string &path,
+                         std::ostream &out) {
+    // The routine uses system calls directly so that it doesn't depend on a
+    // C library: open(2), write(2) and close(2) on 32 bit Linux
+    out << "\t.globl __regalloc_prof_dump\n"
+        << "\t.type __regalloc_prof_dump, @function\n"
+        << "__regalloc_prof_dump:\n"
+        << "\t.cfi_startproc\n"
+        << "\tpushl %ebx\n"
+        << "\t.cfi_def_cfa_offset 8\n"
+        << "\t.cfi_offset %ebx, -8\n"
+        << "\tmovl $5, %eax\n"
+        << "\tmovl $.Lprof_path, %ebx\n"
+        << "\tmovl $0x241, %ecx\n" // O_WRONLY | O_CREAT | O_TRUNC
+        << "\tmovl $0644, %edx\n"
+        << "\tint $0x80\n"
+        << "\ttestl %eax, %eax\n"
+        << "\tjs .Lprof_done\n"
+        << "\tmovl %eax, %ebx\n"
+        << "\tmovl $4, %eax\n"
+        << "\tmovl $.Lprof_data, %ecx\n"
+        << "\tmovl $" << 8 + 4 * numBlocks << ", %edx\n"
+        << "\tint $0x80\n"
+        << "\tmovl $6, %eax\n"
+        << "\tint $0x80\n"
+        << ".Lprof_done:\n"
+        << "\tpopl %ebx\n"
+        << "\t.cfi_restore %ebx\n"
+        << "\t.cfi_def_cfa_offset 4\n"
+        << "\tret\n"
+        << "\t.cfi_endproc\n"
+        << "\t.size __regalloc_prof_dump, .-__regalloc_prof_dump\n"
+        << "\t.section .fini_array, \"aw\"\n"
+        << "\t.long __regalloc_prof_dump\n"
+        << "\t.data\n"
+        << "\t.p2align 2\n"
+        << ".Lprof_data:\n"
+        << "\t.ascii \"" << profileMagic << "\"\n"
+        << "\t.long " << numBlocks << "\n"
+        << ".Lprof_counters:\n"
+        << "\t.zero " << 4 * numBlocks << "\n"
+        << ".Lprof_path:\n"
+        << "\t.asciz \"" << path << "\"\n"
+        << "\t.text\n";
+}
+
+std::vector<std::uint32_t> readProfile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("Could not open profile " + path);
+
+    char magic[4];
+    std::uint32_t numBlocks = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&numBlocks), sizeof(numBlocks));
+
+    if (!file || std::memcmp(magic, profileMagic, sizeof(magic)) != 0)
+        throw std::runtime_error("Malformed profile " + path);
+
+    std::vector<std::uint32_t> counters(numBlocks);
+    file.read(reinterpret_cast<char *>(counters.data()),
+              numBlocks * sizeof(std::uint32_t));
+
+    if (!file)
+        throw std::runtime_error("Truncated profile " + path);
+    return counters;
+}
+
+std::shared_ptr<BlockFrequencyTable>
+blockFrequencies(const BlockIndexTable &indices,
+                 const std::vector<std::uint32_t> &counters) {
+    auto frequencies = std::make_shared<BlockFrequencyTable>();
+
+    for (const auto &entry : indices) {
+        if (entry.second >= counters.size())
+            throw std::runtime_error(
+                "Profile was not collected from this module");
+
+        frequencies->insert(
+            std::make_pair(entry.first, counters[entry.second]));
+    }
+    return frequencies;
+}
+
+std::vector<const llvm::BasicBlock *>
+layoutBlocks(const llvm::Function &func,
+             const std::shared_ptr<BlockFrequencyTable> &frequencies) {
+    std::vector<const llvm::BasicBlock *> order;
+
+    if (frequencies == nullptr) {
+        for (const auto &bb : func) {
+            order.push_back(&bb);
+        }
+        return order;
+    }
+
+    std::set<const llvm::BasicBlock *> placed;
+    auto frequency = [&](const llvm::BasicBlock *bb) {
+        auto entry = frequencies->find(bb);
+        return entry == frequencies->end() ? 0u : entry->second;
+    };
+
+    const llvm::BasicBlock *current = &func.getEntryBlock();
+
+    while (order.size() < func.size()) {
+        // Start a new chain at the hottest block that hasn't been placed.
+        // Once only blocks that never ran are left, they keep their order in
+        // the IR.
+        if (current == nullptr) {
+            for (const auto &bb : func) {
+                if (placed.count(&bb) == 0 &&
+                    (current == nullptr || frequency(&bb) > frequency(current)))
+                    current = &bb;
+            }
+        }
+        order.push_back(current);
+        placed.insert(current);
+
+        // Continue the chain with the hottest successor that is free. A
+        // block that ran never pulls a block that didn't into its chain.
+        const llvm::BasicBlock *next = nullptr;
+
+        for (const auto succ : llvm::successors(current)) {
+            if (placed.count(succ) > 0)
+                continue;
+            if (next == nullptr || frequency(succ) > frequency(next))
+                next = succ;
+        }
+
+        if (next != nullptr && frequency(next) == 0 && frequency(current) > 0)
+            next = nullptr;
+        current = next;
+    }
+    return order;
+}
@@ -0,0 +1,209 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+const char *const defaultSocketPath = "/tmp/regalloc.sock";
+
+//! The largest frame that will be accepted, to guard against garbage lengths
+static const std::uint32_t maxFrameSize = 64 * 1024 * 1024;
+
+/*!
+ * \brief Write a buffer to a file descriptor, retrying on partial writes
+ *
+ * \returns Whether every byte was written
+ */
+static bool writeAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        auto written = send(fd, buf, len, MSG_NOSIGNAL);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        buf += written;
+        len -= written;
+    }
+    return true;
+}
+
+/*!
+ * \brief Read an exact number of bytes from a file descriptor
+ *
+ * \returns Whether every byte was read before the peer closed the connection
+ */
+static bool readAll(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        auto received = recv(fd, buf, len, 0);
+
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        buf += received;
+        len -= received;
+    }
+    return true;
+}
+
+/*!
+ * \brief Fill out a socket address for a filesystem path
+ *
+ * Throws if the path does not fit in the address structure.
+ */
+static sockaddr_un socketAddress(const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path is too long: " + path);
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+/*!
+ * \brief Append a length prefixed section to a payload
+ */
+static void appendSection(std::string &payload, const std::string &section) {
+    std::uint32_t length = htonl(static_cast<std::uint32_t>(section.size()));
+
+    payload.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    payload += section;
+}
+
+/*!
+ * \brief Read a length prefixed section from a payload
+ *
+ * \returns Whether the section was whole, in which case `offset` is moved
+ * past it
+ */
+static bool readSection(const std::string &payload, size_t &offset,
+                        std::string &section) {
+    std::uint32_t length = 0;
+
+    if (payload.size() - offset < sizeof(length))
+        return false;
+    std::memcpy(&length, payload.data() + offset, sizeof(length));
+    length = ntohl(length);
+    offset += sizeof(length);
+
+    if (payload.size() - offset < length)
+        return false;
+    section = payload.substr(offset, length);
+    offset += length;
+    return true;
+}
+
+std::string encodeRequest(const std::vector<std::string> &args,
+                          const std::string &ir) {
+    std::string flags;
+
+    for (const auto &arg : args) {
+        flags += arg;
+        flags += '\0';
+    }
+
+    std::string payload;
+    appendSection(payload, flags);
+    return payload + ir;
+}
+
+bool decodeRequest(const std::string &payload, std::vector<std::string> &args,
+                   std::string &ir) {
+    size_t offset = 0;
+    std::string flags;
+
+    if (!readSection(payload, offset, flags) ||
+        (!flags.empty() && flags.back() != '\0'))
+        return false;
+
+    args.clear();
+    for (size_t start = 0; start < flags.size();) {
+        size_t end = flags.find('\0', start);
+        args.push_back(flags.substr(start, end - start));
+        start = end + 1;
+    }
+    ir = payload.substr(offset);
+    return true;
+}
+
+std::string encodeResponse(ResponseStatus status,
+                           const std::string &diagnostics,
+                           const std::string &body) {
+    std::string payload(1, static_cast<char>(status));
+
+    appendSection(payload, diagnostics);
+    return payload + body;
+}
+
+bool decodeResponse(const std::string &payload, ResponseStatus &status,
+                    std::string &diagnostics, std::string &body) {
+    size_t offset = 1;
+
+    if (payload.empty() || !readSection(payload, offset, diagnostics))
+        return false;
+    status = static_cast<ResponseStatus>(payload[0]);
+    body = payload.substr(offset);
+    return true;
+}
+
+bool sendFrame(int fd, const std::string &payload) {
+    std::uint32_t length = htonl(static_cast<std::uint32_t>(payload.size()));
+
+    return writeAll(fd, reinterpret_cast<const char *>(&length),
+                    sizeof(length)) &&
+           writeAll(fd, payload.data(), payload.size());
+}
+
+bool recvFrame(int fd, std::string &payload) {
+    std::uint32_t length = 0;
+
+    if (!readAll(fd, reinterpret_cast<char *>(&length), sizeof(length)))
+        return false;
+    length = ntohl(length);
+
+    if (length > maxFrameSize)
+        return false;
+    payload.resize(length);
+    return readAll(fd, payload.data(), length);
+}
+
+int listenSocket(const std::string &path) {
+    auto addr = socketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        throw std::runtime_error("Could not create socket!");
+
+    // remove a socket file left behind by a previous server
+    unlink(path.c_str());
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not listen on socket " + path + ": " +
+                                 std::strerror(errno));
+    }
+    return fd;
+}
+
+int connectSocket(const std::string &path) {
+    auto addr = socketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        throw std::runtime_error("Could not create socket!");
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not connect to socket " + path + ": " +
+                                 std::strerror(errno));
+    }
+    return fd;
+}
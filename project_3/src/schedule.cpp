@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include "LLVMUtils.h"
+#include "schedule.h"
+
+/*!
+ * \brief Return whether an instruction may be moved past unrelated ones
+ *
+ * \param[in] inst The instruction
+ * \returns Whether only its operands and memory accesses constrain it
+ */
+static bool isMovable(const llvm::Instruction &inst) {
+    if (llvm::isa<llvm::LoadInst>(inst) || llvm::isa<llvm::StoreInst>(inst))
+        return !inst.isVolatile();
+
+    // division can trap, so it stays where it is
+    if (isArithmeticInst(inst) || llvm::isa<llvm::ICmpInst>(inst))
+        return !inst.isIntDivRem();
+    if (llvm::isa<llvm::SelectInst>(inst))
+        return true;
+    return llvm::isa<llvm::DbgInfoIntrinsic>(inst);
+}
+
+/*!
+ * \brief Return whether an instruction is a comparison fused into a branch
+ *
+ * \param[in] inst The instruction
+ * \returns Whether the instruction has to stay in front of the terminator
+ */
+static bool isFusedBranchCompare(const llvm::Instruction &inst) {
+    return isFusedCompare(inst) &&
+           llvm::isa<llvm::BranchInst>(inst.user_back());
+}
+
+/*!
+ * \brief Return the address that a load or store accesses
+ *
+ * \param[in] inst The instruction
+ * \returns The pointer operand, or `nullptr` for other instructions
+ */
+static const llvm::Value *accessedPointer(const llvm::Instruction &inst) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst))
+        return load->getPointerOperand();
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst))
+        return store->getPointerOperand();
+    return nullptr;
+}
+
+/*!
+ * \brief Return whether two pointers may refer to the same memory
+ *
+ * Distinct stack variables and globals never overlap. Anything else, such as
+ * a pointer passed in as an argument, may point anywhere.
+ *
+ * \param[in] a The first pointer
+ * \param[in] b The second pointer
+ * \returns Whether the pointers may alias
+ */
+static bool mayAlias(const llvm::Value *a, const llvm::Value *b) {
+    auto isObject = [](const llvm::Value *v) {
+        return llvm::isa<llvm::AllocaInst>(v) ||
+               llvm::isa<llvm::GlobalVariable>(v);
+    };
+    return a == b || !isObject(a) || !isObject(b);
+}
+
+/*!
+ * \brief Return whether an instruction must stay after an earlier one
+ *
+ * \param[in] earlier The instruction that comes first in the block
+ * \param[in] later The instruction that comes after it
+ * \returns Whether the two can't be swapped
+ */
+static bool mustFollow(const llvm::Instruction &earlier,
+                       const llvm::Instruction &later) {
+    if (!isMovable(earlier) || !isMovable(later))
+        return true;
+
+    for (const auto &operand : later.operands()) {
+        if (operand.get() == &earlier)
+            return true;
+    }
+
+    // two accesses conflict if either of them writes to the same memory
+    auto pointerA = accessedPointer(earlier);
+    auto pointerB = accessedPointer(later);
+
+    if (pointerA == nullptr || pointerB == nullptr)
+        return false;
+    if (!earlier.mayWriteToMemory() && !later.mayWriteToMemory())
+        return false;
+    return mayAlias(pointerA, pointerB);
+}
+
+/*!
+ * \brief Return whether a value competes for a register in its block
+ *
+ * \param[in] inst The instruction that defines the value
+ * \returns Whether the value is allocated a register
+ */
+static bool needsRegister(const llvm::Instruction &inst) {
+    return !inst.getType()->isVoidTy() && !inst.use_empty() &&
+           !llvm::isa<llvm::AllocaInst>(inst) &&
+           !llvm::isa<llvm::PHINode>(inst) && !isFusedCompare(inst) &&
+           !isLiveOut(inst);
+}
+
+/*!
+ * \brief Return the largest number of values live at once in an order
+ *
+ * This follows the intervals that the allocator builds: a value is live from
+ * its definition until its last use in the block, including both ends.
+ *
+ * \param[in] order The instructions of the block
+ * \returns The peak register pressure
+ */
+static unsigned
+peakPressure(const std::vector<llvm::Instruction *> &order) {
+    std::unordered_map<const llvm::Instruction *, int> position;
+
+    for (size_t i = 0; i < order.size(); i++) {
+        position.insert(std::make_pair(order[i], i));
+    }
+
+    // the change in the number of live values at each position
+    std::vector<int> delta(order.size() + 1, 0);
+
+    for (size_t i = 0; i < order.size(); i++) {
+        if (!needsRegister(*order[i]))
+            continue;
+
+        int end = i;
+
+        for (const auto user : order[i]->users()) {
+            auto userInst = llvm::cast<llvm::Instruction>(user);
+
+            // uses by a fused comparison happen at its user
+            if (isFusedCompare(*userInst))
+                userInst = llvm::cast<llvm::Instruction>(userInst->user_back());
+            end = std::max(end, position.at(userInst));
+        }
+        delta[i]++;
+        delta[end + 1]--;
+    }
+
+    int live = 0;
+    int peak = 0;
+
+    for (auto d : delta) {
+        live += d;
+        peak = std::max(peak, live);
+    }
+    return peak;
+}
+
+unsigned latency(const llvm::Instruction &inst) {
+    if (llvm::isa<llvm::LoadInst>(inst))
+        return 4;
+    if (inst.getOpcode() == llvm::Instruction::Mul)
+        return 3;
+    return 1;
+}
+
+unsigned scheduleBlock(llvm::BasicBlock &bb, unsigned numRegisters) {
+    // Allocas and phis stay at the top of the block, and the terminator and
+    // the comparison fused into it stay at the bottom. Everything in between
+    // is scheduled.
+    std::vector<llvm::Instruction *> head;
+    std::vector<llvm::Instruction *> body;
+    std::vector<llvm::Instruction *> tail;
+
+    for (auto &inst : bb) {
+        if (llvm::isa<llvm::AllocaInst>(inst) || llvm::isa<llvm::PHINode>(inst))
+            head.push_back(&inst);
+        else if (inst.isTerminator() || isFusedBranchCompare(inst))
+            tail.push_back(&inst);
+        else
+            body.push_back(&inst);
+    }
+
+    size_t n = body.size();
+
+    if (n < 2)
+        return 0;
+
+    // the dependence graph, as the successors of each instruction along with
+    // the number of cycles the successor has to wait
+    std::vector<std::vector<std::pair<size_t, unsigned>>> successors(n);
+    std::vector<unsigned> numPredecessors(n, 0);
+
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < j; i++) {
+            if (!mustFollow(*body[i], *body[j]))
+                continue;
+
+            // only a value flowing from one to the other makes it wait
+            bool usesResult = false;
+            for (const auto &operand : body[j]->operands()) {
+                usesResult |= operand.get() == body[i];
+            }
+            successors[i].push_back(
+                std::make_pair(j, usesResult ? latency(*body[i]) : 0));
+            numPredecessors[j]++;
+        }
+    }
+
+    // the length of the longest path from each instruction to the end of the
+    // block, which is the priority of the instruction
+    std::vector<unsigned> height(n, 0);
+
+    for (size_t i = n; i-- > 0;) {
+        height[i] = latency(*body[i]);
+
+        for (const auto &succ : successors[i]) {
+            height[i] = std::max(height[i], succ.second + height[succ.first]);
+        }
+    }
+
+    // the number of uses of each value that haven't been scheduled yet, to
+    // tell when an instruction frees the register of one of its operands
+    std::unordered_map<const llvm::Instruction *, unsigned> pendingUses;
+    std::unordered_map<const llvm::Instruction *, size_t> bodyIndex;
+
+    for (size_t i = 0; i < n; i++) {
+        bodyIndex.insert(std::make_pair(body[i], i));
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (const auto &operand : body[i]->operands()) {
+            auto def = llvm::dyn_cast<llvm::Instruction>(operand.get());
+
+            if (def != nullptr && bodyIndex.count(def) > 0)
+                pendingUses[def]++;
+        }
+    }
+
+    // the change in live values if an instruction were issued next
+    auto pressureDelta = [&](size_t i) {
+        int delta = needsRegister(*body[i]) ? 1 : 0;
+
+        for (const auto &operand : body[i]->operands()) {
+            auto def = llvm::dyn_cast<llvm::Instruction>(operand.get());
+
+            if (def == nullptr || !needsRegister(*def) ||
+                bodyIndex.count(def) == 0)
+                continue;
+
+            unsigned uses = 0;
+            for (const auto &other : body[i]->operands()) {
+                uses += other.get() == def;
+            }
+
+            // the value is still needed by the block's tail
+            bool usedByTail = false;
+            for (const auto user : def->users()) {
+                auto userInst = llvm::cast<llvm::Instruction>(user);
+                usedByTail |= bodyIndex.count(userInst) == 0;
+            }
+
+            if (pendingUses[def] == uses && !usedByTail)
+                delta--;
+        }
+        return delta;
+    };
+
+    // issue one instruction per cycle
+    std::vector<unsigned> readyAt(n, 0);
+    std::vector<size_t> ready;
+    std::vector<size_t> order;
+    unsigned cycle = 0;
+    int live = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (numPredecessors[i] == 0)
+            ready.push_back(i);
+    }
+
+    while (!ready.empty()) {
+        // whether the result of an instruction would still find a register
+        auto fits = [&](size_t i) {
+            int defined = needsRegister(*body[i]) ? 1 : 0;
+            return live + defined <= static_cast<int>(numRegisters);
+        };
+
+        auto better = [&](size_t a, size_t b) {
+            // when registers run out, issue whatever frees the most of them
+            if (fits(a) != fits(b))
+                return fits(a);
+            if (!fits(a) && pressureDelta(a) != pressureDelta(b))
+                return pressureDelta(a) < pressureDelta(b);
+
+            bool availA = readyAt[a] <= cycle;
+            bool availB = readyAt[b] <= cycle;
+
+            if (availA != availB)
+                return availA;
+            if (!availA && readyAt[a] != readyAt[b])
+                return readyAt[a] < readyAt[b];
+            if (height[a] != height[b])
+                return height[a] > height[b];
+            return a < b;
+        };
+        auto best = ready.begin();
+
+        for (auto it = ready.begin(); it != ready.end(); it++) {
+            if (better(*it, *best))
+                best = it;
+        }
+
+        size_t next = *best;
+        ready.erase(best);
+        live += pressureDelta(next);
+        cycle = std::max(cycle, readyAt[next]);
+        order.push_back(next);
+
+        for (const auto &operand : body[next]->operands()) {
+            auto def = llvm::dyn_cast<llvm::Instruction>(operand.get());
+
+            if (def != nullptr && bodyIndex.count(def) > 0)
+                pendingUses[def]--;
+        }
+
+        for (const auto &succ : successors[next]) {
+            readyAt[succ.first] =
+                std::max(readyAt[succ.first], cycle + succ.second);
+
+            if (--numPredecessors[succ.first] == 0)
+                ready.push_back(succ.first);
+        }
+        cycle++;
+    }
+
+    // keep the original order if the new one needs more registers than are
+    // available and more than the original did
+    std::vector<llvm::Instruction *> original = head;
+    std::vector<llvm::Instruction *> scheduled = head;
+
+    for (size_t i = 0; i < n; i++) {
+        original.push_back(body[i]);
+        scheduled.push_back(body[order[i]]);
+    }
+    original.insert(original.end(), tail.begin(), tail.end());
+    scheduled.insert(scheduled.end(), tail.begin(), tail.end());
+
+    unsigned peak = peakPressure(scheduled);
+
+    if (peak > numRegisters && peak > peakPressure(original))
+        return 0;
+
+    // move the instructions into their new order in front of the tail
+    unsigned moved = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        body[order[i]]->moveBefore(tail.front());
+
+        if (order[i] != i)
+            moved++;
+    }
+    return moved;
+}
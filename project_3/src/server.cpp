@@ -0,0 +1,134 @@
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include <llvm/IR/Module.h>
+
+#include "LLVMUtils.h"
+#include "codegen.h"
+#include "flags.h"
+#include "protocol.h"
+#include "server.h"
+
+//! The number of requests a context serves before it is replaced
+static const unsigned maxContextUses = 1024;
+
+ContextPool::ContextPool(unsigned size) {
+    for (unsigned i = 0; i < size; i++) {
+        available.push_back({std::make_unique<llvm::LLVMContext>(), 0});
+    }
+}
+
+PooledContext ContextPool::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    released.wait(guard, [this] { return !available.empty(); });
+
+    auto pooled = std::move(available.back());
+    available.pop_back();
+    return pooled;
+}
+
+void ContextPool::release(PooledContext pooled) {
+    // recycle contexts that have accumulated too much uniqued state. This is
+    // done outside of the lock because creating a context isn't free.
+    if (++pooled.uses >= maxContextUses) {
+        pooled.context = std::make_unique<llvm::LLVMContext>();
+        pooled.uses = 0;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        available.push_back(std::move(pooled));
+    }
+    released.notify_one();
+}
+
+std::string compileModule(const std::string &ir,
+                          const std::vector<std::string> &args,
+                          llvm::LLVMContext &context, std::ostream &err) {
+    CompileFlags flags;
+    std::string filename;
+
+    // the command line is parsed as the program would parse its own
+    for (size_t i = 0; i < args.size(); i++) {
+        if (parseFlag(args, i, flags))
+            continue;
+
+        if (!filename.empty())
+            throw std::invalid_argument("Unexpected argument: " + args[i]);
+        filename = args[i];
+    }
+
+    // requests are already compiled in parallel, one per connection
+    auto options = codeGenOptions(flags);
+    options.pipeline = false;
+
+    auto module = parseModule(ir, context, filename);
+    std::stringstream ss;
+    codeGen(module, ss, options, err);
+    return ss.str();
+}
+
+/*!
+ * \brief Serve requests on a connection until the client disconnects
+ *
+ * A client may send any number of requests over one connection. Each
+ * request is compiled with a context borrowed from the pool.
+ *
+ * \param[in] fd The connected socket
+ * \param[in] pool The shared context pool
+ */
+static void serveConnection(int fd, ContextPool &pool) {
+    std::string request;
+
+    while (recvFrame(fd, request)) {
+        std::vector<std::string> args;
+        std::string ir;
+
+        if (!decodeRequest(request, args, ir))
+            break;
+
+        auto pooled = pool.acquire();
+        std::stringstream err;
+        std::string response;
+
+        try {
+            auto assembly = compileModule(ir, args, *pooled.context, err);
+            response = encodeResponse(responseOk, err.str(), assembly);
+        } catch (const std::exception &e) {
+            response = encodeResponse(responseError, err.str(), e.what());
+        }
+        pool.release(std::move(pooled));
+
+        if (!sendFrame(fd, response))
+            break;
+    }
+    close(fd);
+}
+
+int runServer(const std::string &socketPath, unsigned poolSize) {
+    // a client hanging up mid-response should not take the server down
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (poolSize == 0)
+        poolSize = 1;
+
+    auto pool = std::make_shared<ContextPool>(poolSize);
+    int listener = listenSocket(socketPath);
+    std::cerr << "Listening on " << socketPath << " with " << poolSize
+              << " contexts\n";
+
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+
+        if (fd < 0)
+            continue;
+
+        // each connection gets its own thread; the pool bounds how many
+        // modules are actually compiled at once
+        std::thread([fd, pool] { serveConnection(fd, *pool); }).detach();
+    }
+}
@@ -0,0 +1,54 @@
+; A loop that draws a pseudo-random number on every iteration and adds it to
+; one of two sums depending on whether it is below %limit. With %limit = 0 the
+; outcome is as good as a coin flip, so the branch is mispredicted about half
+; of the time unless the diamond is turned into conditional moves. With
+; %limit = -2147483648 the branch always goes the same way.
+
+define i32 @branchy(i32 %n, i32 %limit) {
+entry:
+  %i = alloca i32, align 4
+  %x = alloca i32, align 4
+  %pos = alloca i32, align 4
+  %neg = alloca i32, align 4
+  store i32 0, i32* %i, align 4
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* %pos, align 4
+  store i32 0, i32* %neg, align 4
+  br label %cond
+
+cond:
+  %iv = load i32, i32* %i, align 4
+  %more = icmp slt i32 %iv, %n
+  br i1 %more, label %body, label %exit
+
+body:
+  %xv = load i32, i32* %x, align 4
+  %scaled = mul i32 %xv, 1103515245
+  %next = add i32 %scaled, 12345
+  store i32 %next, i32* %x, align 4
+  %negative = icmp slt i32 %next, %limit
+  br i1 %negative, label %then, label %else
+
+then:
+  %nv = load i32, i32* %neg, align 4
+  %n1 = sub i32 %nv, %next
+  store i32 %n1, i32* %neg, align 4
+  br label %latch
+
+else:
+  %pv = load i32, i32* %pos, align 4
+  %p1 = add i32 %pv, %next
+  store i32 %p1, i32* %pos, align 4
+  br label %latch
+
+latch:
+  %i1 = add i32 %iv, 1
+  store i32 %i1, i32* %i, align 4
+  br label %cond
+
+exit:
+  %pr = load i32, i32* %pos, align 4
+  %nr = load i32, i32* %neg, align 4
+  %r = sub i32 %pr, %nr
+  ret i32 %r
+}
@@ -0,0 +1,25 @@
+; Two independent chains of multiplications, written one after the other.
+; Each multiplication needs the result of the one before it, so issuing the
+; chains in IR order waits on every `imull`, while interleaving them overlaps
+; the two chains without needing more registers.
+
+define i32 @chains(i32 %a, i32 %b) {
+  %1 = alloca i32, align 4
+  %2 = alloca i32, align 4
+  store i32 %a, i32* %1, align 4
+  store i32 %b, i32* %2, align 4
+  %3 = load i32, i32* %1, align 4
+  %4 = mul nsw i32 %3, %3
+  %5 = mul nsw i32 %4, %4
+  %6 = mul nsw i32 %5, %5
+  %7 = mul nsw i32 %6, %6
+  %8 = mul nsw i32 %7, %7
+  %9 = load i32, i32* %2, align 4
+  %10 = mul nsw i32 %9, %9
+  %11 = mul nsw i32 %10, %10
+  %12 = mul nsw i32 %11, %11
+  %13 = mul nsw i32 %12, %12
+  %14 = mul nsw i32 %13, %13
+  %15 = add nsw i32 %8, %14
+  ret i32 %15
+}
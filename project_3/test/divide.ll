@@ -0,0 +1,21 @@
+; Division and calls read and write fixed registers: `idivl` takes its
+; dividend in %eax and overwrites %edx, and calls overwrite %eax, %ecx and
+; %edx. Values that live across them have to stay out of those registers.
+
+define i32 @scale(i32 %x, i32 %y) {
+  %1 = mul nsw i32 %x, 3
+  %2 = sub nsw i32 %1, %y
+  ret i32 %2
+}
+
+define i32 @divide(i32 %a, i32 %b) {
+  %1 = add nsw i32 %a, 100
+  %2 = sdiv i32 %1, %b
+  %3 = srem i32 %1, %b
+  %4 = mul nsw i32 %2, 7
+  %5 = call i32 @scale(i32 %4, i32 %3)
+  %6 = udiv i32 %5, 3
+  %7 = add nsw i32 %6, %3
+  %8 = add nsw i32 %7, %2
+  ret i32 %8
+}
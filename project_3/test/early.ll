@@ -0,0 +1,34 @@
+; Sums n multiples of step, returning straight away when there is nothing to
+; sum. Only the loop needs stack slots, so the early return skips the
+; prologue and the epilogue.
+
+define i32 @sumMultiples(i32 %n, i32 %step) {
+entry:
+  %i = alloca i32, align 4
+  %acc = alloca i32, align 4
+  %empty = icmp sle i32 %n, 0
+  br i1 %empty, label %none, label %init
+
+none:
+  ret i32 0
+
+init:
+  store i32 0, i32* %i, align 4
+  store i32 0, i32* %acc, align 4
+  br label %loop
+
+loop:
+  %iv = load i32, i32* %i, align 4
+  %a = load i32, i32* %acc, align 4
+  %t = mul i32 %iv, %step
+  %a2 = add i32 %a, %t
+  store i32 %a2, i32* %acc, align 4
+  %iv2 = add i32 %iv, 1
+  store i32 %iv2, i32* %i, align 4
+  %more = icmp slt i32 %iv2, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %r = load i32, i32* %acc, align 4
+  ret i32 %r
+}
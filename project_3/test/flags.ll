@@ -0,0 +1,40 @@
+; Comparisons whose result the flags already hold. The counter of `countdown`
+; is tested for zero right after it is decremented, so `subl` sets the flags
+; that the branch reads. `clamp` compares the same pair of values twice, the
+; second time the other way around, and starts its sum from zero, which is
+; moved to a register with `xorl` because nothing reads the flags there.
+
+define i32 @countdown(i32 %n, i32 %step) {
+entry:
+  %empty = icmp eq i32 %n, 0
+  br i1 %empty, label %done, label %loop
+
+loop:
+  %i = phi i32 [ %n, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %acc.next = add i32 %acc, %step
+  %i.next = sub i32 %i, 1
+  %more = icmp ne i32 %i.next, 0
+  br i1 %more, label %loop, label %done
+
+done:
+  %r = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  ret i32 %r
+}
+
+define i32 @clamp(i32 %x, i32 %limit) {
+entry:
+  %low = icmp slt i32 %x, %limit
+  %min = select i1 %low, i32 %x, i32 %limit
+  %high = icmp sgt i32 %limit, %x
+  %max = select i1 %high, i32 %limit, i32 %x
+  %sum = add i32 %min, %max
+  %zero = icmp eq i32 %sum, 0
+  br i1 %zero, label %empty, label %done
+
+empty:
+  ret i32 0
+
+done:
+  ret i32 %sum
+}
@@ -0,0 +1,40 @@
+; A function with debug locations, as clang emits them with -g. With -g,
+; RegAlloc maps the generated code back to the lines of clamp.c.
+
+define i32 @clamp(i32 %x, i32 %lo, i32 %hi) !dbg !6 {
+entry:
+  %r = alloca i32, align 4
+  store i32 %x, i32* %r, align 4, !dbg !10
+  %below = icmp slt i32 %x, %lo, !dbg !11
+  br i1 %below, label %low, label %check, !dbg !11
+
+low:
+  store i32 %lo, i32* %r, align 4, !dbg !12
+  br label %check, !dbg !12
+
+check:
+  %v = load i32, i32* %r, align 4, !dbg !13
+  %above = icmp sgt i32 %v, %hi, !dbg !13
+  %c = select i1 %above, i32 %hi, i32 %v, !dbg !14
+  %sum = add i32 %c, 0, !dbg !15
+  ret i32 %sum, !dbg !15
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "clamp.c", directory: "/src")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!6 = distinct !DISubprogram(name: "clamp", scope: !1, file: !1, line: 1, type: !7, scopeLine: 1, flags: DIFlagPrototyped, spFlags: DISPFlagDefinition, unit: !0, retainedNodes: !2)
+!7 = !DISubroutineType(types: !8)
+!8 = !{!9, !9, !9, !9}
+!9 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!10 = !DILocation(line: 2, column: 9, scope: !6)
+!11 = !DILocation(line: 3, column: 11, scope: !6)
+!12 = !DILocation(line: 4, column: 11, scope: !6)
+!13 = !DILocation(line: 5, column: 11, scope: !6)
+!14 = !DILocation(line: 6, column: 12, scope: !6)
+!15 = !DILocation(line: 7, column: 5, scope: !6)
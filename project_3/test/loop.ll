@@ -0,0 +1,41 @@
+; A counted loop whose body has a rarely taken arm. The rare arm comes first in
+; the IR, so the straightforward layout makes the common path jump over it on
+; every iteration. Profiling the loop lets the hot arm fall through instead.
+
+define i32 @loop(i32 %n, i32 %k) {
+entry:
+  %i = alloca i32, align 4
+  %s = alloca i32, align 4
+  store i32 0, i32* %i, align 4
+  store i32 0, i32* %s, align 4
+  br label %cond
+
+cond:
+  %iv = load i32, i32* %i, align 4
+  %more = icmp slt i32 %iv, %n
+  br i1 %more, label %body, label %exit
+
+body:
+  %sv = load i32, i32* %s, align 4
+  %rare = icmp eq i32 %iv, %k
+  br i1 %rare, label %then, label %else
+
+then:
+  %t = mul i32 %sv, 3
+  store i32 %t, i32* %s, align 4
+  br label %latch
+
+else:
+  %e = add i32 %sv, %iv
+  store i32 %e, i32* %s, align 4
+  br label %latch
+
+latch:
+  %next = add i32 %iv, 1
+  store i32 %next, i32* %i, align 4
+  br label %cond
+
+exit:
+  %r = load i32, i32* %s, align 4
+  ret i32 %r
+}
@@ -0,0 +1,42 @@
+; A straight-line kernel that keeps more values live at once than there are
+; registers. Every load is used long after it is defined, so most values
+; compete for the four registers at the same time.
+
+define i32 @pressure(i32 %a, i32 %b) {
+  %1 = alloca i32, align 4
+  %2 = alloca i32, align 4
+  %3 = alloca i32, align 4
+  %4 = alloca i32, align 4
+  %5 = alloca i32, align 4
+  %6 = alloca i32, align 4
+  store i32 %a, i32* %1, align 4
+  store i32 %b, i32* %2, align 4
+  store i32 3, i32* %3, align 4
+  store i32 5, i32* %4, align 4
+  %7 = load i32, i32* %1, align 4
+  %8 = load i32, i32* %2, align 4
+  %9 = load i32, i32* %3, align 4
+  %10 = load i32, i32* %4, align 4
+  %11 = add nsw i32 2, 3
+  %12 = mul nsw i32 %11, 4
+  %13 = add nsw i32 %7, %8
+  %14 = sub nsw i32 %9, %10
+  %15 = mul nsw i32 %13, %14
+  %16 = add nsw i32 %15, %7
+  %17 = sub nsw i32 %16, %8
+  %18 = mul nsw i32 %17, %9
+  %19 = add nsw i32 %18, %10
+  %20 = add nsw i32 %19, %12
+  %21 = add nsw i32 %20, %11
+  store i32 %21, i32* %5, align 4
+  %22 = load i32, i32* %5, align 4
+  %23 = load i32, i32* %1, align 4
+  %24 = load i32, i32* %2, align 4
+  %25 = mul nsw i32 %23, %24
+  %26 = add nsw i32 %22, %25
+  %27 = sub nsw i32 %26, %7
+  %28 = add nsw i32 %27, %8
+  store i32 %28, i32* %6, align 4
+  %29 = load i32, i32* %6, align 4
+  ret i32 %29
+}
@@ -0,0 +1,57 @@
+; Loops in SSA form, as produced by `opt -passes=mem2reg`, which carry their
+; state in phis. The counter of `fib` shares a stack slot with its increment,
+; so only the pair of numbers is copied around the loop. `swap` exchanges two
+; phis on every iteration, which can only be done through a temporary.
+
+define i32 @fib(i32 %n, i32 %unused) {
+entry:
+  %empty = icmp sle i32 %n, 0
+  br i1 %empty, label %done, label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %a = phi i32 [ 0, %entry ], [ %b, %loop ]
+  %b = phi i32 [ 1, %entry ], [ %sum, %loop ]
+  %sum = add i32 %a, %b
+  %i.next = add i32 %i, 1
+  %more = icmp slt i32 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %r = phi i32 [ 0, %entry ], [ %b, %loop ]
+  ret i32 %r
+}
+
+define i32 @gcd(i32 %x, i32 %y) {
+entry:
+  %zero = icmp eq i32 %y, 0
+  br i1 %zero, label %done, label %loop
+
+loop:
+  %a = phi i32 [ %x, %entry ], [ %b, %loop ]
+  %b = phi i32 [ %y, %entry ], [ %rem, %loop ]
+  %rem = urem i32 %a, %b
+  %more = icmp ne i32 %rem, 0
+  br i1 %more, label %loop, label %done
+
+done:
+  %r = phi i32 [ %x, %entry ], [ %b, %loop ]
+  ret i32 %r
+}
+
+define i32 @swap(i32 %x, i32 %y) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %a = phi i32 [ %x, %entry ], [ %b, %loop ]
+  %b = phi i32 [ %y, %entry ], [ %a, %loop ]
+  %i.next = add i32 %i, 1
+  %more = icmp slt i32 %i.next, 5
+  br i1 %more, label %loop, label %done
+
+done:
+  %r = sub i32 %a, %b
+  ret i32 %r
+}
@@ -0,0 +1,18 @@
+; A straight-line kernel that needs five registers. Four computed values are
+; used by a chain of multiplications and again after it, so they stay live
+; alongside the partial product. None of them can be rematerialized.
+
+define i32 @wide(i32 %a, i32 %b) {
+  %1 = add nsw i32 %a, %b
+  %2 = sub nsw i32 %a, %b
+  %3 = mul nsw i32 %a, %b
+  %4 = add nsw i32 %a, 7
+  %5 = mul nsw i32 %1, %2
+  %6 = mul nsw i32 %5, %3
+  %7 = mul nsw i32 %6, %4
+  %8 = add nsw i32 %7, %1
+  %9 = sub nsw i32 %8, %2
+  %10 = mul nsw i32 %9, %3
+  %11 = add nsw i32 %10, %4
+  ret i32 %11
+}